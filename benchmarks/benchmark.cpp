@@ -0,0 +1,340 @@
+// End-to-end load/save benchmarks on synthetic workbooks.
+//
+// Usage: xlnt-benchmark [--scale=<factor>] [--repeat=<n>] [--only=<name>] [--dir=<path>] [--trace=<file>]
+//
+// Results are written to stdout as JSON, one entry per workbook shape. Each
+// phase reports the median wall time over --repeat runs in milliseconds, so
+// two runs can be diffed (or thresholded) to catch regressions. --trace also
+// writes every load/save as a Chrome trace (open in chrome://tracing).
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <xlnt/xlnt.hpp>
+
+namespace {
+
+struct shape
+{
+    std::string name;
+    std::string description;
+    row_t rows;
+    column_t columns;
+    // only every nth cell is populated (1 = dense)
+    std::size_t stride;
+    std::function<void(xlnt::cell, row_t, column_t)> fill;
+};
+
+struct result
+{
+    std::string name;
+    std::string description;
+    std::size_t cells;
+    std::size_t file_bytes;
+    double generate_ms;
+    double save_ms;
+    double load_ms;
+    double iterate_ms;
+    double random_access_ms;
+    std::size_t random_accesses;
+};
+
+typedef std::chrono::steady_clock clock_type;
+
+double elapsed_ms(clock_type::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+}
+
+double median(std::vector<double> samples)
+{
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+std::size_t file_size(const std::string &path)
+{
+    std::FILE *file = std::fopen(path.c_str(), "rb");
+
+    if(file == nullptr)
+    {
+        return 0;
+    }
+
+    std::fseek(file, 0, SEEK_END);
+    auto size = static_cast<std::size_t>(std::ftell(file));
+    std::fclose(file);
+
+    return size;
+}
+
+std::vector<shape> make_shapes(double scale)
+{
+    auto scaled = [scale](double n) { return static_cast<row_t>(std::max(1.0, n * scale)); };
+
+    std::vector<shape> shapes;
+
+    shapes.push_back({"wide", "numbers, few rows, many columns", scaled(200), 2000, 1,
+        [](xlnt::cell c, row_t row, column_t column) { c.set_value(row * 0.5 + column); }});
+
+    shapes.push_back({"tall", "numbers, many rows, few columns", scaled(100000), 8, 1,
+        [](xlnt::cell c, row_t row, column_t column) { c.set_value(static_cast<int>(row * 8 + column)); }});
+
+    shapes.push_back({"sparse", "numbers, one populated cell in 97", scaled(20000), 200, 97,
+        [](xlnt::cell c, row_t row, column_t column) { c.set_value(row / (column + 1.0)); }});
+
+    shapes.push_back({"strings", "text, half repeated and half unique", scaled(50000), 10, 1,
+        [](xlnt::cell c, row_t row, column_t column)
+        {
+            if(column % 2 == 0)
+            {
+                c.set_value("category " + std::to_string(row % 100));
+            }
+            else
+            {
+                c.set_value("unique text for row " + std::to_string(row) + " column " + std::to_string(column));
+            }
+        }});
+
+    shapes.push_back({"styled", "numbers with number formats", scaled(50000), 10, 1,
+        [](xlnt::cell c, row_t row, column_t column)
+        {
+            c.set_value(row + column / 100.0);
+            c.set_number_format(column % 2 == 0 ? "0.00" : "0%");
+        }});
+
+    shapes.push_back({"formulas", "one input column and formulas reading the column to their left", scaled(50000), 4, 1,
+        [](xlnt::cell c, row_t row, column_t column)
+        {
+            if(column == 0)
+            {
+                c.set_value(static_cast<int>(row));
+                return;
+            }
+
+            auto source = xlnt::cell_reference(column - 1, row).to_string();
+            c.set_formula(source + "*2+1");
+        }});
+
+    return shapes;
+}
+
+xlnt::workbook generate(const shape &s, std::size_t &cells)
+{
+    xlnt::workbook wb;
+    wb.set_guess_types(false);
+    auto ws = wb.get_active_sheet();
+    cells = 0;
+
+    for(row_t row = 0; row < s.rows; row++)
+    {
+        for(column_t column = 0; column < s.columns; column++)
+        {
+            if((static_cast<std::size_t>(row) * s.columns + column) % s.stride != 0)
+            {
+                continue;
+            }
+
+            s.fill(ws.get_cell(xlnt::cell_reference(column, row)), row, column);
+            cells++;
+        }
+    }
+
+    return wb;
+}
+
+result run(const shape &s, std::size_t repeat, const std::string &directory)
+{
+    result r;
+    r.name = s.name;
+    r.description = s.description;
+
+    std::vector<double> generate_samples, save_samples, load_samples, iterate_samples, random_samples;
+    const std::string path = directory + "/xlnt-benchmark-" + s.name + ".xlsx";
+
+    for(std::size_t i = 0; i < repeat; i++)
+    {
+        auto start = clock_type::now();
+        auto wb = generate(s, r.cells);
+        generate_samples.push_back(elapsed_ms(start));
+
+        start = clock_type::now();
+        wb.save(path);
+        save_samples.push_back(elapsed_ms(start));
+        r.file_bytes = file_size(path);
+
+        xlnt::workbook loaded;
+        start = clock_type::now();
+        loaded.load(path);
+        load_samples.push_back(elapsed_ms(start));
+
+        auto ws = loaded.get_active_sheet();
+
+        // touch every value so the loop can't be optimized away
+        double checksum = 0;
+        start = clock_type::now();
+
+        for(auto row : ws.rows())
+        {
+            for(auto cell : row)
+            {
+                const auto &v = cell.get_value();
+                checksum += v.is(xlnt::value::type::numeric) ? v.as<double>() : static_cast<double>(v.to_string().size());
+            }
+        }
+
+        iterate_samples.push_back(elapsed_ms(start));
+
+        // fixed seed so every run and every build probes the same cells
+        std::mt19937 generator(12345);
+        std::uniform_int_distribution<std::size_t> index(0, static_cast<std::size_t>(s.rows) * s.columns / s.stride - 1);
+        r.random_accesses = std::min<std::size_t>(r.cells, 100000);
+        start = clock_type::now();
+
+        for(std::size_t j = 0; j < r.random_accesses; j++)
+        {
+            auto flat = index(generator) * s.stride;
+            auto cell = ws.get_cell(xlnt::cell_reference(static_cast<column_t>(flat % s.columns), static_cast<row_t>(flat / s.columns)));
+            checksum += cell.get_value().is(xlnt::value::type::null) ? 0 : 1;
+        }
+
+        random_samples.push_back(elapsed_ms(start));
+
+        if(checksum == -1)
+        {
+            std::cerr << checksum << std::endl;
+        }
+    }
+
+    std::remove(path.c_str());
+
+    r.generate_ms = median(generate_samples);
+    r.save_ms = median(save_samples);
+    r.load_ms = median(load_samples);
+    r.iterate_ms = median(iterate_samples);
+    r.random_access_ms = median(random_samples);
+
+    return r;
+}
+
+void write_json(std::ostream &out, const std::vector<result> &results, double scale, std::size_t repeat)
+{
+    out << "{\n";
+    out << "  \"scale\": " << scale << ",\n";
+    out << "  \"repeat\": " << repeat << ",\n";
+    out << "  \"benchmarks\": [\n";
+
+    for(std::size_t i = 0; i < results.size(); i++)
+    {
+        const auto &r = results[i];
+        out << "    {\n";
+        out << "      \"name\": \"" << r.name << "\",\n";
+        out << "      \"description\": \"" << r.description << "\",\n";
+        out << "      \"cells\": " << r.cells << ",\n";
+        out << "      \"file_bytes\": " << r.file_bytes << ",\n";
+        out << "      \"generate_ms\": " << r.generate_ms << ",\n";
+        out << "      \"save_ms\": " << r.save_ms << ",\n";
+        out << "      \"load_ms\": " << r.load_ms << ",\n";
+        out << "      \"iterate_ms\": " << r.iterate_ms << ",\n";
+        out << "      \"random_access_ms\": " << r.random_access_ms << ",\n";
+        out << "      \"random_accesses\": " << r.random_accesses << "\n";
+        out << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    out << "  ]\n";
+    out << "}\n";
+}
+
+bool parse_option(const char *argument, const char *name, std::string &value)
+{
+    auto length = std::strlen(name);
+
+    if(std::strncmp(argument, name, length) != 0 || argument[length] != '=')
+    {
+        return false;
+    }
+
+    value = argument + length + 1;
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    double scale = 1;
+    std::size_t repeat = 3;
+    std::string only;
+    std::string directory = ".";
+    std::string trace_path;
+
+    for(int i = 1; i < argc; i++)
+    {
+        std::string value;
+
+        if(parse_option(argv[i], "--scale", value))
+        {
+            scale = std::atof(value.c_str());
+        }
+        else if(parse_option(argv[i], "--repeat", value))
+        {
+            repeat = static_cast<std::size_t>(std::max(1, std::atoi(value.c_str())));
+        }
+        else if(parse_option(argv[i], "--only", value))
+        {
+            only = value;
+        }
+        else if(parse_option(argv[i], "--dir", value))
+        {
+            directory = value;
+        }
+        else if(parse_option(argv[i], "--trace", value))
+        {
+            trace_path = value;
+        }
+        else
+        {
+            std::cerr << "usage: " << argv[0] << " [--scale=<factor>] [--repeat=<n>] [--only=<name>] [--dir=<path>] [--trace=<file>]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<result> results;
+
+    if(!trace_path.empty())
+    {
+        xlnt::trace::start();
+    }
+
+    for(const auto &s : make_shapes(scale))
+    {
+        if(!only.empty() && s.name != only)
+        {
+            continue;
+        }
+
+        std::cerr << "running " << s.name << "..." << std::endl;
+        results.push_back(run(s, repeat, directory));
+    }
+
+    if(!trace_path.empty())
+    {
+        xlnt::trace::stop();
+        std::ofstream trace_file(trace_path);
+        xlnt::trace::write_chrome_json(trace_file);
+    }
+
+    write_json(std::cout, results, scale, repeat);
+
+    return 0;
+}
@@ -22,6 +22,7 @@
 // @author: see AUTHORS file
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 #include <utility>
@@ -64,12 +65,38 @@ public:
     /// ordinals by adding 64.
     /// </remarks>
     static std::string column_string_from_index(column_t column_index);
+
+    /// <summary>
+    /// Write the column letters for column_index into buffer, null-terminated,
+    /// and return the number of letters written.
+    /// </summary>
+    /// <remarks>
+    /// buffer must hold at least MaxStringLength characters.
+    /// </remarks>
+    static std::size_t column_string_from_index(column_t column_index, char *buffer);
     
     static std::pair<std::string, row_t> split_reference(const std::string &reference_string,
         bool &absolute_column, bool &absolute_row);
+
+    /// <summary>
+    /// Split a coordinate in [first, last) like "$B$12" into a 1-based column and row
+    /// without allocating. Returns false if the string isn't a valid reference.
+    /// </summary>
+    /// <remarks>
+    /// Letters are matched case-insensitively as ASCII, independent of the global locale.
+    /// </remarks>
+    static bool split_reference(const char *first, const char *last,
+        column_t &column, row_t &row, bool &absolute_column, bool &absolute_row);
+
+    /// <summary>
+    /// Buffer size that is always large enough for to_string(char *) and
+    /// column_string_from_index(column_t, char *), including the terminator.
+    /// </summary>
+    static const std::size_t MaxStringLength = 24;
     
     cell_reference();
     cell_reference(const char *reference_string);
+    cell_reference(const char *first, const char *last);
     cell_reference(const std::string &reference_string);
     cell_reference(const std::string &column, row_t row, bool absolute = false);
     cell_reference(column_t column, row_t row, bool absolute = false);
@@ -92,6 +119,15 @@ public:
     cell_reference make_offset(int column_offset, int row_offset) const;
     
     std::string to_string() const;
+
+    /// <summary>
+    /// Write this reference into buffer, null-terminated, and return its length.
+    /// </summary>
+    /// <remarks>
+    /// buffer must hold at least MaxStringLength characters.
+    /// </remarks>
+    std::size_t to_string(char *buffer) const;
+
     range_reference to_range() const;
     
     range_reference operator,(const cell_reference &other) const;
@@ -44,6 +44,7 @@ public:
 	value(const char *s);
 	value(const wchar_t *s);
 	value(const std::string &s);
+	value(std::string &&s);
 	value(const std::wstring &s);
     value(const date &d);
     value(const datetime &d);
@@ -22,6 +22,7 @@
 // @author: see AUTHORS file
 #pragma once
 
+#include <cstddef>
 #include <string>
 
 namespace xlnt {
@@ -37,6 +38,18 @@ struct date
     static date today();
     static date from_number(int days_since_base_year, calendar base_date);
 
+    /// <summary>
+    /// Convert count serials at once, giving the same results as calling
+    /// from_number on each. The loop is branch-free so it can be vectorized.
+    /// </summary>
+    static void from_numbers(const int *serials, std::size_t count, calendar base_date, date *result);
+
+    /// <summary>
+    /// Convert count dates at once, giving the same results as calling
+    /// to_number on each.
+    /// </summary>
+    static void to_numbers(const date *dates, std::size_t count, calendar base_date, int *result);
+
     date(int year, int month, int day)
         : year(year), month(month), day(day)
     {
@@ -75,6 +88,25 @@ struct datetime
     static datetime now();
     static datetime from_number(long double number, calendar base_date);
 
+    /// <summary>
+    /// Convert count serials at once, giving the same results as calling
+    /// from_number on each. The loop is branch-free so it can be vectorized.
+    /// </summary>
+    static void from_numbers(const double *serials, std::size_t count, calendar base_date, datetime *result);
+
+    /// <summary>
+    /// Convert count datetimes at once, giving the same results as calling
+    /// to_number on each.
+    /// </summary>
+    static void to_numbers(const datetime *datetimes, std::size_t count, calendar base_date, double *result);
+
+    /// <summary>
+    /// Convert between serials and seconds since 1970-01-01 00:00:00 (UTC is
+    /// assumed, serials carry no time zone).
+    /// </summary>
+    static void from_unix_times(const double *seconds, std::size_t count, calendar base_date, double *serials);
+    static void to_unix_times(const double *serials, std::size_t count, calendar base_date, double *seconds);
+
     datetime(int year, int month, int day, int hour = 0, int minute = 0, int second = 0, int microsecond = 0)
         : year(year), month(month), day(day), hour(hour), minute(minute), second(second), microsecond(microsecond)
     {
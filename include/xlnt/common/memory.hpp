@@ -0,0 +1,60 @@
+// Copyright (c) 2014 Thomas Fussell
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, WRISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE
+//
+// @license: http://www.opensource.org/licenses/mit-license.php
+// @author: see AUTHORS file
+#pragma once
+
+#include <cstddef>
+
+namespace xlnt {
+
+/// <summary>
+/// malloc-style functions through which xlnt obtains its bulk memory: worksheet
+/// cell storage, pugixml document nodes and miniz archive and compressor buffers.
+/// </summary>
+/// <remarks>
+/// allocate and reallocate return nullptr on failure and must return memory
+/// aligned for any type. Strings and other small containers inside xlnt still
+/// use operator new.
+/// </remarks>
+struct memory_functions
+{
+    void *(*allocate)(std::size_t size);
+    void *(*reallocate)(void *pointer, std::size_t size);
+    void (*deallocate)(void *pointer);
+};
+
+/// <summary>
+/// Route all of xlnt's bulk allocations through functions. This is process-wide
+/// and must be called before any workbook is created (or after all workbooks
+/// have been destroyed), since memory is always returned to the functions that
+/// allocated it.
+/// </summary>
+void set_memory_functions(const memory_functions &functions);
+
+/// <summary>
+/// Return to std::malloc, std::realloc and std::free.
+/// </summary>
+void reset_memory_functions();
+
+const memory_functions &get_memory_functions();
+
+} // namespace xlnt
@@ -0,0 +1,60 @@
+// Copyright (c) 2014 Thomas Fussell
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, WRISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE
+//
+// @license: http://www.opensource.org/licenses/mit-license.php
+// @author: see AUTHORS file
+#pragma once
+
+#include <iostream>
+
+namespace xlnt {
+
+/// <summary>
+/// Process-wide timeline of what workbook::load and workbook::save spend their time on:
+/// one span per zip entry inflated or deflated, per worksheet parsed or serialized,
+/// and for the shared string and style passes, each tagged with the calling thread.
+/// </summary>
+/// <remarks>
+/// Recording is off until start() is called and costs one relaxed atomic load per
+/// span while off. Setting TracingEnabled to false in config.hpp removes it entirely.
+/// </remarks>
+class trace
+{
+public:
+    /// <summary>
+    /// Discard previously recorded spans and start recording.
+    /// </summary>
+    static void start();
+
+    /// <summary>
+    /// Stop recording. Recorded spans are kept until the next start().
+    /// </summary>
+    static void stop();
+
+    static bool is_recording();
+
+    /// <summary>
+    /// Write the recorded spans in Chrome trace-event format, viewable in
+    /// chrome://tracing or https://ui.perfetto.dev.
+    /// </summary>
+    static void write_chrome_json(std::ostream &stream);
+};
+
+} // namespace xlnt
@@ -96,6 +96,12 @@ public:
     void writestr(const std::string &arcname, const std::string &bytes);
     void writestr(const zip_info &arcname, const std::string &bytes);
 
+    /// <summary>
+    /// Add member name of source to this archive as it is stored there, without
+    /// inflating and deflating it again.
+    /// </summary>
+    void write_from(zip_file &source, const std::string &name);
+
     std::string get_filename() const { return filename_; }
     
     std::string comment;
@@ -33,4 +33,7 @@ enum class limit_style
 
 const limit_style LimitStyle = limit_style::openpyxl;
 
+// Set to false to compile out xlnt::trace span recording
+const bool TracingEnabled = true;
+
 }
@@ -24,6 +24,7 @@
 #pragma once
 
 #include <iostream>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -37,6 +38,11 @@ class workbook;
 class worksheet;
 class zip_file;
 
+namespace detail {
+class shared_string_table;
+class xf_table;
+} // namespace detail
+
 class reader
 {
 public:
@@ -48,6 +54,7 @@ public:
     static std::string determine_document_type(const std::vector<std::pair<std::string, std::string>> &override_types);
     static worksheet read_worksheet(std::istream &handle, workbook &wb, const std::string &title, const std::vector<std::string> &string_table);
     static void read_worksheet(worksheet ws, const std::string &xml_string, const std::vector<std::string> &string_table, const std::vector<int> &number_format_ids);
+    static void read_worksheet(worksheet ws, const std::string &xml_string, const detail::shared_string_table &string_table, const std::shared_ptr<detail::xf_table> &xfs);
     static std::vector<std::string> read_shared_string(const std::string &xml_string);
     static std::string read_dimension(const std::string &xml_string);
     static document_properties read_properties_core(const std::string &xml_string);
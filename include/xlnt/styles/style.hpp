@@ -38,6 +38,7 @@ class style
 public:
     style(bool static_ = false) : static_(static_) {}
     style(const style &rhs);
+    style &operator=(const style &rhs) = default;
     
     style copy() const;
     
@@ -0,0 +1,88 @@
+// Copyright (c) 2014 Thomas Fussell
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, WRISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE
+//
+// @license: http://www.opensource.org/licenses/mit-license.php
+// @author: see AUTHORS file
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace xlnt {
+
+/// <summary>
+/// Cost of one step of workbook::load, workbook::save or workbook::append_rows.
+/// </summary>
+struct phase_metrics
+{
+    phase_metrics() : milliseconds(0), uncompressed_bytes(0), compressed_bytes(0), cells(0), strings(0), peak_cell_bytes(0) {}
+
+    /// <summary>
+    /// One of "open", "inflate", "read_workbook", "read_shared_strings", "read_styles", "read_worksheet",
+    /// "calculate", "collect_shared_strings", "write_part", "write_worksheet", "deflate", "copy_part", "append_rows" or "zip_save".
+    /// </summary>
+    std::string phase;
+
+    /// <summary>
+    /// Package part the step worked on (e.g. "xl/worksheets/sheet1.xml"), or the file name for "open", "calculate" and "zip_save".
+    /// </summary>
+    std::string part;
+
+    double milliseconds;
+
+    /// <summary>
+    /// XML bytes produced by inflate or the readers, or consumed by deflate or produced by the writers.
+    /// </summary>
+    std::size_t uncompressed_bytes;
+
+    /// <summary>
+    /// Bytes in the archive: the stored size for "inflate" and "copy_part" and the whole file for "zip_save".
+    /// </summary>
+    std::size_t compressed_bytes;
+
+    std::size_t cells;
+    std::size_t strings;
+
+    /// <summary>
+    /// For "read_worksheet": the most memory the sheet's cell storage held at
+    /// once while it was read, including blocks freed and reused since.
+    /// </summary>
+    std::size_t peak_cell_bytes;
+};
+
+/// <summary>
+/// Per-phase timings and volumes collected by the workbook::load, workbook::save and
+/// workbook::append_rows overloads that take this struct. Phases are listed in the order they ran.
+/// </summary>
+struct io_metrics
+{
+    io_metrics() : total_milliseconds(0), bytes_inflated(0), bytes_deflated(0), cells(0), strings(0) {}
+
+    std::vector<phase_metrics> phases;
+
+    double total_milliseconds;
+    std::size_t bytes_inflated;
+    std::size_t bytes_deflated;
+    std::size_t cells;
+    std::size_t strings;
+};
+
+} // namespace xlnt
@@ -35,10 +35,13 @@ namespace xlnt {
 
 class document_properties;
 class drawing;
+struct io_metrics;
 class range;
 class range_reference;
 class relationship;
+class value;
 class worksheet;
+class workbook_snapshot;
 
 namespace detail {    
     struct workbook_impl;
@@ -55,6 +58,13 @@ struct content_type
 /// <summary>
 /// workbook is the container for all other parts of the document.
 /// </summary>
+/// <remarks>
+/// Different sheets may be filled in from different threads at the same time.
+/// Creating, removing, looking up and renaming sheets is synchronized, so threads
+/// can also create their own sheets. Each sheet must only be written by one thread
+/// at a time, and workbook-wide settings (guess types, properties), snapshots and
+/// save must wait until the writers are done.
+/// </remarks>
 class workbook
 {
 public:
@@ -109,6 +119,35 @@ public:
 
     bool get_data_only() const;
     void set_data_only(bool data_only);
+
+    /// <summary>
+    /// When set before load, the shared string table is only indexed while
+    /// loading and each string is decoded the first time a cell holding it is
+    /// read. Opening a workbook with a huge string table of which little is read
+    /// becomes much cheaper, at the cost of keeping the raw table in memory until
+    /// every string has been decoded. Has no effect together with guess types,
+    /// which need every string to be decoded.
+    /// </summary>
+    bool get_lazy_shared_strings() const;
+    void set_lazy_shared_strings(bool lazy);
+
+    /// <summary>
+    /// While read-only, anything that would change the workbook, its sheets or
+    /// their cells throws read_only_workbook_exception, and looking up a cell that
+    /// doesn't exist returns a blank cell instead of creating one. Any number of
+    /// threads may then read the workbook concurrently without locking. Const
+    /// member functions never modify anything; non-const ones such as rows(),
+    /// get_cell or get_value may be used for reading too, except get_style. The
+    /// non-const get_style creates or copies the cell's style (loaded cells share
+    /// theirs), so in read-only mode styles have to be read through a const cell.
+    /// </summary>
+    /// <remarks>
+    /// Only call set_read_only while no other thread is using the workbook. Blank
+    /// cells handed out in read-only mode stay blank and are not saved.
+    /// Copies of a read-only workbook are writable.
+    /// </remarks>
+    void set_read_only(bool read_only);
+    bool is_read_only() const;
     
     //create
     worksheet create_sheet();
@@ -155,12 +194,88 @@ public:
     range get_named_range(const std::string &name);
     void remove_named_range(const std::string &name);
     
+    /// <summary>
+    /// Evaluate the formulas whose inputs changed since the last calculation and
+    /// store the results as the values of their cells. Returns how many formulas
+    /// were evaluated. Only edits made through cell::set_value, set_formula and
+    /// the worksheet's bulk writers are noticed, not assignments through the
+    /// reference returned by cell::get_value. After a load, the values stored
+    /// with formulas are taken as current. Formulas that can't be evaluated (text
+    /// that doesn't parse, unsupported functions or undefined names) are skipped
+    /// and keep the value their cells already had; circular references give 0.
+    /// Throws read_only_workbook_exception in read-only mode.
+    /// </summary>
+    std::size_t calculate();
+
+    /// <summary>
+    /// Whether save calls calculate before writing, so that the values stored
+    /// with formulas are up to date. On by default. After a load, the values
+    /// stored in the file are kept and only formulas without one, or whose
+    /// inputs have changed since, are evaluated. When off, cells are saved with
+    /// whatever values they hold. Read-only workbooks are never calculated.
+    /// </summary>
+    bool get_calculate_on_save() const;
+    void set_calculate_on_save(bool calculate);
+
+    /// <summary>
+    /// Set how many threads calculate may use, including the calling thread.
+    /// Formulas that don't depend on each other are evaluated in parallel when
+    /// there are enough of them. 0, the default, uses one thread per hardware
+    /// thread and 1 calculates on the calling thread only. The results don't
+    /// depend on this setting.
+    /// </summary>
+    void set_calculation_threads(std::size_t threads);
+    std::size_t get_calculation_threads() const;
+
     //serialization
+    /// <summary>
+    /// Write the workbook to a file. Formulas are calculated first unless
+    /// set_calculate_on_save(false) was called. After a load, sheets
+    /// that haven't changed since are copied from the loaded file without being
+    /// serialized or compressed again, as are its shared strings and styles while
+    /// no sheet needs new strings or has had a cell style changed. Any access
+    /// through a non-const cell or sheet handle that could change a sheet counts
+    /// as a change.
+    /// </summary>
+    /// <remarks>
+    /// This is why the loaded file is kept in memory until the workbook is
+    /// cleared or loads another file.
+    /// </remarks>
     bool save(std::vector<unsigned char> &data);
     bool save(const std::string &filename);
     bool load(const std::vector<unsigned char> &data);
     bool load(const std::string &filename);
     bool load(const std::istream &stream);
+
+    /// <summary>
+    /// Same as load/save(filename), additionally appending the time and volume of
+    /// each phase (inflate, XML parsing, cell insertion, serialization, deflate) to metrics.
+    /// </summary>
+    bool save(const std::string &filename, io_metrics &metrics);
+    bool load(const std::string &filename, io_metrics &metrics);
+
+    /// <summary>
+    /// Add rows after the last row of the sheet titled sheet_title in the file
+    /// filename without loading the workbook. Only that sheet is inflated, has the
+    /// rows spliced in before the end of its sheetData and its dimension widened,
+    /// and is deflated again; every other part is copied as stored. rows[i][j]
+    /// goes in column j + 1 and null values leave their cell out. Strings are
+    /// written inline rather than added to the shared string table and dates and
+    /// times as unformatted serial numbers.
+    /// Throws invalid_file_exception if the file can't be opened and
+    /// std::runtime_error if it has no such sheet.
+    /// </summary>
+    static void append_rows(const std::string &filename, const std::string &sheet_title, const std::vector<std::vector<value>> &rows);
+    static void append_rows(const std::string &filename, const std::string &sheet_title, const std::vector<std::vector<value>> &rows, io_metrics &metrics);
+
+    /// <summary>
+    /// Capture the current state of the workbook without copying any cells, e.g.
+    /// to save it in the background. Formulas are calculated first unless
+    /// set_calculate_on_save(false) was called, and lazily loaded strings are
+    /// decoded, so that saving the snapshot has nothing left to change in the
+    /// sheets. See workbook_snapshot.
+    /// </summary>
+    workbook_snapshot snapshot();
     
     bool operator==(const workbook &rhs) const;
     bool operator==(std::nullptr_t) const;
@@ -173,6 +288,10 @@ public:
     
 private:
     friend class worksheet;
+    friend class workbook_snapshot;
+    bool save(const std::string &filename, io_metrics *metrics);
+    bool load(const std::string &filename, io_metrics *metrics);
+    static void append_rows(const std::string &filename, const std::string &sheet_title, const std::vector<std::vector<value>> &rows, io_metrics *metrics);
     std::shared_ptr<detail::workbook_impl> d_;
 };
     
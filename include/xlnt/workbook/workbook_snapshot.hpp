@@ -0,0 +1,70 @@
+// Copyright (c) 2014 Thomas Fussell
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, WRISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE
+//
+// @license: http://www.opensource.org/licenses/mit-license.php
+// @author: see AUTHORS file
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace xlnt {
+
+class workbook;
+
+namespace detail {
+    struct snapshot_impl;
+} // namespace detail
+
+/// <summary>
+/// Read-only view of a workbook as it was when workbook::snapshot was called.
+/// </summary>
+/// <remarks>
+/// Taking a snapshot does not copy any cells. A worksheet is copied only when
+/// the workbook next changes it (or creates or looks up a cell through a
+/// non-const handle), so the cost is proportional to the sheets edited since.
+/// A snapshot may be saved or converted on another thread while the workbook
+/// keeps being edited on the thread that owns it. Saving reads the sheets in
+/// place, so while it runs, the workbook's first write to a sheet it hasn't
+/// changed since the snapshot waits for the save to finish. Sheets that are
+/// unchanged since the workbook was loaded are copied from the loaded file
+/// where possible, as workbook::save does.
+/// </remarks>
+class workbook_snapshot
+{
+public:
+    /// <summary>
+    /// Build an ordinary, independent workbook holding the snapshot's contents.
+    /// </summary>
+    workbook to_workbook() const;
+
+    bool save(const std::string &filename) const;
+    bool save(std::vector<unsigned char> &data) const;
+
+    std::vector<std::string> get_sheet_names() const;
+
+private:
+    friend class workbook;
+    explicit workbook_snapshot(std::shared_ptr<detail::snapshot_impl> d);
+    std::shared_ptr<detail::snapshot_impl> d_;
+};
+
+} // namespace xlnt
@@ -27,8 +27,10 @@
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "../cell/value.hpp"
 #include "../common/types.hpp"
 #include "../common/relationship.hpp"
 
@@ -43,6 +45,7 @@ class relationship;
 class workbook;
 
 struct date;
+struct datetime;
 
 namespace detail {    
 struct worksheet_impl;
@@ -297,6 +300,65 @@ public:
     void append(const std::unordered_map<std::string, std::string> &cells);
     void append(const std::unordered_map<int, std::string> &cells);
 
+    /// <summary>
+    /// Append a row below the highest row, moving cells[0..count) into columns A, B, ...
+    /// The row's storage is reserved once and no cell handles or string copies are made.
+    /// </summary>
+    void append_row(value *cells, std::size_t count);
+    void append_row(std::vector<value> &&cells);
+
+    /// <summary>
+    /// Append a row of heterogeneous values, e.g. ws.emplace_row(std::move(name), 42, 3.5, true).
+    /// Each argument is forwarded to a value constructor so rvalue strings are moved.
+    /// </summary>
+    template<typename... T>
+    void emplace_row(T &&... cells)
+    {
+        static_assert(sizeof...(T) > 0, "a row needs at least one cell");
+        value row[] = { value(std::forward<T>(cells))... };
+        append_row(row, sizeof...(T));
+    }
+
+    // bulk column access
+    /// <summary>
+    /// Set count consecutive cells going down from first_cell to values, creating
+    /// cells as needed. Existing styles are kept, but formulas are removed so
+    /// that workbook::calculate doesn't replace the values.
+    /// </summary>
+    /// <remarks>
+    /// Values are stored directly without going through cell handles. Strings
+    /// are stored as-is, even when the workbook guesses types.
+    /// </remarks>
+    void write_column(const cell_reference &first_cell, const double *values, std::size_t count);
+    void write_column(const cell_reference &first_cell, const std::vector<double> &values);
+    void write_column(const cell_reference &first_cell, const std::vector<std::string> &values);
+
+    /// <summary>
+    /// Set count consecutive cells going down from first_cell to dates, converted
+    /// to serials in the workbook's base date all at once. Like cell::set_value,
+    /// the cells get a date number format but otherwise keep their styles.
+    /// Existing formulas are removed.
+    /// </summary>
+    void write_column(const cell_reference &first_cell, const std::vector<date> &values);
+    void write_column(const cell_reference &first_cell, const std::vector<datetime> &values);
+
+    /// <summary>
+    /// Read count consecutive cells going down from first_cell into values. valid[i]
+    /// is false when the cell doesn't exist or doesn't hold a value of the requested
+    /// type, in which case values[i] is 0 or an empty string. Cells are never created.
+    /// </summary>
+    void read_column(const cell_reference &first_cell, std::size_t count, std::vector<double> &values, std::vector<bool> &valid) const;
+    void read_column(const cell_reference &first_cell, std::size_t count, std::vector<std::string> &values, std::vector<bool> &valid) const;
+
+    /// <summary>
+    /// Read count consecutive numeric cells going down from first_cell as dates
+    /// in the workbook's base date. The number format isn't checked. Invalid
+    /// entries are date(0, 0, 0) or datetime(0, 0, 0) and a date drops any time
+    /// of day.
+    /// </summary>
+    void read_column(const cell_reference &first_cell, std::size_t count, std::vector<date> &values, std::vector<bool> &valid) const;
+    void read_column(const cell_reference &first_cell, std::size_t count, std::vector<datetime> &values, std::vector<bool> &valid) const;
+
     // operators
     bool operator==(const worksheet &other) const;
     bool operator!=(const worksheet &other) const;
@@ -314,7 +376,9 @@ public:
     
     // page
     page_setup &get_page_setup();
+    const page_setup &get_page_setup() const;
     margins &get_page_margins();
+    const margins &get_page_margins() const;
     
     // auto filter
     range_reference get_auto_filter() const;
@@ -340,6 +404,7 @@ public:
 private:
     friend class workbook;
     friend class cell;
+    friend class reader;
     worksheet(detail::worksheet_impl *d);
     detail::worksheet_impl *d_;
 };
@@ -29,6 +29,10 @@
 #include <vector>
 
 namespace xlnt {
+
+namespace detail {
+class xf_table;
+} // namespace detail
     
 class relationship;
 class workbook;
@@ -54,6 +58,12 @@ public:
 		const std::vector<std::string> &string_table = {}, 
 		const std::unordered_map<std::size_t, std::string> &style_table = {});
 
+    /// <summary>
+    /// Write ws to be saved next to an unchanged copy of the styles.xml that
+    /// source_xfs was read from: each styled cell refers to its cell format there.
+    /// </summary>
+    static std::string write_worksheet(worksheet ws, const std::vector<std::string> &string_table, const detail::xf_table &source_xfs);
+
 	static std::string write_root_rels();
 
     static std::string write_workbook_rels(const workbook &wb);
@@ -62,6 +72,9 @@ public:
 
 private:
 	static std::string write_relationships(const std::vector<relationship> &relationships);
+
+    static std::string write_worksheet(worksheet ws, const std::vector<std::string> &string_table,
+        const std::unordered_map<std::size_t, std::string> &style_table, const detail::xf_table *source_xfs);
 };
     
 } // namespace xlnt
@@ -44,10 +44,14 @@ const std::string download_url = "https://github.com/tfussell/xlnt/archive/maste
 #include "worksheet/range_reference.hpp"
 #include "worksheet/range.hpp"
 #include "common/exceptions.hpp"
+#include "common/memory.hpp"
 #include "reader/reader.hpp"
 #include "common/string_table.hpp"
+#include "common/trace.hpp"
 #include "common/zip_file.hpp"
 #include "workbook/document_properties.hpp"
+#include "workbook/io_metrics.hpp"
+#include "workbook/workbook_snapshot.hpp"
 #include "cell/value.hpp"
 #include "cell/comment.hpp"
 #include "common/miniz.h"
@@ -1,7 +1,9 @@
 #include <algorithm>
+#include <cmath>
 #include <locale>
 #include <sstream>
 #include <codecvt>
+#include <iterator>
 
 #include <xlnt/cell/cell.hpp>
 #include <xlnt/cell/cell_reference.hpp>
@@ -9,15 +11,25 @@
 #include <xlnt/cell/value.hpp>
 #include <xlnt/common/datetime.hpp>
 #include <xlnt/common/relationship.hpp>
+#include <xlnt/worksheet/range_reference.hpp>
 #include <xlnt/worksheet/worksheet.hpp>
 #include <xlnt/common/exceptions.hpp>
 #include <xlnt/workbook/workbook.hpp>
 #include <xlnt/workbook/document_properties.hpp>
 
 #include "detail/cell_impl.hpp"
+#include "detail/number_conversion.hpp"
+#include "detail/worksheet_impl.hpp"
 
 namespace {
 
+// what const get_style() returns for unstyled cells, so it never has to allocate
+const xlnt::style DefaultStyle;
+
+// namespace scope rather than a function-local static, which VS2013 doesn't
+// initialize thread-safely and cells may be written from several threads
+const char *const PossibleBooleans[] = {"TRUE", "true", "FALSE", "false"};
+
 std::vector<std::string> split_string(const std::string &string, char delim = ' ')
 {
     std::stringstream ss(string);
@@ -55,11 +67,8 @@ xlnt::value::type data_type_for_value(const std::string &value)
             {
                 for(auto part : split)
                 {
-                    try
-                    {
-                        std::stoi(part);
-                    }
-                    catch(std::invalid_argument)
+                    int parsed = 0;
+                    if(!xlnt::detail::parse_int(part.c_str(), parsed))
                     {
                         return xlnt::value::type::string;
                     }
@@ -83,8 +92,7 @@ xlnt::value::type data_type_for_value(const std::string &value)
         strtod(value.c_str(), &p);
         if(*p != 0)
         {
-            static const std::vector<std::string> possible_booleans = {"TRUE", "true", "FALSE", "false"};
-            if(std::find(possible_booleans.begin(), possible_booleans.end(), value) != possible_booleans.end())
+            if(std::find(std::begin(PossibleBooleans), std::end(PossibleBooleans), value) != std::end(PossibleBooleans))
             {
                 return xlnt::value::type::boolean;
             }
@@ -149,16 +157,22 @@ bool cell::garbage_collectible() const
 
 value &cell::get_value()
 {
+    d_->parent_->before_reference();
+    d_->resolve_value();
     return d_->value_;
 }
 
 const value &cell::get_value() const
 {
+    d_->resolve_value();
     return d_->value_;
 }
 
 void cell::set_value(const value &v)
 {
+    d_->parent_->before_write();
+    d_->parent_->value_changed(d_->column_, d_->row_);
+    d_->discard_lazy_string();
     d_->value_ = v;
 }
 
@@ -171,6 +185,9 @@ void cell::set_value(const std::wstring &s)
 
 void cell::set_value(const std::string &s)
 {
+    d_->parent_->before_write();
+    d_->parent_->value_changed(d_->column_, d_->row_);
+    d_->discard_lazy_string();
     if(!get_parent().get_parent().get_guess_types())
     {
         d_->is_date_ = false;
@@ -227,26 +244,39 @@ void cell::set_value(const wchar_t *s)
 
 void cell::set_value(bool b)
 {
+    d_->parent_->before_write();
+    d_->parent_->value_changed(d_->column_, d_->row_);
+    d_->discard_lazy_string();
     d_->value_ = value(b);
 }
 
 void cell::set_value(int i)
 {
+    d_->parent_->before_write();
+    d_->parent_->value_changed(d_->column_, d_->row_);
+    d_->discard_lazy_string();
     d_->value_ = value(i);
 }
 
 void cell::set_value(long long int i)
 {
-    d_->value_ = value(i);
+    d_->parent_->before_write();
+    d_->parent_->value_changed(d_->column_, d_->row_);
+    d_->discard_lazy_string();
+    d_->value_ = value(static_cast<int64_t>(i));
 }
 
 void cell::set_value(double d)
 {
+    d_->parent_->before_write();
+    d_->parent_->value_changed(d_->column_, d_->row_);
+    d_->discard_lazy_string();
     d_->value_ = value(d);
 }
 
 void cell::set_value(const date &d)
 {
+    d_->parent_->before_write();
     d_->is_date_ = true;
     auto date_format_code = xlnt::number_format::lookup_format(14);
     auto number_format = xlnt::number_format(date_format_code);
@@ -257,6 +287,7 @@ void cell::set_value(const date &d)
 
 void cell::set_value(const datetime &d)
 {
+    d_->parent_->before_write();
     d_->is_date_ = true;
     auto date_format_code = xlnt::number_format::lookup_format(22);
     auto number_format = xlnt::number_format(date_format_code);
@@ -267,12 +298,14 @@ void cell::set_value(const datetime &d)
 
 void cell::set_value(const time &t)
 {
+    d_->parent_->before_write();
     d_->is_date_ = true;
     set_value(t.to_number());
 }
 
 void cell::set_value(const timedelta &t)
 {
+    d_->parent_->before_write();
     d_->is_date_ = true;
     set_value(t.to_number());
 }
@@ -294,12 +327,13 @@ std::string cell::get_column() const
 
 void cell::set_merged(bool merged)
 {
+    d_->parent_->before_write();
     d_->merged = merged;
 }
 
 bool cell::is_merged() const
 {
-    return d_->merged;
+    return d_->merged || (d_->parent_ != nullptr && d_->parent_->merged_cells_.contains(d_->column_, d_->row_));
 }
 
 bool cell::is_date() const
@@ -324,6 +358,9 @@ bool cell::operator==(const cell &comparand) const
         return d_ == nullptr;
     }
 
+    d_->resolve_value();
+    comparand.d_->resolve_value();
+
     return d_->value_ == comparand.d_->value_;
 }
 
@@ -331,18 +368,31 @@ style &cell::get_style()
 {
     if(d_->style_ == nullptr)
     {
+        d_->parent_->before_write();
         d_->style_ = new style();
     }
+    else if(d_->shared_style_)
+    {
+        d_->parent_->before_write();
+        d_->style_ = new style(*d_->style_);
+        d_->shared_style_ = false;
+    }
+    else
+    {
+        d_->parent_->before_reference();
+    }
+
+    if(!d_->parent_->is_read_only())
+    {
+        d_->parent_->styles_changed_ = true;
+    }
+
     return *d_->style_;
 }
 
 const style &cell::get_style() const
 {
-    if(d_->style_ == nullptr)
-    {
-        d_->style_ = new style();
-    }
-    return *d_->style_;
+    return d_->style_ == nullptr ? DefaultStyle : *d_->style_;
 }
     
 void cell::set_style(const xlnt::style &s)
@@ -381,8 +431,25 @@ bool cell::has_hyperlink() const
     return d_->has_hyperlink_;
 }
 
+void cell::set_number_format(const std::string &format_code)
+{
+    d_->parent_->before_write();
+    auto &format = get_style().get_number_format();
+    auto builtin = number_format::reversed_builtin_formats().find(format_code);
+
+    if(builtin != number_format::reversed_builtin_formats().end())
+    {
+        format.set_format_code(number_format::lookup_format(builtin->second));
+    }
+    else
+    {
+        format.set_format_code(format_code);
+    }
+}
+
 void cell::set_hyperlink(const std::string &hyperlink)
 {
+    d_->parent_->before_write();
     if(hyperlink.length() == 0 || std::find(hyperlink.begin(), hyperlink.end(), ':') == hyperlink.end())
     {
         throw data_type_exception();
@@ -399,12 +466,19 @@ void cell::set_hyperlink(const std::string &hyperlink)
 
 void cell::set_formula(const std::string &formula)
 {
+    d_->parent_->before_write();
     if(formula.length() == 0)
     {
         throw data_type_exception();
     }
 
+    if(d_->formula_.empty())
+    {
+        d_->parent_->formula_count_++;
+    }
+
     d_->formula_ = formula;
+    d_->parent_->formula_changed(d_->column_, d_->row_);
 }
 
 bool cell::has_formula() const
@@ -424,11 +498,19 @@ std::string cell::get_formula() const
 
 void cell::clear_formula()
 {
-    d_->formula_.clear();
+    d_->parent_->before_write();
+
+    if(!d_->formula_.empty())
+    {
+        d_->formula_.clear();
+        d_->parent_->formula_count_--;
+        d_->parent_->formula_changed(d_->column_, d_->row_);
+    }
 }
 
 void cell::set_comment(const xlnt::comment &c)
 {
+    d_->parent_->before_write();
     if(!has_comment())
     {
         get_parent().increment_comments();
@@ -439,6 +521,7 @@ void cell::set_comment(const xlnt::comment &c)
 
 void cell::clear_comment()
 {
+    d_->parent_->before_write();
     if(has_comment())
     {
         get_parent().decrement_comments();
@@ -1,4 +1,5 @@
-#include <locale>
+#include <algorithm>
+#include <cstring>
 
 #include <xlnt/cell/cell_reference.hpp>
 #include <xlnt/common/exceptions.hpp>
@@ -6,6 +7,28 @@
 
 #include "constants.hpp"
 
+namespace {
+
+// ASCII-only equivalents of isalpha/isdigit/toupper. Cell references are
+// always ASCII, so there is no need to consult (or lock) a std::locale.
+inline bool is_letter(char c)
+{
+    return static_cast<unsigned>((c | 0x20) - 'a') < 26u;
+}
+
+inline bool is_digit(char c)
+{
+    return static_cast<unsigned>(c - '0') < 10u;
+}
+
+// 1-based letter value, assumes is_letter(c)
+inline unsigned letter_value(char c)
+{
+    return static_cast<unsigned>((c | 0x20) - 'a') + 1;
+}
+
+} // namespace
+
 namespace xlnt {
     
 std::size_t cell_reference_hash::operator()(const cell_reference &k) const
@@ -25,15 +48,28 @@ cell_reference::cell_reference() : cell_reference(0, 0, false)
 }
 
 cell_reference::cell_reference(const std::string &string)
+: cell_reference(string.data(), string.data() + string.size())
 {
-    bool absolute = false;
-    auto split = split_reference(string, absolute, absolute);
-    *this = cell_reference(split.first, split.second, absolute);
 }
 
-cell_reference::cell_reference(const char *reference_string) : cell_reference(std::string(reference_string))
+cell_reference::cell_reference(const char *reference_string)
+: cell_reference(reference_string, reference_string + std::strlen(reference_string))
 {
-    
+}
+
+cell_reference::cell_reference(const char *first, const char *last)
+{
+    column_t column = 0;
+    row_t row = 0;
+    bool absolute_column = false;
+    bool absolute_row = false;
+
+    if(!split_reference(first, last, column, row, absolute_column, absolute_row))
+    {
+        throw cell_coordinates_exception(std::string(first, last));
+    }
+
+    *this = cell_reference(column - 1, row - 1, absolute_column || absolute_row);
 }
 
 cell_reference::cell_reference(const std::string &column, row_t row, bool absolute)
@@ -65,11 +101,40 @@ range_reference cell_reference::operator,(const xlnt::cell_reference &other) con
 
 std::string cell_reference::to_string() const
 {
+    char buffer[MaxStringLength];
+    return std::string(buffer, to_string(buffer));
+}
+
+std::size_t cell_reference::to_string(char *buffer) const
+{
+    char *out = buffer;
+
+    if(absolute_)
+    {
+        *out++ = '$';
+    }
+
+    out += column_string_from_index(column_index_ + 1, out);
+
     if(absolute_)
     {
-        return std::string("$") + column_string_from_index(column_index_ + 1) + "$" + std::to_string(row_index_ + 1);
+        *out++ = '$';
     }
-    return column_string_from_index(column_index_ + 1) + std::to_string(row_index_ + 1);
+
+    // write the row digits backwards then reverse them in place
+    char *digits = out;
+    row_t row = row_index_ + 1;
+
+    do
+    {
+        *out++ = static_cast<char>('0' + row % 10);
+        row /= 10;
+    } while(row > 0);
+
+    std::reverse(digits, out);
+    *out = '\0';
+
+    return static_cast<std::size_t>(out - buffer);
 }
 
 range_reference cell_reference::to_range() const
@@ -79,62 +144,66 @@ range_reference cell_reference::to_range() const
 
 std::pair<std::string, row_t> cell_reference::split_reference(const std::string &reference_string, bool &absolute_column, bool &absolute_row)
 {
-    absolute_column = false;
-    absolute_row = false;
-    
-    // Convert a coordinate string like 'B12' to a tuple ('B', 12)
-    bool column_part = true;
-    
-    std::string column_string;
-    
-    for(auto character : reference_string)
+    column_t column = 0;
+    row_t row = 0;
+
+    if(!split_reference(reference_string.data(), reference_string.data() + reference_string.size(), column, row, absolute_column, absolute_row))
     {
-        char upper = std::toupper(character, std::locale::classic());
-        
-        if(std::isalpha(character, std::locale::classic()))
-        {
-            if(column_part)
-            {
-                column_string.append(1, upper);
-            }
-            else
-            {
-                throw cell_coordinates_exception(reference_string);
-            }
-        }
-        else
-        {
-            if(column_part)
-            {
-                column_part = false;
-            }
-            else if(!(std::isdigit(character, std::locale::classic()) || character == '$'))
-            {
-                throw cell_coordinates_exception(reference_string);
-            }
-        }
+        throw cell_coordinates_exception(reference_string);
     }
-    
-    std::string row_string = reference_string.substr(column_string.length());
-    
-    if(row_string.length() == 0)
+
+    return {column_string_from_index(column), row};
+}
+
+bool cell_reference::split_reference(const char *first, const char *last, column_t &column, row_t &row, bool &absolute_column, bool &absolute_row)
+{
+    // Convert a coordinate string like '$B$12' to (2, 12) with both flags set
+    absolute_column = first != last && *first == '$';
+    first += absolute_column ? 1 : 0;
+
+    const char *column_end = first;
+    column_t column_index = 0;
+
+    while(column_end != last && is_letter(*column_end) && column_end - first < 3)
     {
-        throw cell_coordinates_exception(reference_string);
+        column_index = column_index * 26 + letter_value(*column_end++);
     }
 
-    if(column_string[0] == '$')
+    if(column_end == first)
     {
-        absolute_row = true;
-        column_string = column_string.substr(1);
+        return false;
     }
-    
-    if(row_string[0] == '$')
+
+    absolute_row = column_end != last && *column_end == '$';
+    const char *row_begin = column_end + (absolute_row ? 1 : 0);
+
+    if(row_begin == last)
     {
-        absolute_column = true;
-        row_string = row_string.substr(1);
+        return false;
     }
-    
-    return {column_string, std::stoi(row_string)};
+
+    std::uint64_t row_index = 0;
+
+    // at most ten digits so the accumulator can't overflow
+    for(const char *c = row_begin; c != last; ++c)
+    {
+        if(!is_digit(*c) || c - row_begin >= 10)
+        {
+            return false;
+        }
+
+        row_index = row_index * 10 + static_cast<unsigned>(*c - '0');
+    }
+
+    if(row_index == 0 || row_index > constants::MaxRow || column_index > constants::MaxColumn)
+    {
+        return false;
+    }
+
+    column = column_index;
+    row = static_cast<row_t>(row_index);
+
+    return true;
 }
 
 cell_reference cell_reference::make_offset(int column_offset, int row_offset) const
@@ -157,55 +226,56 @@ column_t cell_reference::column_index_from_string(const std::string &column_stri
     }
     
     column_t column_index = 0;
-    int place = 1;
     
-    for(int i = static_cast<int>(column_string.length()) - 1; i >= 0; i--)
+    for(auto character : column_string)
     {
-        if(!std::isalpha(column_string[i], std::locale::classic()))
+        if(!is_letter(character))
         {
-	    throw column_string_index_exception();
+            throw column_string_index_exception();
         }
         
-        column_index += (std::toupper(column_string[i], std::locale::classic()) - 'A' + 1) * place;
-        place *= 26;
+        column_index = column_index * 26 + letter_value(character);
     }
     
     return column_index;
 }
 
-// Convert a column number into a column letter (3 -> 'C')
-// Right shift the column col_idx by 26 to find column letters in reverse
-// order.These numbers are 1 - based, and can be converted to ASCII
-// ordinals by adding 64.
 std::string cell_reference::column_string_from_index(column_t column_index)
+{
+    char buffer[MaxStringLength];
+    return std::string(buffer, column_string_from_index(column_index, buffer));
+}
+
+// Convert a column number into a column letter (3 -> 'C')
+// Columns are bijective base-26: subtract one before each division so that
+// 26 maps to Z rather than to A0.
+std::size_t cell_reference::column_string_from_index(column_t column_index, char *buffer)
 {
     // these indicies corrospond to A->ZZZ and include all allowed
     // columns
     if(column_index < 1 || column_index > constants::MaxColumn)
     {
-      //        auto msg = "Column index out of bounds: " + std::to_string(column_index);
         throw column_string_index_exception();
     }
-    
-    auto temp = column_index;
-    std::string column_letter = "";
-    
-    while(temp > 0)
+
+    char reversed[8];
+    std::size_t length = 0;
+
+    while(column_index > 0)
     {
-        int quotient = temp / 26, remainder = temp % 26;
-        
-        // check for exact division and borrow if needed
-        if(remainder == 0)
-        {
-            quotient -= 1;
-            remainder = 26;
-        }
-        
-        column_letter = std::string(1, char(remainder + 64)) + column_letter;
-        temp = quotient;
+        column_index--;
+        reversed[length++] = static_cast<char>('A' + column_index % 26);
+        column_index /= 26;
     }
-    
-    return column_letter;
+
+    for(std::size_t i = 0; i < length; i++)
+    {
+        buffer[i] = reversed[length - 1 - i];
+    }
+
+    buffer[length] = '\0';
+
+    return length;
 }
 
 bool operator<(const cell_reference &left, const cell_reference &right)
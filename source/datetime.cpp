@@ -3,80 +3,206 @@
 
 #include <xlnt/common/datetime.hpp>
 
+namespace {
+
+// The conversions below are written without data-dependent branches (the
+// special cases are selects the compiler can turn into blends) so that the
+// batch loops over them can be vectorized. The scalar conversions use the same
+// code so both always agree.
+
+// Days between Excel's 1900 and 1904 epochs.
+const int mac_1904_offset = 1462;
+
+inline int epoch_offset(xlnt::calendar base_date)
+{
+    return base_date == xlnt::calendar::mac_1904 ? mac_1904_offset : 0;
+}
+
+// Serial of 9999-12-31, the last date Excel accepts. Serials are clamped to
+// [-max_serial, max_serial] before anything else: the date arithmetic below
+// overflows for far larger ones, and converting a double outside int's range
+// (or NaN) to int is undefined.
+const int max_serial = 2958465;
+
+inline int clamp_serial(int serial)
+{
+    return serial < -max_serial ? -max_serial : (serial > max_serial ? max_serial : serial);
+}
+
+// Leaves the times of day of the last date alone. NaN becomes the lower bound.
+inline double clamp_serial(double serial)
+{
+    return std::fmin(std::fmax(serial, -max_serial - 1.0), max_serial + 1.0);
+}
+
+// Serial in the 1900 date system to a civil date. Excel treats 1900 as a leap
+// year, so serial 60 is 29 February 1900 and earlier serials are shifted by a day.
+inline void civil_from_serial(int serial, int &year, int &month, int &day)
+{
+    const int is_leap_bug = serial == 60;
+    serial += serial < 60;
+
+    int l = serial + 68569 + 2415019;
+    int n = int((4 * l) / 146097);
+    l = l - int((146097 * n + 3) / 4);
+    int i = int((4000 * (l + 1)) / 1461001);
+    l = l - int((1461 * i) / 4) + 31;
+    int j = int((80 * l) / 2447);
+    int d = l - int((2447 * j) / 80);
+    l = int(j / 11);
+    int m = j + 2 - (12 * l);
+    int y = 100 * (n - 49) + i + l;
+
+    day = is_leap_bug ? 29 : d;
+    month = is_leap_bug ? 2 : m;
+    year = is_leap_bug ? 1900 : y;
+}
+
+// The inverse of civil_from_serial.
+inline int serial_from_civil(int year, int month, int day)
+{
+    const int a = int((month - 14) / 12);
+    int serial = int((1461 * (year + 4800 + a)) / 4)
+        + int((367 * (month - 2 - 12 * a)) / 12)
+        - int((3 * (int((year + 4900 + a) / 100))) / 4)
+        + day - 2415019 - 32075;
+    serial -= serial <= 60;
+
+    return (day == 29 && month == 2 && year == 1900) ? 60 : serial;
+}
+
+// Fraction of a day to a time of day, rounding up to the next second from
+// 999999.5 microseconds.
+inline void time_from_fraction(double fraction, int &hour, int &minute, int &second, int &microsecond)
+{
+    fraction *= 24;
+    hour = (int)fraction;
+    fraction = 60 * (fraction - hour);
+    minute = (int)fraction;
+    fraction = 60 * (fraction - minute);
+    second = (int)fraction;
+    fraction = 1000000 * (fraction - second);
+    microsecond = (int)fraction;
+
+    int carry = microsecond == 999999 && fraction - microsecond > 0.5;
+    microsecond = carry ? 0 : microsecond;
+    second += carry;
+    carry = second == 60;
+    second = carry ? 0 : second;
+    minute += carry;
+    carry = minute == 60;
+    minute = carry ? 0 : minute;
+    hour += carry;
+}
+
+inline double fraction_from_time(int hour, int minute, int second, int microsecond)
+{
+    double number = microsecond;
+    number /= 1000000;
+    number += second;
+    number /= 60;
+    number += minute;
+    number /= 60;
+    number += hour;
+    number /= 24;
+    return number;
+}
+
+// The 1900 system serial of 1970-01-01.
+const double unix_epoch_serial = 25569;
+const double seconds_per_day = 86400;
+
+} // namespace
+
 namespace xlnt {
 
 time time::from_number(long double raw_time)
 {
-	time result;
+    time result;
+    double raw = clamp_serial((double)raw_time);
+    time_from_fraction(raw - std::trunc(raw), result.hour, result.minute, result.second, result.microsecond);
+    return result;
+}
+
+date date::from_number(int days_since_base_year, calendar base_date)
+{
+    date result(0, 0, 0);
+    civil_from_serial(clamp_serial(days_since_base_year) + epoch_offset(base_date), result.year, result.month, result.day);
+    return result;
+}
 
-    double integer_part;
-    double fractional_part = std::modf((double)raw_time, &integer_part);
+void date::from_numbers(const int *serials, std::size_t count, calendar base_date, date *result)
+{
+    const int offset = epoch_offset(base_date);
 
-    fractional_part *= 24;
-    result.hour = (int)fractional_part;
-	fractional_part = 60 * (fractional_part - result.hour);
-	result.minute = (int)fractional_part;
-	fractional_part = 60 * (fractional_part - result.minute);
-	result.second = (int)fractional_part;
-	fractional_part = 1000000 * (fractional_part - result.second);
-	result.microsecond = (int)fractional_part;
-	if (result.microsecond == 999999 && fractional_part - result.microsecond > 0.5)
+    for(std::size_t i = 0; i < count; i++)
     {
-		result.microsecond = 0;
-		result.second += 1;
-		if (result.second == 60)
-        {
-			result.second = 0;
-			result.minute += 1;
-			if (result.minute == 60)
-            {
-				result.minute = 0;
-				result.hour += 1;
-            }
-        }
+        civil_from_serial(clamp_serial(serials[i]) + offset, result[i].year, result[i].month, result[i].day);
     }
-	return result;
 }
 
-date date::from_number(int days_since_base_year, calendar base_date)
+void date::to_numbers(const date *dates, std::size_t count, calendar base_date, int *result)
 {
-    date result(0, 0, 0);
+    const int offset = epoch_offset(base_date);
 
-    if(base_date == calendar::mac_1904)
+    for(std::size_t i = 0; i < count; i++)
     {
-        days_since_base_year += 1462;
+        result[i] = serial_from_civil(dates[i].year, dates[i].month, dates[i].day) - offset;
     }
+}
+
+datetime datetime::from_number(long double raw_time, calendar base_date)
+{
+    datetime result(0, 0, 0);
+    double raw = (double)raw_time;
+    from_numbers(&raw, 1, base_date, &result);
+    return result;
+}
 
-    if(days_since_base_year == 60)
+void datetime::from_numbers(const double *serials, std::size_t count, calendar base_date, datetime *result)
+{
+    const int offset = epoch_offset(base_date);
+
+    for(std::size_t i = 0; i < count; i++)
     {
-        result.day = 29;
-        result.month = 2;
-        result.year = 1900;
+        const double serial = clamp_serial(serials[i]);
+        const double whole_days = std::trunc(serial);
+        datetime &out = result[i];
+        civil_from_serial((int)whole_days + offset, out.year, out.month, out.day);
+        time_from_fraction(serial - whole_days, out.hour, out.minute, out.second, out.microsecond);
     }
-    else if(days_since_base_year < 60)
+}
+
+void datetime::to_numbers(const datetime *datetimes, std::size_t count, calendar base_date, double *result)
+{
+    const int offset = epoch_offset(base_date);
+
+    for(std::size_t i = 0; i < count; i++)
     {
-        days_since_base_year++;
+        const datetime &in = datetimes[i];
+        result[i] = (serial_from_civil(in.year, in.month, in.day) - offset)
+            + fraction_from_time(in.hour, in.minute, in.second, in.microsecond);
     }
+}
 
-    int l = days_since_base_year + 68569 + 2415019;
-    int n = int((4 * l) / 146097);
-    l = l - int((146097 * n + 3) / 4);
-    int i = int((4000 * (l + 1)) / 1461001);
-    l = l - int((1461 * i) / 4) + 31;
-    int j = int((80 * l) / 2447);
-    result.day = l - int((2447 * j) / 80);
-    l = int(j / 11);
-    result.month = j + 2 - (12 * l);
-    result.year = 100 * (n - 49) + i + l;
+void datetime::from_unix_times(const double *seconds, std::size_t count, calendar base_date, double *serials)
+{
+    const double offset = unix_epoch_serial - epoch_offset(base_date);
 
-    return result;
+    for(std::size_t i = 0; i < count; i++)
+    {
+        serials[i] = seconds[i] / seconds_per_day + offset;
+    }
 }
 
-datetime datetime::from_number(long double raw_time, calendar base_date)
+void datetime::to_unix_times(const double *serials, std::size_t count, calendar base_date, double *seconds)
 {
-    auto date_part = date::from_number((int)raw_time, base_date);
-    auto time_part = time::from_number(raw_time);
-    return datetime(date_part.year, date_part.month, date_part.day, time_part.hour, time_part.minute, time_part.second, time_part.microsecond);
+    const double offset = unix_epoch_serial - epoch_offset(base_date);
+
+    for(std::size_t i = 0; i < count; i++)
+    {
+        seconds[i] = (serials[i] - offset) * seconds_per_day;
+    }
 }
 
 bool date::operator==(const date &comparand) const
@@ -123,46 +249,19 @@ time::time(const std::string &time_string) : hour(0), minute(0), second(0), micr
 
 double time::to_number() const
 {
-    double number = microsecond;
-    number /= 1000000;
-    number += second;
-    number /= 60;
-    number += minute;
-    number /= 60;
-    number += hour;
-    number /= 24;
-    return number;
+    return fraction_from_time(hour, minute, second, microsecond);
 }
 
 int date::to_number(calendar base_date) const
 {
-    if(day == 29 && month == 2 && year == 1900)
-    {
-        return 60;
-    }
-
-    int days_since_1900 = int((1461 * (year + 4800 + int((month - 14) / 12))) / 4)
-        + int((367 * (month - 2 - 12 * ((month - 14) / 12))) / 12)
-        - int((3 * (int((year + 4900 + int((month - 14) / 12)) / 100))) / 4)
-        + day - 2415019 - 32075;
-
-    if(days_since_1900 <= 60)
-    {
-        days_since_1900--;
-    }
-
-    if(base_date == calendar::mac_1904)
-    {
-        return days_since_1900 - 1462;
-    }
-
-    return days_since_1900;
+    return serial_from_civil(year, month, day) - epoch_offset(base_date);
 }
 
 double datetime::to_number(calendar base_date) const
 {
-    return date(year, month, day).to_number(base_date)
-        + time(hour, minute, second, microsecond).to_number();
+    double result;
+    to_numbers(this, 1, base_date, &result);
+    return result;
 }
 
 date date::today()
@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#include "detail/cell_arena.hpp"
+
+namespace {
+
+const std::size_t FirstChunkSize = 16 * 1024;
+const std::size_t MaxChunkSize = 1024 * 1024;
+
+} // namespace
+
+namespace xlnt {
+namespace detail {
+
+cell_arena::cell_arena()
+    : functions_(get_memory_functions()), cursor_(nullptr), end_(nullptr), next_chunk_size_(FirstChunkSize), held_bytes_(0), peak_bytes_(0)
+{
+    std::memset(free_lists_, 0, sizeof(free_lists_));
+}
+
+cell_arena::~cell_arena()
+{
+    release();
+}
+
+void *cell_arena::allocate(std::size_t size)
+{
+    if(size > MaxPooledSize)
+    {
+        auto pointer = allocate_or_throw(size);
+        add_held(size);
+        return pointer;
+    }
+
+    auto size_class = size == 0 ? 0 : (size - 1) / Granularity;
+
+    if(free_lists_[size_class] != nullptr)
+    {
+        auto block = free_lists_[size_class];
+        free_lists_[size_class] = block->next;
+        return block;
+    }
+
+    auto rounded = (size_class + 1) * Granularity;
+
+    if(static_cast<std::size_t>(end_ - cursor_) < rounded)
+    {
+        // the tail of the previous chunk is abandoned; it is smaller than one block
+        auto chunk = static_cast<char *>(allocate_or_throw(next_chunk_size_));
+        chunks_.push_back(chunk);
+        add_held(next_chunk_size_);
+        cursor_ = chunk;
+        end_ = chunk + next_chunk_size_;
+        next_chunk_size_ = std::min(next_chunk_size_ * 2, MaxChunkSize);
+    }
+
+    auto block = cursor_;
+    cursor_ += rounded;
+
+    return block;
+}
+
+void cell_arena::deallocate(void *pointer, std::size_t size)
+{
+    if(pointer == nullptr)
+    {
+        return;
+    }
+
+    if(size > MaxPooledSize)
+    {
+        functions_.deallocate(pointer);
+        held_bytes_ -= size;
+        return;
+    }
+
+    auto size_class = size == 0 ? 0 : (size - 1) / Granularity;
+    auto block = static_cast<free_block *>(pointer);
+    block->next = free_lists_[size_class];
+    free_lists_[size_class] = block;
+}
+
+void cell_arena::release()
+{
+    for(auto chunk : chunks_)
+    {
+        functions_.deallocate(chunk);
+    }
+
+    chunks_.clear();
+    cursor_ = end_ = nullptr;
+    next_chunk_size_ = FirstChunkSize;
+    std::memset(free_lists_, 0, sizeof(free_lists_));
+    held_bytes_ = peak_bytes_ = 0;
+}
+
+void cell_arena::add_held(std::size_t size)
+{
+    held_bytes_ += size;
+    peak_bytes_ = std::max(peak_bytes_, held_bytes_);
+}
+
+void *cell_arena::allocate_or_throw(std::size_t size)
+{
+    auto pointer = functions_.allocate(size);
+
+    if(pointer == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+
+    return pointer;
+}
+
+} // namespace detail
+} // namespace xlnt
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <xlnt/common/memory.hpp>
+
+namespace xlnt {
+namespace detail {
+
+/// <summary>
+/// Pooled memory for the cell containers of one worksheet. Small blocks (hash
+/// nodes, i.e. one per cell and one per row) are carved out of large chunks and
+/// recycled through per-size free lists, so filling a sheet costs a handful of
+/// malloc calls and destroying it releases every chunk at once instead of
+/// freeing each node. Larger requests such as bucket arrays are passed straight
+/// through. All memory comes from the memory_functions current at construction.
+/// </summary>
+class cell_arena
+{
+public:
+    cell_arena();
+    ~cell_arena();
+
+    void *allocate(std::size_t size);
+    void deallocate(void *pointer, std::size_t size);
+
+    /// <summary>
+    /// Return all chunks to the system. Only valid once nothing allocated from
+    /// this arena is in use any more.
+    /// </summary>
+    void release();
+
+    /// <summary>
+    /// The most memory this arena has held from the system at once (chunks and
+    /// pass-through blocks) since it was constructed or last released.
+    /// </summary>
+    std::size_t get_peak_bytes() const
+    {
+        return peak_bytes_;
+    }
+
+private:
+    cell_arena(const cell_arena &);
+    cell_arena &operator=(const cell_arena &);
+
+    static const std::size_t Granularity = 16;
+    static const std::size_t SizeClasses = 32;
+    static const std::size_t MaxPooledSize = Granularity * SizeClasses;
+
+    struct free_block
+    {
+        free_block *next;
+    };
+
+    void *allocate_or_throw(std::size_t size);
+    void add_held(std::size_t size);
+
+    memory_functions functions_;
+    std::vector<void *> chunks_;
+    char *cursor_;
+    char *end_;
+    std::size_t next_chunk_size_;
+    free_block *free_lists_[SizeClasses];
+    std::size_t held_bytes_;
+    std::size_t peak_bytes_;
+};
+
+/// <summary>
+/// Standard allocator handing out memory from a cell_arena. Allocators compare
+/// equal when they share an arena.
+/// </summary>
+template<typename T>
+class arena_allocator
+{
+public:
+    typedef T value_type;
+
+    explicit arena_allocator(cell_arena *arena) : arena_(arena)
+    {
+    }
+
+    template<typename U>
+    arena_allocator(const arena_allocator<U> &other) : arena_(other.arena())
+    {
+    }
+
+    T *allocate(std::size_t n)
+    {
+        return static_cast<T *>(arena_->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T *pointer, std::size_t n)
+    {
+        arena_->deallocate(pointer, n * sizeof(T));
+    }
+
+    cell_arena *arena() const
+    {
+        return arena_;
+    }
+
+    template<typename U>
+    struct rebind
+    {
+        typedef arena_allocator<U> other;
+    };
+
+private:
+    cell_arena *arena_;
+};
+
+template<typename T, typename U>
+bool operator==(const arena_allocator<T> &left, const arena_allocator<U> &right)
+{
+    return left.arena() == right.arena();
+}
+
+template<typename T, typename U>
+bool operator!=(const arena_allocator<T> &left, const arena_allocator<U> &right)
+{
+    return left.arena() != right.arena();
+}
+
+} // namespace detail
+} // namespace xlnt
@@ -1,14 +1,18 @@
-#include "cell_impl.hpp"
+#include <xlnt/worksheet/range_reference.hpp>
 #include <xlnt/worksheet/worksheet.hpp>
 
+#include "cell_impl.hpp"
+#include "shared_string_table.hpp"
+#include "worksheet_impl.hpp"
+
 namespace xlnt {
 namespace detail {
 
-cell_impl::cell_impl() : parent_(nullptr), column_(0), row_(0), style_(nullptr), merged(false), is_date_(false), has_hyperlink_(false)
+cell_impl::cell_impl() : parent_(nullptr), column_(0), row_(0), style_(nullptr), shared_style_(false), merged(false), is_date_(false), has_hyperlink_(false), lazy_string_(NoLazyString)
 {
 }
     
-cell_impl::cell_impl(worksheet_impl *parent, int column_index, int row_index) : parent_(parent), column_(column_index), row_(row_index), style_(nullptr), merged(false), is_date_(false), has_hyperlink_(false)
+cell_impl::cell_impl(worksheet_impl *parent, int column_index, int row_index) : parent_(parent), column_(column_index), row_(row_index), style_(nullptr), shared_style_(false), merged(false), is_date_(false), has_hyperlink_(false), lazy_string_(NoLazyString)
 {
 }
     
@@ -26,11 +30,25 @@ cell_impl &cell_impl::operator=(const cell_impl &rhs)
     column_ = rhs.column_;
     row_ = rhs.row_;
     style_ = rhs.style_;
+    shared_style_ = rhs.shared_style_;
     merged = rhs.merged;
     is_date_ = rhs.is_date_;
     has_hyperlink_ = rhs.has_hyperlink_;
+    lazy_string_ = rhs.lazy_string_;
     return *this;
 }
 
+void cell_impl::resolve_lazy_string()
+{
+    // value_ is about to change in place
+    if(parent_->shared_with_snapshot_)
+    {
+        parent_->detach_snapshots();
+    }
+
+    value_ = value(parent_->lazy_strings_->get(lazy_string_));
+    lazy_string_ = NoLazyString;
+}
+
 } // namespace detail
 } // namespace xlnt
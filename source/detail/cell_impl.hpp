@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+
 #include <xlnt/cell/cell.hpp>
 #include <xlnt/cell/comment.hpp>
 #include <xlnt/cell/value.hpp>
@@ -21,6 +23,32 @@ struct cell_impl
     cell_impl(const cell_impl &rhs);
     cell_impl &operator=(const cell_impl &rhs);
 
+    static const std::size_t NoLazyString = static_cast<std::size_t>(-1);
+
+    /// <summary>
+    /// Must be called before value_ is read. Decodes the shared string this cell
+    /// was loaded with if that was deferred (see workbook::set_lazy_shared_strings).
+    /// Decoding detaches snapshots that still share the sheet first, because
+    /// they may be reading value_ on another thread.
+    /// </summary>
+    void resolve_value()
+    {
+        if(lazy_string_ != NoLazyString)
+        {
+            resolve_lazy_string();
+        }
+    }
+
+    /// <summary>
+    /// Must be called when value_ is overwritten.
+    /// </summary>
+    void discard_lazy_string()
+    {
+        lazy_string_ = NoLazyString;
+    }
+
+    void resolve_lazy_string();
+
     worksheet_impl *parent_;
     value value_;
     std::string formula_;
@@ -28,10 +56,19 @@ struct cell_impl
     column_t column_;
     row_t row_;
     style *style_;
+    // style_ belongs to an xf_table (or is one of the date column styles in
+    // worksheet.cpp) and is shared with other cells, so it has to be copied
+    // before it is modified
+    bool shared_style_;
+    // set by cell::set_merged; ranges merged with worksheet::merge_cells are
+    // looked up in worksheet_impl::merged_cells_ instead
     bool merged;
     bool is_date_;
     bool has_hyperlink_;
     comment comment_;
+    // index into the sheet's lazy_strings_ of a string value that hasn't been
+    // decoded yet (value_ is then an empty string), or NoLazyString
+    std::size_t lazy_string_;
 };
     
 } // namespace detail
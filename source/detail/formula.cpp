@@ -0,0 +1,2421 @@
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include <xlnt/drawing/drawing.hpp>
+#include <xlnt/workbook/document_properties.hpp>
+#include <xlnt/workbook/workbook.hpp>
+#include <xlnt/worksheet/range_reference.hpp>
+#include <xlnt/worksheet/worksheet.hpp>
+
+#include "constants.hpp"
+#include "detail/formula.hpp"
+#include "detail/number_conversion.hpp"
+#include "detail/workbook_impl.hpp"
+#include "detail/worksheet_impl.hpp"
+
+namespace xlnt {
+namespace detail {
+namespace {
+
+typedef compiled_formula::reference reference;
+
+const char *const ErrorNull = "#NULL!";
+const char *const ErrorDivideByZero = "#DIV/0!";
+const char *const ErrorValue = "#VALUE!";
+const char *const ErrorReference = "#REF!";
+const char *const ErrorName = "#NAME?";
+const char *const ErrorNumber = "#NUM!";
+const char *const ErrorNotAvailable = "#N/A";
+
+const char *const ErrorCodes[] = { ErrorNull, ErrorDivideByZero, ErrorValue, ErrorReference, ErrorName, ErrorNumber, ErrorNotAvailable };
+
+// A value on the evaluation stack
+struct operand
+{
+    enum class kind
+    {
+        // a blank cell
+        empty,
+        number,
+        string,
+        boolean,
+        error,
+        // an argument left out, as in IF(A1,,2)
+        missing,
+        // a reference to one or more cells, read when the operand is used
+        range
+    };
+
+    operand() : type(kind::empty), number(0), range(nullptr)
+    {
+    }
+
+    kind type;
+    // the number, or 1 or 0 for a boolean
+    double number;
+    // the string or the error code
+    std::string text;
+    const reference *range;
+};
+
+typedef operand::kind kind;
+
+operand make_number(double number)
+{
+    operand result;
+    result.type = kind::number;
+    result.number = number;
+    return result;
+}
+
+operand make_boolean(bool boolean)
+{
+    operand result;
+    result.type = kind::boolean;
+    result.number = boolean ? 1 : 0;
+    return result;
+}
+
+operand make_string(const std::string &string)
+{
+    operand result;
+    result.type = kind::string;
+    result.text = string;
+    return result;
+}
+
+operand make_error(const char *code)
+{
+    operand result;
+    result.type = kind::error;
+    result.text = code;
+    return result;
+}
+
+operand make_range(const reference *range)
+{
+    operand result;
+    result.type = kind::range;
+    result.range = range;
+    return result;
+}
+
+operand from_value(const value &cell_value)
+{
+    switch(cell_value.get_type())
+    {
+    case value::type::numeric:
+        return make_number(cell_value.as<double>());
+    case value::type::string:
+        return make_string(cell_value.get<std::string>());
+    case value::type::boolean:
+        return make_boolean(cell_value.as<bool>());
+    case value::type::error:
+        return make_error(cell_value.to_string().c_str());
+    case value::type::null:
+        break;
+    }
+
+    return operand();
+}
+
+operand read_cell(worksheet_impl *sheet, column_t column, row_t row)
+{
+    auto cell = sheet->find_cell(column, row);
+
+    if(cell == nullptr)
+    {
+        return operand();
+    }
+
+    cell->resolve_value();
+
+    return from_value(cell->value_);
+}
+
+bool is_single_cell(const reference &range)
+{
+    return range.first_column == range.last_column && range.first_row == range.last_row;
+}
+
+// Calls visit(column, row, cell) for each cell of range that exists, row by row
+// and left to right. Ranges are clipped to the used part of the sheet, so whole
+// columns and rows cost as much as the cells in them.
+template<typename Visitor>
+void for_each_cell(const reference &range, Visitor visit)
+{
+    auto sheet = range.sheet;
+
+    if(sheet->cell_map_.empty() || range.first_row > sheet->highest_row_)
+    {
+        return;
+    }
+
+    std::uint64_t last_row = std::min(range.last_row, sheet->highest_row_);
+    std::vector<row_t> rows;
+
+    if(last_row - range.first_row + 1 <= sheet->cell_map_.size())
+    {
+        for(std::uint64_t row = range.first_row; row <= last_row; row++)
+        {
+            if(sheet->cell_map_.count(static_cast<row_t>(row)) != 0)
+            {
+                rows.push_back(static_cast<row_t>(row));
+            }
+        }
+    }
+    else
+    {
+        for(const auto &row : sheet->cell_map_)
+        {
+            if(row.first >= range.first_row && row.first <= last_row)
+            {
+                rows.push_back(row.first);
+            }
+        }
+
+        std::sort(rows.begin(), rows.end());
+    }
+
+    std::uint64_t width = static_cast<std::uint64_t>(range.last_column) - range.first_column + 1;
+    std::vector<column_t> columns;
+
+    for(auto row : rows)
+    {
+        auto &cells = sheet->cell_map_.find(row)->second;
+
+        if(width <= cells.size())
+        {
+            for(std::uint64_t column = range.first_column; column <= range.last_column; column++)
+            {
+                auto match = cells.find(static_cast<column_t>(column));
+
+                if(match != cells.end())
+                {
+                    visit(match->first, row, match->second);
+                }
+            }
+
+            continue;
+        }
+
+        columns.clear();
+
+        for(const auto &cell : cells)
+        {
+            if(cell.first >= range.first_column && cell.first <= range.last_column)
+            {
+                columns.push_back(cell.first);
+            }
+        }
+
+        std::sort(columns.begin(), columns.end());
+
+        for(auto column : columns)
+        {
+            visit(column, row, cells.find(column)->second);
+        }
+    }
+}
+
+// The operand itself, or the value of the cell a single-cell reference points to
+operand dereference(const operand &argument)
+{
+    if(argument.type != kind::range)
+    {
+        return argument;
+    }
+
+    const auto &range = *argument.range;
+
+    if(range.sheet == nullptr)
+    {
+        return make_error(ErrorReference);
+    }
+
+    if(!is_single_cell(range))
+    {
+        return make_error(ErrorValue);
+    }
+
+    return read_cell(range.sheet, range.first_column, range.first_row);
+}
+
+bool to_number(const operand &scalar, double &result)
+{
+    switch(scalar.type)
+    {
+    case kind::number:
+    case kind::boolean:
+        result = scalar.number;
+        return true;
+    case kind::empty:
+    case kind::missing:
+        result = 0;
+        return true;
+    case kind::string:
+        return parse_double(scalar.text.c_str(), result);
+    default:
+        return false;
+    }
+}
+
+bool equals_ignoring_case(const std::string &left, const char *right)
+{
+    std::size_t i = 0;
+
+    for(; i < left.size() && right[i] != '\0'; i++)
+    {
+        if(std::toupper(static_cast<unsigned char>(left[i])) != std::toupper(static_cast<unsigned char>(right[i])))
+        {
+            return false;
+        }
+    }
+
+    return i == left.size() && right[i] == '\0';
+}
+
+bool to_boolean(const operand &scalar, bool &result)
+{
+    switch(scalar.type)
+    {
+    case kind::number:
+    case kind::boolean:
+        result = scalar.number != 0;
+        return true;
+    case kind::empty:
+    case kind::missing:
+        result = false;
+        return true;
+    case kind::string:
+        if(equals_ignoring_case(scalar.text, "TRUE") || equals_ignoring_case(scalar.text, "FALSE"))
+        {
+            result = equals_ignoring_case(scalar.text, "TRUE");
+            return true;
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+// Rounds to the 15 significant digits Excel works with, so that e.g. 2.675 * 100
+// is 267.5 rather than 267.49999999999997
+double to_significant_digits(double number)
+{
+    if(number == 0 || !std::isfinite(number))
+    {
+        return number;
+    }
+
+    auto scale = std::pow(10.0, 14 - static_cast<int>(std::floor(std::log10(std::fabs(number)))));
+    auto scaled = std::round(number * scale) / scale;
+
+    return std::isfinite(scaled) ? scaled : number;
+}
+
+std::string to_text(const operand &scalar)
+{
+    switch(scalar.type)
+    {
+    case kind::number:
+    {
+        char buffer[MaxDoubleLength];
+        return std::string(buffer, format_double(to_significant_digits(scalar.number), buffer));
+    }
+    case kind::boolean:
+        return scalar.number != 0 ? "TRUE" : "FALSE";
+    case kind::string:
+    case kind::error:
+        return scalar.text;
+    default:
+        return std::string();
+    }
+}
+
+int compare_text(const std::string &left, const std::string &right)
+{
+    auto length = std::min(left.size(), right.size());
+
+    for(std::size_t i = 0; i < length; i++)
+    {
+        auto l = std::toupper(static_cast<unsigned char>(left[i]));
+        auto r = std::toupper(static_cast<unsigned char>(right[i]));
+
+        if(l != r)
+        {
+            return l < r ? -1 : 1;
+        }
+    }
+
+    return left.size() == right.size() ? 0 : (left.size() < right.size() ? -1 : 1);
+}
+
+// Orders two scalars the way Excel's comparison operators do: numbers before
+// text before booleans, text without regard to case, and a blank cell as
+// whatever the other side is (0, "" or FALSE).
+int compare(operand left, operand right)
+{
+    if(left.type == kind::empty || left.type == kind::missing)
+    {
+        left = right.type == kind::string ? make_string("") : right.type == kind::boolean ? make_boolean(false) : make_number(0);
+    }
+
+    if(right.type == kind::empty || right.type == kind::missing)
+    {
+        right = left.type == kind::string ? make_string("") : left.type == kind::boolean ? make_boolean(false) : make_number(0);
+    }
+
+    auto rank = [](kind type) { return type == kind::number ? 0 : type == kind::string ? 1 : 2; };
+
+    if(left.type != right.type)
+    {
+        return rank(left.type) < rank(right.type) ? -1 : 1;
+    }
+
+    if(left.type == kind::string)
+    {
+        return compare_text(left.text, right.text);
+    }
+
+    return left.number == right.number ? 0 : (left.number < right.number ? -1 : 1);
+}
+
+operand finite_or_error(double number)
+{
+    return std::isfinite(number) ? make_number(number) : make_error(ErrorNumber);
+}
+
+operand power(double base, double exponent)
+{
+    if(base == 0 && exponent == 0)
+    {
+        return make_error(ErrorNumber);
+    }
+
+    if(base == 0 && exponent < 0)
+    {
+        return make_error(ErrorDivideByZero);
+    }
+
+    return finite_or_error(std::pow(base, exponent));
+}
+
+// Everything but a blank cell or a missing argument
+bool is_present(const operand &scalar)
+{
+    return scalar.type != kind::empty && scalar.type != kind::missing;
+}
+
+// Calls visit(number) for the numbers SUM, AVERAGE, MIN, MAX and PRODUCT work
+// on: arguments given directly if they are numbers, booleans or numeric text,
+// but only the numbers in references. Stops at and returns the first error.
+template<typename Visitor>
+operand visit_numbers(const operand *arguments, std::size_t count, Visitor visit)
+{
+    for(std::size_t i = 0; i < count; i++)
+    {
+        const auto &argument = arguments[i];
+
+        if(argument.type == kind::range)
+        {
+            if(argument.range->sheet == nullptr)
+            {
+                return make_error(ErrorReference);
+            }
+
+            operand error;
+
+            for_each_cell(*argument.range, [&](column_t, row_t, cell_impl &cell)
+            {
+                if(error.type == kind::error)
+                {
+                    return;
+                }
+
+                cell.resolve_value();
+
+                if(cell.value_.is(value::type::numeric))
+                {
+                    visit(cell.value_.as<double>());
+                }
+                else if(cell.value_.is(value::type::error))
+                {
+                    error = from_value(cell.value_);
+                }
+            });
+
+            if(error.type == kind::error)
+            {
+                return error;
+            }
+
+            continue;
+        }
+
+        if(argument.type == kind::error)
+        {
+            return argument;
+        }
+
+        if(argument.type == kind::missing)
+        {
+            continue;
+        }
+
+        double number = 0;
+
+        if(!to_number(argument, number))
+        {
+            return make_error(ErrorValue);
+        }
+
+        visit(number);
+    }
+
+    return operand();
+}
+
+// What SUM, AVERAGE, MIN, MAX and COUNT need to know about a set of numbers
+struct number_summary
+{
+    number_summary()
+        : sum(0),
+          minimum(std::numeric_limits<double>::infinity()),
+          maximum(-std::numeric_limits<double>::infinity()),
+          count(0)
+    {
+    }
+
+    void add(double number)
+    {
+        sum += number;
+        minimum = std::min(minimum, number);
+        maximum = std::max(maximum, number);
+        count++;
+    }
+
+    void add(const number_summary &other)
+    {
+        sum += other.sum;
+        minimum = std::min(minimum, other.minimum);
+        maximum = std::max(maximum, other.maximum);
+        count += other.count;
+    }
+
+    double sum;
+    double minimum;
+    double maximum;
+    std::size_t count;
+};
+
+// Ranges at least this many rows tall and at most this many columns wide are
+// aggregated from a column_cache instead of cell by cell
+const std::uint64_t TallRange = 64;
+const std::uint64_t CachedColumns = 16;
+
+bool is_cached(const reference &range)
+{
+    return static_cast<std::uint64_t>(range.last_row) - range.first_row + 1 >= TallRange
+        && static_cast<std::uint64_t>(range.last_column) - range.first_column + 1 <= CachedColumns;
+}
+
+// Summarizes rows [first, last) of a cached column. Four independent lanes
+// break the dependency between iterations, so the loop vectorizes; every path
+// that reads a given range adds in the same order, so results don't depend on
+// how a calculation is spread over threads.
+number_summary summarize_rows(const column_cache::column &cached, std::size_t first, std::size_t last)
+{
+    const auto infinity = std::numeric_limits<double>::infinity();
+    const double *numbers = cached.numbers.data();
+    const std::uint8_t *is_number = cached.is_number.data();
+
+    double sum[4] = { 0, 0, 0, 0 };
+    double minimum[4] = { infinity, infinity, infinity, infinity };
+    double maximum[4] = { -infinity, -infinity, -infinity, -infinity };
+    std::size_t count[4] = { 0, 0, 0, 0 };
+
+    auto row = first;
+
+    for(; row + 4 <= last; row += 4)
+    {
+        for(std::size_t lane = 0; lane < 4; lane++)
+        {
+            auto number = numbers[row + lane];
+            auto present = is_number[row + lane] != 0;
+            sum[lane] += number;
+            minimum[lane] = present && number < minimum[lane] ? number : minimum[lane];
+            maximum[lane] = present && number > maximum[lane] ? number : maximum[lane];
+            count[lane] += is_number[row + lane];
+        }
+    }
+
+    for(std::size_t lane = 0; row < last; row++, lane++)
+    {
+        auto number = numbers[row];
+        auto present = is_number[row] != 0;
+        sum[lane] += number;
+        minimum[lane] = present && number < minimum[lane] ? number : minimum[lane];
+        maximum[lane] = present && number > maximum[lane] ? number : maximum[lane];
+        count[lane] += is_number[row];
+    }
+
+    number_summary result;
+    result.sum = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+    result.minimum = std::min(std::min(minimum[0], minimum[1]), std::min(minimum[2], minimum[3]));
+    result.maximum = std::max(std::max(maximum[0], maximum[1]), std::max(maximum[2], maximum[3]));
+    result.count = count[0] + count[1] + count[2] + count[3];
+
+    return result;
+}
+
+// Adds the numbers of a range for which is_cached holds to result, column by
+// column. Returns the range's first error in row-major order, if any, like
+// for_each_cell would find it.
+operand summarize_range(const reference &range, column_cache &cache, number_summary &result)
+{
+    auto sheet = range.sheet;
+
+    if(sheet->cell_map_.empty() || range.first_row > sheet->highest_row_)
+    {
+        return operand();
+    }
+
+    std::uint64_t last_row = std::min(range.last_row, sheet->highest_row_);
+    const std::pair<row_t, std::string> *first_error = nullptr;
+
+    auto before = [](const std::pair<row_t, std::string> &error, std::uint64_t row) { return error.first < row; };
+
+    for(std::uint64_t column = range.first_column; column <= range.last_column; column++)
+    {
+        const auto &cached = cache.get(sheet, static_cast<column_t>(column));
+        auto end = std::min<std::uint64_t>(last_row + 1, cached.numbers.size());
+
+        if(range.first_row < end)
+        {
+            result.add(summarize_rows(cached, range.first_row, static_cast<std::size_t>(end)));
+        }
+
+        // ties go to the leftmost column, which was seen first
+        auto error = std::lower_bound(cached.errors.begin(), cached.errors.end(), static_cast<std::uint64_t>(range.first_row), before);
+
+        if(error != cached.errors.end() && error->first <= last_row
+            && (first_error == nullptr || error->first < first_error->first))
+        {
+            first_error = &*error;
+        }
+    }
+
+    return first_error == nullptr ? operand() : make_error(first_error->second.c_str());
+}
+
+// Like visit_numbers, but summarizes the numbers so that tall ranges can be
+// read from cache
+operand summarize_numbers(const operand *arguments, std::size_t count, column_cache &cache, number_summary &result)
+{
+    for(std::size_t i = 0; i < count; i++)
+    {
+        const auto &argument = arguments[i];
+
+        if(argument.type == kind::range && argument.range->sheet != nullptr && is_cached(*argument.range))
+        {
+            auto error = summarize_range(*argument.range, cache, result);
+
+            if(error.type == kind::error)
+            {
+                return error;
+            }
+
+            continue;
+        }
+
+        auto error = visit_numbers(&argument, 1, [&](double number) { result.add(number); });
+
+        if(error.type == kind::error)
+        {
+            return error;
+        }
+    }
+
+    return operand();
+}
+
+operand function_sum(const operand *arguments, std::size_t count, column_cache &cache)
+{
+    number_summary summary;
+    auto error = summarize_numbers(arguments, count, cache, summary);
+    return error.type == kind::error ? error : finite_or_error(summary.sum);
+}
+
+operand function_product(const operand *arguments, std::size_t count, column_cache &)
+{
+    double product = 1;
+    std::size_t numbers = 0;
+    auto error = visit_numbers(arguments, count, [&](double number) { product *= number; numbers++; });
+    return error.type == kind::error ? error : finite_or_error(numbers == 0 ? 0 : product);
+}
+
+operand function_average(const operand *arguments, std::size_t count, column_cache &cache)
+{
+    number_summary summary;
+    auto error = summarize_numbers(arguments, count, cache, summary);
+
+    if(error.type == kind::error)
+    {
+        return error;
+    }
+
+    return summary.count == 0 ? make_error(ErrorDivideByZero) : finite_or_error(summary.sum / summary.count);
+}
+
+operand function_min(const operand *arguments, std::size_t count, column_cache &cache)
+{
+    number_summary summary;
+    auto error = summarize_numbers(arguments, count, cache, summary);
+    return error.type == kind::error ? error : make_number(summary.count == 0 ? 0 : summary.minimum);
+}
+
+operand function_max(const operand *arguments, std::size_t count, column_cache &cache)
+{
+    number_summary summary;
+    auto error = summarize_numbers(arguments, count, cache, summary);
+    return error.type == kind::error ? error : make_number(summary.count == 0 ? 0 : summary.maximum);
+}
+
+operand function_count(const operand *arguments, std::size_t count, column_cache &cache)
+{
+    std::size_t numbers = 0;
+
+    for(std::size_t i = 0; i < count; i++)
+    {
+        const auto &argument = arguments[i];
+        double number = 0;
+
+        if(argument.type == kind::range)
+        {
+            if(argument.range->sheet != nullptr && is_cached(*argument.range))
+            {
+                number_summary summary;
+                summarize_range(*argument.range, cache, summary);
+                numbers += summary.count;
+            }
+            else if(argument.range->sheet != nullptr)
+            {
+                for_each_cell(*argument.range, [&](column_t, row_t, cell_impl &cell)
+                {
+                    numbers += cell.value_.is(value::type::numeric) ? 1 : 0;
+                });
+            }
+        }
+        else if(argument.type != kind::missing && argument.type != kind::error && to_number(argument, number))
+        {
+            numbers++;
+        }
+    }
+
+    return make_number(static_cast<double>(numbers));
+}
+
+operand function_counta(const operand *arguments, std::size_t count, column_cache &)
+{
+    std::size_t values = 0;
+
+    for(std::size_t i = 0; i < count; i++)
+    {
+        const auto &argument = arguments[i];
+
+        if(argument.type == kind::range)
+        {
+            if(argument.range->sheet != nullptr)
+            {
+                for_each_cell(*argument.range, [&](column_t, row_t, cell_impl &cell)
+                {
+                    cell.resolve_value();
+                    values += cell.value_.is(value::type::null) ? 0 : 1;
+                });
+            }
+        }
+        else if(argument.type != kind::missing)
+        {
+            values++;
+        }
+    }
+
+    return make_number(static_cast<double>(values));
+}
+
+// The condition of COUNTIF and SUMIF: a value to compare with, optionally
+// preceded by a comparison operator when it's given as text (e.g. ">=10")
+struct criterion
+{
+    enum class comparison { equal, not_equal, less, less_equal, greater, greater_equal };
+
+    comparison op;
+    operand target;
+};
+
+criterion make_criterion(const operand &scalar)
+{
+    criterion result;
+    result.op = criterion::comparison::equal;
+    result.target = scalar;
+
+    if(scalar.type != kind::string)
+    {
+        return result;
+    }
+
+    static const struct { const char *text; criterion::comparison op; } Operators[] =
+    {
+        { "<>", criterion::comparison::not_equal },
+        { "<=", criterion::comparison::less_equal },
+        { ">=", criterion::comparison::greater_equal },
+        { "<", criterion::comparison::less },
+        { ">", criterion::comparison::greater },
+        { "=", criterion::comparison::equal }
+    };
+
+    auto text = scalar.text;
+
+    for(const auto &candidate : Operators)
+    {
+        auto length = std::strlen(candidate.text);
+
+        if(text.compare(0, length, candidate.text) == 0)
+        {
+            result.op = candidate.op;
+            text = text.substr(length);
+            break;
+        }
+    }
+
+    double number = 0;
+
+    if(!text.empty() && parse_double(text.c_str(), number))
+    {
+        result.target = make_number(number);
+    }
+    else if(equals_ignoring_case(text, "TRUE") || equals_ignoring_case(text, "FALSE"))
+    {
+        result.target = make_boolean(equals_ignoring_case(text, "TRUE"));
+    }
+    else
+    {
+        // "" and "=" match blank cells
+        result.target = text.empty() ? operand() : make_string(text);
+    }
+
+    return result;
+}
+
+bool matches(const criterion &condition, const operand &candidate)
+{
+    auto target = condition.target;
+    bool blank_target = target.type == kind::empty;
+    bool blank_candidate = candidate.type == kind::empty;
+
+    if(blank_target || blank_candidate)
+    {
+        bool equal = blank_target && (blank_candidate || (candidate.type == kind::string && candidate.text.empty()));
+
+        switch(condition.op)
+        {
+        case criterion::comparison::equal: return equal;
+        case criterion::comparison::not_equal: return !equal;
+        default: return false;
+        }
+    }
+
+    // only values of the same type are compared; anything else just isn't equal
+    if(target.type != candidate.type)
+    {
+        return condition.op == criterion::comparison::not_equal;
+    }
+
+    auto order = compare(candidate, target);
+
+    switch(condition.op)
+    {
+    case criterion::comparison::equal: return order == 0;
+    case criterion::comparison::not_equal: return order != 0;
+    case criterion::comparison::less: return order < 0;
+    case criterion::comparison::less_equal: return order <= 0;
+    case criterion::comparison::greater: return order > 0;
+    case criterion::comparison::greater_equal: return order >= 0;
+    }
+
+    return false;
+}
+
+std::uint64_t area(const reference &range)
+{
+    return (static_cast<std::uint64_t>(range.last_column) - range.first_column + 1) * (static_cast<std::uint64_t>(range.last_row) - range.first_row + 1);
+}
+
+operand function_countif(const operand *arguments, std::size_t, column_cache &)
+{
+    if(arguments[0].type != kind::range)
+    {
+        return make_error(ErrorValue);
+    }
+
+    const auto &range = *arguments[0].range;
+
+    if(range.sheet == nullptr)
+    {
+        return make_error(ErrorReference);
+    }
+
+    auto condition = make_criterion(dereference(arguments[1]));
+    std::uint64_t existing = 0;
+    std::uint64_t matching = 0;
+
+    for_each_cell(range, [&](column_t, row_t, cell_impl &cell)
+    {
+        cell.resolve_value();
+        existing++;
+        matching += matches(condition, from_value(cell.value_)) ? 1 : 0;
+    });
+
+    // cells that don't exist are blank
+    if(matches(condition, operand()))
+    {
+        matching += area(range) - existing;
+    }
+
+    return make_number(static_cast<double>(matching));
+}
+
+operand function_sumif(const operand *arguments, std::size_t count, column_cache &)
+{
+    if(arguments[0].type != kind::range || (count == 3 && arguments[2].type != kind::range))
+    {
+        return make_error(ErrorValue);
+    }
+
+    const auto &range = *arguments[0].range;
+    const auto &sum_range = count == 3 ? *arguments[2].range : range;
+
+    if(range.sheet == nullptr || sum_range.sheet == nullptr)
+    {
+        return make_error(ErrorReference);
+    }
+
+    auto condition = make_criterion(dereference(arguments[1]));
+    double sum = 0;
+
+    auto add = [&](const cell_impl &cell)
+    {
+        if(cell.value_.is(value::type::numeric))
+        {
+            sum += cell.value_.as<double>();
+        }
+    };
+
+    if(!matches(condition, operand()))
+    {
+        for_each_cell(range, [&](column_t column, row_t row, cell_impl &cell)
+        {
+            cell.resolve_value();
+
+            if(matches(condition, from_value(cell.value_)))
+            {
+                auto summed = sum_range.sheet->find_cell(sum_range.first_column + (column - range.first_column), sum_range.first_row + (row - range.first_row));
+
+                if(summed != nullptr)
+                {
+                    add(*summed);
+                }
+            }
+        });
+    }
+    else
+    {
+        // blank cells match too, so go by the cells there are to sum instead
+        auto clipped = sum_range;
+        clipped.last_column = std::min(clipped.last_column, clipped.first_column + (range.last_column - range.first_column));
+        clipped.last_row = std::min(clipped.last_row, clipped.first_row + (range.last_row - range.first_row));
+
+        for_each_cell(clipped, [&](column_t column, row_t row, cell_impl &cell)
+        {
+            auto tested = range.sheet->find_cell(range.first_column + (column - clipped.first_column), range.first_row + (row - clipped.first_row));
+
+            if(tested != nullptr)
+            {
+                tested->resolve_value();
+            }
+
+            if(tested == nullptr || matches(condition, from_value(tested->value_)))
+            {
+                add(cell);
+            }
+        });
+    }
+
+    return finite_or_error(sum);
+}
+
+operand function_if(const operand *arguments, std::size_t count, column_cache &)
+{
+    auto condition = dereference(arguments[0]);
+    bool result = false;
+
+    if(condition.type == kind::error)
+    {
+        return condition;
+    }
+
+    if(!to_boolean(condition, result))
+    {
+        return make_error(ErrorValue);
+    }
+
+    std::size_t chosen = result ? 1 : 2;
+
+    if(chosen >= count)
+    {
+        return make_boolean(result);
+    }
+
+    return arguments[chosen].type == kind::missing ? make_number(0) : arguments[chosen];
+}
+
+// AND and OR: booleans and numbers count, text in references is skipped
+template<typename Combine>
+operand combine_booleans(const operand *arguments, std::size_t count, bool initial, Combine combine)
+{
+    bool result = initial;
+    bool any = false;
+
+    for(std::size_t i = 0; i < count; i++)
+    {
+        const auto &argument = arguments[i];
+
+        if(argument.type == kind::range)
+        {
+            if(argument.range->sheet == nullptr)
+            {
+                return make_error(ErrorReference);
+            }
+
+            operand error;
+
+            for_each_cell(*argument.range, [&](column_t, row_t, cell_impl &cell)
+            {
+                if(cell.value_.is(value::type::numeric) || cell.value_.is(value::type::boolean))
+                {
+                    result = combine(result, cell.value_.as<bool>());
+                    any = true;
+                }
+                else if(cell.value_.is(value::type::error) && error.type != kind::error)
+                {
+                    error = from_value(cell.value_);
+                }
+            });
+
+            if(error.type == kind::error)
+            {
+                return error;
+            }
+
+            continue;
+        }
+
+        if(argument.type == kind::error)
+        {
+            return argument;
+        }
+
+        bool boolean = false;
+
+        if(argument.type == kind::missing)
+        {
+            continue;
+        }
+
+        if(!to_boolean(argument, boolean))
+        {
+            return make_error(ErrorValue);
+        }
+
+        result = combine(result, boolean);
+        any = true;
+    }
+
+    return any ? make_boolean(result) : make_error(ErrorValue);
+}
+
+operand function_and(const operand *arguments, std::size_t count, column_cache &)
+{
+    return combine_booleans(arguments, count, true, [](bool left, bool right) { return left && right; });
+}
+
+operand function_or(const operand *arguments, std::size_t count, column_cache &)
+{
+    return combine_booleans(arguments, count, false, [](bool left, bool right) { return left || right; });
+}
+
+operand function_not(const operand *arguments, std::size_t, column_cache &)
+{
+    auto argument = dereference(arguments[0]);
+    bool result = false;
+
+    if(argument.type == kind::error)
+    {
+        return argument;
+    }
+
+    return to_boolean(argument, result) ? make_boolean(!result) : make_error(ErrorValue);
+}
+
+operand function_true(const operand *, std::size_t, column_cache &)
+{
+    return make_boolean(true);
+}
+
+operand function_false(const operand *, std::size_t, column_cache &)
+{
+    return make_boolean(false);
+}
+
+operand function_iferror(const operand *arguments, std::size_t, column_cache &)
+{
+    auto argument = dereference(arguments[0]);
+    return argument.type == kind::error ? arguments[1] : argument;
+}
+
+operand function_iserror(const operand *arguments, std::size_t, column_cache &)
+{
+    return make_boolean(dereference(arguments[0]).type == kind::error);
+}
+
+operand function_isna(const operand *arguments, std::size_t, column_cache &)
+{
+    auto argument = dereference(arguments[0]);
+    return make_boolean(argument.type == kind::error && argument.text == ErrorNotAvailable);
+}
+
+operand function_isblank(const operand *arguments, std::size_t, column_cache &)
+{
+    return make_boolean(dereference(arguments[0]).type == kind::empty);
+}
+
+operand function_isnumber(const operand *arguments, std::size_t, column_cache &)
+{
+    return make_boolean(dereference(arguments[0]).type == kind::number);
+}
+
+operand function_istext(const operand *arguments, std::size_t, column_cache &)
+{
+    return make_boolean(dereference(arguments[0]).type == kind::string);
+}
+
+// Converts every argument to a number and passes them to compute, or returns the first error
+template<std::size_t Count, typename Compute>
+operand numeric_function(const operand *arguments, std::size_t count, Compute compute)
+{
+    double numbers[Count] = {};
+
+    for(std::size_t i = 0; i < count && i < Count; i++)
+    {
+        auto argument = dereference(arguments[i]);
+
+        if(argument.type == kind::error)
+        {
+            return argument;
+        }
+
+        if(!to_number(argument, numbers[i]))
+        {
+            return make_error(ErrorValue);
+        }
+    }
+
+    return compute(numbers, count);
+}
+
+operand function_abs(const operand *arguments, std::size_t count, column_cache &)
+{
+    return numeric_function<1>(arguments, count, [](const double *n, std::size_t) { return make_number(std::fabs(n[0])); });
+}
+
+operand function_int(const operand *arguments, std::size_t count, column_cache &)
+{
+    return numeric_function<1>(arguments, count, [](const double *n, std::size_t) { return make_number(std::floor(n[0])); });
+}
+
+operand function_sqrt(const operand *arguments, std::size_t count, column_cache &)
+{
+    return numeric_function<1>(arguments, count, [](const double *n, std::size_t)
+    {
+        return n[0] < 0 ? make_error(ErrorNumber) : make_number(std::sqrt(n[0]));
+    });
+}
+
+operand function_mod(const operand *arguments, std::size_t count, column_cache &)
+{
+    return numeric_function<2>(arguments, count, [](const double *n, std::size_t)
+    {
+        // the result has the sign of the divisor
+        return n[1] == 0 ? make_error(ErrorDivideByZero) : finite_or_error(n[0] - n[1] * std::floor(n[0] / n[1]));
+    });
+}
+
+operand function_power(const operand *arguments, std::size_t count, column_cache &)
+{
+    return numeric_function<2>(arguments, count, [](const double *n, std::size_t) { return power(n[0], n[1]); });
+}
+
+// ROUND, ROUNDUP and ROUNDDOWN to a number of decimal places, which may be
+// negative; mode is applied to the magnitude of the scaled number
+template<typename Mode>
+operand round_function(const operand *arguments, std::size_t count, Mode mode)
+{
+    return numeric_function<2>(arguments, count, [&](const double *n, std::size_t)
+    {
+        auto scale = std::pow(10.0, std::trunc(n[1]));
+        auto scaled = to_significant_digits(std::fabs(n[0]) * scale);
+        auto rounded = mode(scaled) / scale;
+        return finite_or_error(n[0] < 0 ? -rounded : rounded);
+    });
+}
+
+operand function_round(const operand *arguments, std::size_t count, column_cache &)
+{
+    return round_function(arguments, count, [](double n) { return std::floor(n + 0.5); });
+}
+
+operand function_roundup(const operand *arguments, std::size_t count, column_cache &)
+{
+    return round_function(arguments, count, [](double n) { return std::ceil(n); });
+}
+
+operand function_rounddown(const operand *arguments, std::size_t count, column_cache &)
+{
+    return round_function(arguments, count, [](double n) { return std::floor(n); });
+}
+
+operand function_concatenate(const operand *arguments, std::size_t count, column_cache &)
+{
+    std::string result;
+
+    for(std::size_t i = 0; i < count; i++)
+    {
+        auto argument = dereference(arguments[i]);
+
+        if(argument.type == kind::error)
+        {
+            return argument;
+        }
+
+        result.append(to_text(argument));
+    }
+
+    return make_string(result);
+}
+
+operand function_len(const operand *arguments, std::size_t, column_cache &)
+{
+    auto argument = dereference(arguments[0]);
+    return argument.type == kind::error ? argument : make_number(static_cast<double>(to_text(argument).size()));
+}
+
+// One row or column of a reference, as searched by MATCH, VLOOKUP and HLOOKUP
+struct cell_vector
+{
+    worksheet_impl *sheet;
+    column_t column;
+    row_t row;
+    bool across;
+    std::uint64_t length;
+
+    operand at(std::uint64_t index) const
+    {
+        return across
+            ? read_cell(sheet, static_cast<column_t>(column + index), row)
+            : read_cell(sheet, column, static_cast<row_t>(row + index));
+    }
+};
+
+cell_vector make_vector(const reference &range, bool across, std::uint64_t offset)
+{
+    cell_vector result;
+    result.sheet = range.sheet;
+    result.across = across;
+
+    if(across)
+    {
+        result.row = static_cast<row_t>(range.first_row + offset);
+        result.column = range.first_column;
+        result.length = static_cast<std::uint64_t>(range.last_column) - range.first_column + 1;
+
+        // nothing past the last cell of the row can match
+        column_t last_column = 0;
+        auto row = range.sheet->cell_map_.find(result.row);
+
+        if(row != range.sheet->cell_map_.end())
+        {
+            for(const auto &cell : row->second)
+            {
+                last_column = std::max(last_column, cell.first);
+            }
+        }
+
+        result.length = last_column < range.first_column ? 0 : std::min<std::uint64_t>(result.length, last_column - range.first_column + 1);
+    }
+    else
+    {
+        result.column = static_cast<column_t>(range.first_column + offset);
+        result.row = range.first_row;
+        result.length = static_cast<std::uint64_t>(range.last_row) - range.first_row + 1;
+        auto last_row = range.sheet->highest_row_;
+        result.length = last_row < range.first_row ? 0 : std::min<std::uint64_t>(result.length, last_row - range.first_row + 1);
+    }
+
+    return result;
+}
+
+const std::uint64_t NotFound = static_cast<std::uint64_t>(-1);
+
+// Position of lookup in cells. match_type 0 finds an equal value; 1 the largest
+// value not greater than lookup and -1 the smallest value not less than it,
+// assuming cells are sorted ascending or descending respectively. Cells of
+// another type than lookup are skipped.
+std::uint64_t find_in_vector(const cell_vector &cells, const operand &lookup, int match_type)
+{
+    auto found = NotFound;
+
+    for(std::uint64_t i = 0; i < cells.length; i++)
+    {
+        auto candidate = cells.at(i);
+
+        if(candidate.type != lookup.type)
+        {
+            continue;
+        }
+
+        auto order = compare(candidate, lookup);
+
+        if(match_type == 0)
+        {
+            if(order == 0)
+            {
+                return i;
+            }
+        }
+        else if(match_type > 0 ? order <= 0 : order >= 0)
+        {
+            found = i;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    return found;
+}
+
+operand function_match(const operand *arguments, std::size_t count, column_cache &)
+{
+    auto lookup = dereference(arguments[0]);
+
+    if(lookup.type == kind::error)
+    {
+        return lookup;
+    }
+
+    if(arguments[1].type != kind::range)
+    {
+        return make_error(ErrorNotAvailable);
+    }
+
+    const auto &range = *arguments[1].range;
+
+    if(range.sheet == nullptr)
+    {
+        return make_error(ErrorReference);
+    }
+
+    double match_type = 1;
+
+    if(count == 3 && !to_number(dereference(arguments[2]), match_type))
+    {
+        return make_error(ErrorValue);
+    }
+
+    bool across = range.first_row == range.last_row;
+
+    if(!across && range.first_column != range.last_column)
+    {
+        return make_error(ErrorNotAvailable);
+    }
+
+    auto index = find_in_vector(make_vector(range, across, 0), lookup, match_type > 0 ? 1 : match_type < 0 ? -1 : 0);
+
+    return index == NotFound ? make_error(ErrorNotAvailable) : make_number(static_cast<double>(index + 1));
+}
+
+// VLOOKUP (across is false) and HLOOKUP
+operand table_lookup(const operand *arguments, std::size_t count, bool across)
+{
+    auto lookup = dereference(arguments[0]);
+
+    if(lookup.type == kind::error)
+    {
+        return lookup;
+    }
+
+    if(arguments[1].type != kind::range)
+    {
+        return make_error(ErrorValue);
+    }
+
+    const auto &table = *arguments[1].range;
+
+    if(table.sheet == nullptr)
+    {
+        return make_error(ErrorReference);
+    }
+
+    double index = 0;
+    bool approximate = true;
+
+    if(!to_number(dereference(arguments[2]), index) || (count == 4 && !to_boolean(dereference(arguments[3]), approximate)))
+    {
+        return make_error(ErrorValue);
+    }
+
+    if(index < 1)
+    {
+        return make_error(ErrorValue);
+    }
+
+    auto offset = static_cast<std::uint64_t>(index) - 1;
+    auto extent = across
+        ? static_cast<std::uint64_t>(table.last_row) - table.first_row + 1
+        : static_cast<std::uint64_t>(table.last_column) - table.first_column + 1;
+
+    if(offset >= extent)
+    {
+        return make_error(ErrorReference);
+    }
+
+    auto position = find_in_vector(make_vector(table, across, 0), lookup, approximate ? 1 : 0);
+
+    if(position == NotFound)
+    {
+        return make_error(ErrorNotAvailable);
+    }
+
+    return across
+        ? read_cell(table.sheet, static_cast<column_t>(table.first_column + position), static_cast<row_t>(table.first_row + offset))
+        : read_cell(table.sheet, static_cast<column_t>(table.first_column + offset), static_cast<row_t>(table.first_row + position));
+}
+
+operand function_vlookup(const operand *arguments, std::size_t count, column_cache &)
+{
+    return table_lookup(arguments, count, false);
+}
+
+operand function_hlookup(const operand *arguments, std::size_t count, column_cache &)
+{
+    return table_lookup(arguments, count, true);
+}
+
+operand function_index(const operand *arguments, std::size_t count, column_cache &)
+{
+    if(arguments[0].type != kind::range)
+    {
+        return make_error(ErrorValue);
+    }
+
+    const auto &range = *arguments[0].range;
+
+    if(range.sheet == nullptr)
+    {
+        return make_error(ErrorReference);
+    }
+
+    double row_number = 0;
+    double column_number = 1;
+
+    if(!to_number(dereference(arguments[1]), row_number) || (count == 3 && !to_number(dereference(arguments[2]), column_number)))
+    {
+        return make_error(ErrorValue);
+    }
+
+    // INDEX(A1:E1, 3) is the third cell of the row
+    if(count == 2 && range.first_row == range.last_row)
+    {
+        std::swap(row_number, column_number);
+    }
+
+    if(row_number < 1 || column_number < 1)
+    {
+        return make_error(ErrorValue);
+    }
+
+    auto row = static_cast<std::uint64_t>(row_number) - 1 + range.first_row;
+    auto column = static_cast<std::uint64_t>(column_number) - 1 + range.first_column;
+
+    if(row > range.last_row || column > range.last_column)
+    {
+        return make_error(ErrorReference);
+    }
+
+    return read_cell(range.sheet, static_cast<column_t>(column), static_cast<row_t>(row));
+}
+
+typedef operand (*function_implementation)(const operand *arguments, std::size_t count, column_cache &cache);
+
+struct function_entry
+{
+    const char *name;
+    function_implementation implementation;
+    std::size_t minimum_arguments;
+    std::size_t maximum_arguments;
+};
+
+const std::size_t Unlimited = 255;
+
+const function_entry Functions[] =
+{
+    { "ABS", function_abs, 1, 1 },
+    { "AND", function_and, 1, Unlimited },
+    { "AVERAGE", function_average, 1, Unlimited },
+    { "CONCATENATE", function_concatenate, 1, Unlimited },
+    { "COUNT", function_count, 1, Unlimited },
+    { "COUNTA", function_counta, 1, Unlimited },
+    { "COUNTIF", function_countif, 2, 2 },
+    { "FALSE", function_false, 0, 0 },
+    { "HLOOKUP", function_hlookup, 3, 4 },
+    { "IF", function_if, 1, 3 },
+    { "IFERROR", function_iferror, 2, 2 },
+    { "INDEX", function_index, 2, 3 },
+    { "INT", function_int, 1, 1 },
+    { "ISBLANK", function_isblank, 1, 1 },
+    { "ISERROR", function_iserror, 1, 1 },
+    { "ISNA", function_isna, 1, 1 },
+    { "ISNUMBER", function_isnumber, 1, 1 },
+    { "ISTEXT", function_istext, 1, 1 },
+    { "LEN", function_len, 1, 1 },
+    { "MATCH", function_match, 2, 3 },
+    { "MAX", function_max, 1, Unlimited },
+    { "MIN", function_min, 1, Unlimited },
+    { "MOD", function_mod, 2, 2 },
+    { "NOT", function_not, 1, 1 },
+    { "OR", function_or, 1, Unlimited },
+    { "POWER", function_power, 2, 2 },
+    { "PRODUCT", function_product, 1, Unlimited },
+    { "ROUND", function_round, 2, 2 },
+    { "ROUNDDOWN", function_rounddown, 2, 2 },
+    { "ROUNDUP", function_roundup, 2, 2 },
+    { "SQRT", function_sqrt, 1, 1 },
+    { "SUM", function_sum, 1, Unlimited },
+    { "SUMIF", function_sumif, 2, 3 },
+    { "TRUE", function_true, 0, 0 },
+    { "VLOOKUP", function_vlookup, 3, 4 }
+};
+
+const std::size_t FunctionCount = sizeof(Functions) / sizeof(Functions[0]);
+
+// Stands in for the index of a function that isn't supported
+const std::uint32_t UnknownFunction = static_cast<std::uint32_t>(-1);
+
+std::uint32_t find_function(std::string name)
+{
+    // functions added after Excel 2007 are stored with this prefix
+    if(name.size() > 6 && equals_ignoring_case(name.substr(0, 6), "_xlfn."))
+    {
+        name = name.substr(6);
+    }
+
+    for(std::size_t i = 0; i < FunctionCount; i++)
+    {
+        if(equals_ignoring_case(name, Functions[i].name))
+        {
+            return static_cast<std::uint32_t>(i);
+        }
+    }
+
+    return UnknownFunction;
+}
+
+operand call(std::uint32_t function, const operand *arguments, std::size_t count, column_cache &cache)
+{
+    if(function == UnknownFunction)
+    {
+        return make_error(ErrorName);
+    }
+
+    const auto &entry = Functions[function];
+
+    if(count < entry.minimum_arguments || count > entry.maximum_arguments)
+    {
+        return make_error(ErrorValue);
+    }
+
+    return entry.implementation(arguments, count, cache);
+}
+
+value to_value(const operand &result)
+{
+    switch(result.type)
+    {
+    case kind::number:
+        return value(result.number);
+    case kind::string:
+        return value(result.text);
+    case kind::boolean:
+        return value(result.number != 0);
+    case kind::error:
+        return value::error(result.text);
+    default:
+        // like Excel, a formula that refers to a blank cell shows 0
+        return value(0.0);
+    }
+}
+
+bool is_name_character(char c)
+{
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.' || c == '\\';
+}
+
+} // namespace
+
+column_cache::column_cache()
+{
+}
+
+const column_cache::column &column_cache::get(worksheet_impl *sheet, column_t column)
+{
+    entry *cached = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto &slot = columns_[std::make_pair(static_cast<const worksheet_impl *>(sheet), column)];
+
+        if(!slot)
+        {
+            slot.reset(new entry());
+        }
+
+        cached = slot.get();
+    }
+
+    // other threads wanting the same column wait for it rather than copy it too
+    std::lock_guard<std::mutex> lock(cached->mutex);
+
+    if(!cached->built)
+    {
+        auto &values = cached->values;
+        auto rows = sheet->cell_map_.empty() ? 0 : static_cast<std::size_t>(sheet->highest_row_) + 1;
+        values.numbers.assign(rows, 0);
+        values.is_number.assign(rows, 0);
+
+        for(auto &row : sheet->cell_map_)
+        {
+            auto match = row.second.find(column);
+
+            // lazily loaded strings are neither numbers nor errors
+            if(match == row.second.end() || match->second.lazy_string_ != cell_impl::NoLazyString)
+            {
+                continue;
+            }
+
+            const auto &cell_value = match->second.value_;
+
+            if(cell_value.is(value::type::numeric))
+            {
+                values.numbers[row.first] = cell_value.as<double>();
+                values.is_number[row.first] = 1;
+            }
+            else if(cell_value.is(value::type::error))
+            {
+                values.errors.push_back(std::make_pair(row.first, cell_value.to_string()));
+            }
+        }
+
+        std::sort(values.errors.begin(), values.errors.end());
+        cached->built = true;
+    }
+
+    return cached->values;
+}
+
+void column_cache::invalidate(worksheet_impl *sheet, column_t column)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    columns_.erase(std::make_pair(static_cast<const worksheet_impl *>(sheet), column));
+}
+
+/// <summary>
+/// Recursive descent parser that emits the postfix code of a compiled_formula.
+/// Throws std::runtime_error at the first syntax error.
+/// </summary>
+class formula_compiler
+{
+public:
+    formula_compiler(const std::string &text, const workbook_impl &workbook, worksheet_impl *sheet, compiled_formula &result)
+        : text_(text), position_(0), workbook_(workbook), sheet_(sheet), result_(result)
+    {
+    }
+
+    void compile()
+    {
+        skip_whitespace();
+        accept('=');
+        parse_comparison();
+        skip_whitespace();
+
+        if(position_ != text_.size())
+        {
+            fail();
+        }
+    }
+
+private:
+    typedef compiled_formula::opcode opcode;
+
+    // One side of a reference: a cell (A1), a column (A) or a row (1), each part optionally absolute
+    struct reference_end
+    {
+        bool has_column;
+        bool has_row;
+        column_t column;
+        row_t row;
+    };
+
+    void fail()
+    {
+        throw std::runtime_error("invalid formula");
+    }
+
+    char peek(std::size_t offset = 0) const
+    {
+        return position_ + offset < text_.size() ? text_[position_ + offset] : '\0';
+    }
+
+    void skip_whitespace()
+    {
+        while(peek() == ' ' || peek() == '\t' || peek() == '\r' || peek() == '\n')
+        {
+            position_++;
+        }
+    }
+
+    bool accept(char c)
+    {
+        skip_whitespace();
+
+        if(peek() != c)
+        {
+            return false;
+        }
+
+        position_++;
+        return true;
+    }
+
+    bool accept(const char *token)
+    {
+        skip_whitespace();
+        auto length = std::strlen(token);
+
+        if(text_.compare(position_, length, token) != 0)
+        {
+            return false;
+        }
+
+        position_ += length;
+        return true;
+    }
+
+    void emit(opcode code, std::uint32_t operand = 0, std::size_t argument_count = 0)
+    {
+        compiled_formula::instruction instruction;
+        instruction.code = code;
+        instruction.argument_count = static_cast<std::uint8_t>(argument_count);
+        instruction.operand = operand;
+        result_.code_.push_back(instruction);
+    }
+
+    void emit_string(opcode code, const std::string &string)
+    {
+        result_.strings_.push_back(string);
+        emit(code, static_cast<std::uint32_t>(result_.strings_.size() - 1));
+    }
+
+    void emit_reference(const compiled_formula::reference &range)
+    {
+        result_.references_.push_back(range);
+        emit(opcode::push_reference, static_cast<std::uint32_t>(result_.references_.size() - 1));
+    }
+
+    void parse_comparison()
+    {
+        parse_concatenation();
+
+        for(;;)
+        {
+            opcode code;
+
+            if(accept("<>")) code = opcode::not_equal;
+            else if(accept("<=")) code = opcode::less_equal;
+            else if(accept(">=")) code = opcode::greater_equal;
+            else if(accept('<')) code = opcode::less;
+            else if(accept('>')) code = opcode::greater;
+            else if(accept('=')) code = opcode::equal;
+            else return;
+
+            parse_concatenation();
+            emit(code);
+        }
+    }
+
+    void parse_concatenation()
+    {
+        parse_additive();
+
+        while(accept('&'))
+        {
+            parse_additive();
+            emit(opcode::concatenate);
+        }
+    }
+
+    void parse_additive()
+    {
+        parse_multiplicative();
+
+        for(;;)
+        {
+            if(accept('+'))
+            {
+                parse_multiplicative();
+                emit(opcode::add);
+            }
+            else if(accept('-'))
+            {
+                parse_multiplicative();
+                emit(opcode::subtract);
+            }
+            else
+            {
+                return;
+            }
+        }
+    }
+
+    void parse_multiplicative()
+    {
+        parse_power();
+
+        for(;;)
+        {
+            if(accept('*'))
+            {
+                parse_power();
+                emit(opcode::multiply);
+            }
+            else if(accept('/'))
+            {
+                parse_power();
+                emit(opcode::divide);
+            }
+            else
+            {
+                return;
+            }
+        }
+    }
+
+    // ^ is left associative and, unlike in mathematics, binds looser than negation (-2^2 is 4)
+    void parse_power()
+    {
+        parse_percent();
+
+        while(accept('^'))
+        {
+            parse_percent();
+            emit(opcode::power);
+        }
+    }
+
+    void parse_percent()
+    {
+        parse_unary();
+
+        while(accept('%'))
+        {
+            emit(opcode::percent);
+        }
+    }
+
+    void parse_unary()
+    {
+        if(accept('-'))
+        {
+            parse_unary();
+            emit(opcode::negate);
+        }
+        else if(accept('+'))
+        {
+            parse_unary();
+        }
+        else
+        {
+            parse_primary();
+        }
+    }
+
+    void parse_primary()
+    {
+        skip_whitespace();
+        auto c = peek();
+
+        if(c == '(')
+        {
+            position_++;
+            parse_comparison();
+
+            if(!accept(')'))
+            {
+                fail();
+            }
+        }
+        else if(c == '"')
+        {
+            parse_string();
+        }
+        else if(c == '#')
+        {
+            parse_error();
+        }
+        else if(c == '\'')
+        {
+            parse_quoted_sheet_reference();
+        }
+        else if(try_parse_reference(sheet_))
+        {
+            return;
+        }
+        else if(std::isdigit(static_cast<unsigned char>(c)) || c == '.')
+        {
+            parse_number();
+        }
+        else if(is_name_character(c))
+        {
+            parse_name();
+        }
+        else
+        {
+            fail();
+        }
+    }
+
+    void parse_number()
+    {
+        auto start = position_;
+
+        while(std::isdigit(static_cast<unsigned char>(peek())) || peek() == '.')
+        {
+            position_++;
+        }
+
+        if((peek() == 'e' || peek() == 'E') && (std::isdigit(static_cast<unsigned char>(peek(1)))
+            || ((peek(1) == '+' || peek(1) == '-') && std::isdigit(static_cast<unsigned char>(peek(2))))))
+        {
+            position_ += 2;
+
+            while(std::isdigit(static_cast<unsigned char>(peek())))
+            {
+                position_++;
+            }
+        }
+
+        double number = 0;
+
+        if(!parse_double(text_.data() + start, text_.data() + position_, number))
+        {
+            fail();
+        }
+
+        result_.numbers_.push_back(number);
+        emit(opcode::push_number, static_cast<std::uint32_t>(result_.numbers_.size() - 1));
+    }
+
+    // Reads a string delimited by quote, in which the quote is escaped by doubling it
+    std::string read_quoted(char quote)
+    {
+        std::string result;
+        position_++;
+
+        for(;;)
+        {
+            if(position_ >= text_.size())
+            {
+                fail();
+            }
+
+            if(text_[position_] == quote)
+            {
+                if(peek(1) != quote)
+                {
+                    position_++;
+                    return result;
+                }
+
+                position_++;
+            }
+
+            result.push_back(text_[position_++]);
+        }
+    }
+
+    void parse_string()
+    {
+        emit_string(opcode::push_string, read_quoted('"'));
+    }
+
+    void parse_error()
+    {
+        for(auto code : ErrorCodes)
+        {
+            if(text_.compare(position_, std::strlen(code), code) == 0)
+            {
+                position_ += std::strlen(code);
+                emit_string(opcode::push_error, code);
+                return;
+            }
+        }
+
+        fail();
+    }
+
+    void parse_quoted_sheet_reference()
+    {
+        auto title = read_quoted('\'');
+
+        if(peek() != '!')
+        {
+            fail();
+        }
+
+        position_++;
+
+        if(!try_parse_reference(workbook_.find_sheet(title), true))
+        {
+            fail();
+        }
+    }
+
+    // A function call, a boolean, a sheet-qualified reference or a defined name
+    void parse_name()
+    {
+        auto start = position_;
+
+        while(is_name_character(peek()))
+        {
+            position_++;
+        }
+
+        auto name = text_.substr(start, position_ - start);
+
+        if(peek() == '!')
+        {
+            position_++;
+
+            if(!try_parse_reference(workbook_.find_sheet(name), true))
+            {
+                fail();
+            }
+
+            return;
+        }
+
+        skip_whitespace();
+
+        if(peek() == '(')
+        {
+            position_++;
+            auto function = find_function(name);
+
+            if(function == UnknownFunction)
+            {
+                result_.supported_ = false;
+            }
+
+            parse_call(function);
+            return;
+        }
+
+        if(equals_ignoring_case(name, "TRUE") || equals_ignoring_case(name, "FALSE"))
+        {
+            emit(opcode::push_boolean, equals_ignoring_case(name, "TRUE") ? 1 : 0);
+            return;
+        }
+
+        auto owner = workbook_.find_named_range_owner(name);
+
+        if(owner == nullptr || owner->named_ranges_.find(name) == owner->named_ranges_.end())
+        {
+            result_.supported_ = false;
+            emit_string(opcode::push_error, ErrorName);
+            return;
+        }
+
+        auto range = owner->named_ranges_.find(name);
+
+        compiled_formula::reference named;
+        named.sheet = owner;
+        named.first_column = range->second.get_top_left().get_column_index();
+        named.first_row = range->second.get_top_left().get_row_index();
+        named.last_column = range->second.get_bottom_right().get_column_index();
+        named.last_row = range->second.get_bottom_right().get_row_index();
+        emit_reference(named);
+    }
+
+    void parse_call(std::uint32_t function)
+    {
+        std::size_t argument_count = 0;
+
+        if(!accept(')'))
+        {
+            for(;;)
+            {
+                skip_whitespace();
+
+                if(peek() == ',' || peek() == ')')
+                {
+                    emit(opcode::push_missing);
+                }
+                else
+                {
+                    parse_comparison();
+                }
+
+                argument_count++;
+
+                if(accept(')'))
+                {
+                    break;
+                }
+
+                if(!accept(','))
+                {
+                    fail();
+                }
+            }
+        }
+
+        if(argument_count > Unlimited)
+        {
+            fail();
+        }
+
+        emit(opcode::call, function, argument_count);
+    }
+
+    bool parse_reference_end(reference_end &end)
+    {
+        end.has_column = false;
+        end.has_row = false;
+        end.column = 0;
+        end.row = 0;
+
+        auto start = position_;
+
+        if(peek() == '$')
+        {
+            position_++;
+        }
+
+        std::uint64_t column = 0;
+        std::size_t letters = 0;
+
+        while(std::isalpha(static_cast<unsigned char>(peek())) && letters < 4)
+        {
+            column = column * 26 + (std::toupper(static_cast<unsigned char>(peek())) - 'A' + 1);
+            letters++;
+            position_++;
+        }
+
+        if(letters > 0)
+        {
+            if(letters > 3 || column > constants::MaxColumn)
+            {
+                position_ = start;
+                return false;
+            }
+
+            end.has_column = true;
+            end.column = static_cast<column_t>(column - 1);
+        }
+
+        if(peek() == '$' && std::isdigit(static_cast<unsigned char>(peek(1))))
+        {
+            position_++;
+        }
+
+        std::uint64_t row = 0;
+        std::size_t digits = 0;
+
+        while(std::isdigit(static_cast<unsigned char>(peek())) && digits < 11)
+        {
+            row = row * 10 + static_cast<std::uint64_t>(peek() - '0');
+            digits++;
+            position_++;
+        }
+
+        if(digits > 0)
+        {
+            if(row == 0 || row > constants::MaxRow)
+            {
+                position_ = start;
+                return false;
+            }
+
+            end.has_row = true;
+            end.row = static_cast<row_t>(row - 1);
+        }
+
+        if(!end.has_column && !end.has_row)
+        {
+            position_ = start;
+            return false;
+        }
+
+        return true;
+    }
+
+    // Parses A1, A1:B2, A:B or 1:2 at the current position and emits it as a
+    // reference to a cell of sheet. Leaves the position alone and returns false
+    // if there isn't one. qualified is true after "Sheet!", where sheet may be
+    // nullptr for a sheet that doesn't exist.
+    bool try_parse_reference(worksheet_impl *sheet, bool qualified = false)
+    {
+        auto start = position_;
+        reference_end first;
+        reference_end last;
+
+        if(!parse_reference_end(first))
+        {
+            return false;
+        }
+
+        bool is_range = false;
+
+        if(peek() == ':')
+        {
+            position_++;
+
+            if(!parse_reference_end(last))
+            {
+                position_ = start;
+                return false;
+            }
+
+            is_range = true;
+        }
+        else
+        {
+            last = first;
+        }
+
+        bool cells = first.has_column && first.has_row && last.has_column && last.has_row;
+        bool columns = is_range && first.has_column && !first.has_row && last.has_column && !last.has_row;
+        bool rows = is_range && !first.has_column && first.has_row && !last.has_column && last.has_row;
+
+        // e.g. LOG10( or SUM1X is a name, not a reference
+        if((!cells && !columns && !rows) || is_name_character(peek()) || peek() == '(')
+        {
+            position_ = start;
+
+            if(qualified)
+            {
+                fail();
+            }
+
+            return false;
+        }
+
+        compiled_formula::reference range;
+        range.sheet = sheet;
+        range.first_column = columns || cells ? std::min(first.column, last.column) : 0;
+        range.last_column = columns || cells ? std::max(first.column, last.column) : constants::MaxColumn - 1;
+        range.first_row = rows || cells ? std::min(first.row, last.row) : 0;
+        range.last_row = rows || cells ? std::max(first.row, last.row) : constants::MaxRow - 1;
+        emit_reference(range);
+
+        return true;
+    }
+
+    const std::string &text_;
+    std::size_t position_;
+    const workbook_impl &workbook_;
+    worksheet_impl *sheet_;
+    compiled_formula &result_;
+};
+
+compiled_formula::compiled_formula() : supported_(false)
+{
+}
+
+compiled_formula::compiled_formula(const std::string &text, const workbook_impl &workbook, worksheet_impl *sheet)
+    : supported_(true)
+{
+    try
+    {
+        formula_compiler(text, workbook, sheet, *this).compile();
+    }
+    catch(std::exception &)
+    {
+        code_.clear();
+        numbers_.clear();
+        strings_.clear();
+        references_.clear();
+        strings_.push_back(ErrorName);
+        supported_ = false;
+
+        instruction error;
+        error.code = opcode::push_error;
+        error.argument_count = 0;
+        error.operand = 0;
+        code_.push_back(error);
+    }
+}
+
+value compiled_formula::evaluate(column_cache &cache) const
+{
+    std::vector<operand> stack;
+    stack.reserve(code_.size());
+
+    for(const auto &instruction : code_)
+    {
+        switch(instruction.code)
+        {
+        case opcode::push_number:
+            stack.push_back(make_number(numbers_[instruction.operand]));
+            break;
+        case opcode::push_string:
+            stack.push_back(make_string(strings_[instruction.operand]));
+            break;
+        case opcode::push_boolean:
+            stack.push_back(make_boolean(instruction.operand != 0));
+            break;
+        case opcode::push_error:
+            stack.push_back(make_error(strings_[instruction.operand].c_str()));
+            break;
+        case opcode::push_missing:
+            stack.push_back(operand());
+            stack.back().type = kind::missing;
+            break;
+        case opcode::push_reference:
+            stack.push_back(make_range(&references_[instruction.operand]));
+            break;
+        case opcode::negate:
+        case opcode::percent:
+        {
+            auto argument = dereference(stack.back());
+            double number = 0;
+
+            if(argument.type == kind::error)
+            {
+                stack.back() = argument;
+            }
+            else if(!to_number(argument, number))
+            {
+                stack.back() = make_error(ErrorValue);
+            }
+            else
+            {
+                stack.back() = make_number(instruction.code == opcode::negate ? -number : number / 100);
+            }
+
+            break;
+        }
+        case opcode::call:
+        {
+            auto first = stack.size() - instruction.argument_count;
+            auto result = call(instruction.operand, stack.data() + first, instruction.argument_count, cache);
+            stack.resize(first);
+            stack.push_back(result);
+            break;
+        }
+        default:
+        {
+            // binary operators
+            auto right = dereference(stack.back());
+            stack.pop_back();
+            auto left = dereference(stack.back());
+            auto &result = stack.back();
+
+            if(left.type == kind::error)
+            {
+                result = left;
+                break;
+            }
+
+            if(right.type == kind::error)
+            {
+                result = right;
+                break;
+            }
+
+            if(instruction.code == opcode::concatenate)
+            {
+                result = make_string(to_text(left) + to_text(right));
+                break;
+            }
+
+            if(instruction.code >= opcode::equal)
+            {
+                auto order = compare(left, right);
+
+                switch(instruction.code)
+                {
+                case opcode::equal: result = make_boolean(order == 0); break;
+                case opcode::not_equal: result = make_boolean(order != 0); break;
+                case opcode::less: result = make_boolean(order < 0); break;
+                case opcode::less_equal: result = make_boolean(order <= 0); break;
+                case opcode::greater: result = make_boolean(order > 0); break;
+                default: result = make_boolean(order >= 0); break;
+                }
+
+                break;
+            }
+
+            double x = 0;
+            double y = 0;
+
+            if(!to_number(left, x) || !to_number(right, y))
+            {
+                result = make_error(ErrorValue);
+                break;
+            }
+
+            switch(instruction.code)
+            {
+            case opcode::add: result = finite_or_error(x + y); break;
+            case opcode::subtract: result = finite_or_error(x - y); break;
+            case opcode::multiply: result = finite_or_error(x * y); break;
+            case opcode::divide: result = y == 0 ? make_error(ErrorDivideByZero) : finite_or_error(x / y); break;
+            default: result = power(x, y); break;
+            }
+
+            break;
+        }
+        }
+    }
+
+    return stack.empty() ? value(0.0) : to_value(dereference(stack.back()));
+}
+
+} // namespace detail
+} // namespace xlnt
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <xlnt/cell/value.hpp>
+#include <xlnt/common/types.hpp>
+
+namespace xlnt {
+namespace detail {
+
+struct workbook_impl;
+struct worksheet_impl;
+
+/// <summary>
+/// The numbers of the columns that tall ranges read, laid out contiguously so
+/// that aggregates such as SUM over them are vectorizable loops rather than a
+/// hash lookup per cell. Columns are copied on first use and then shared by
+/// the formulas of one calculation, from any number of threads. A column must
+/// be invalidated (with no formula being evaluated) when a cell in it changes.
+/// </summary>
+class column_cache
+{
+public:
+    struct column
+    {
+        // value of every row up to the sheet's highest, 0 if it isn't a number
+        std::vector<double> numbers;
+        // 1 where the row holds a number
+        std::vector<std::uint8_t> is_number;
+        // the rows holding errors and their codes, by row
+        std::vector<std::pair<row_t, std::string>> errors;
+    };
+
+    column_cache();
+
+    const column &get(worksheet_impl *sheet, column_t column);
+    void invalidate(worksheet_impl *sheet, column_t column);
+
+private:
+    column_cache(const column_cache &);
+    column_cache &operator=(const column_cache &);
+
+    struct entry
+    {
+        entry() : built(false) {}
+
+        std::mutex mutex;
+        bool built;
+        column values;
+    };
+
+    std::mutex mutex_;
+    std::map<std::pair<const worksheet_impl *, column_t>, std::unique_ptr<entry>> columns_;
+};
+
+/// <summary>
+/// A formula compiled to postfix code for formula_engine. Covers arithmetic,
+/// comparison and concatenation operators, references to cells, ranges
+/// (including whole columns and rows), other sheets and defined names, and
+/// the arithmetic, logical, lookup and aggregate functions listed in formula.cpp.
+/// </summary>
+/// <remarks>
+/// Sheets and defined names are resolved when the formula is compiled. Text
+/// that doesn't parse, calls of unsupported functions and names that aren't
+/// defined compile to #NAME? and make is_supported false, since Excel may well
+/// compute something else for them. References to sheets that don't exist
+/// evaluate to #REF!.
+/// </remarks>
+class compiled_formula
+{
+public:
+    /// <summary>
+    /// A cell or a rectangle of cells the formula reads. Indices are zero-based
+    /// and inclusive. sheet is nullptr for references that couldn't be resolved.
+    /// </summary>
+    struct reference
+    {
+        worksheet_impl *sheet;
+        column_t first_column;
+        column_t last_column;
+        row_t first_row;
+        row_t last_row;
+
+        bool operator==(const reference &other) const
+        {
+            return sheet == other.sheet && first_column == other.first_column && last_column == other.last_column
+                && first_row == other.first_row && last_row == other.last_row;
+        }
+
+        bool operator!=(const reference &other) const
+        {
+            return !(*this == other);
+        }
+    };
+
+    compiled_formula();
+
+    /// <summary>
+    /// Compile text (with or without a leading '=') as the formula of a cell on
+    /// sheet. The caller holds workbook.structure_mutex_.
+    /// </summary>
+    compiled_formula(const std::string &text, const workbook_impl &workbook, worksheet_impl *sheet);
+
+    /// <summary>
+    /// Evaluate the formula with the current values of the cells it refers to.
+    /// Only reads the sheets (and cache), so formulas that don't read each
+    /// other can be evaluated on several threads at once as long as no cell
+    /// holds a lazily loaded string.
+    /// </summary>
+    value evaluate(column_cache &cache) const;
+
+    const std::vector<reference> &get_references() const
+    {
+        return references_;
+    }
+
+    /// <summary>
+    /// False if the text didn't compile or uses a function or name this
+    /// evaluator doesn't know, in which case the value Excel stored for the
+    /// cell is better than the #NAME? evaluate would give.
+    /// </summary>
+    bool is_supported() const
+    {
+        return supported_;
+    }
+
+private:
+    friend class formula_compiler;
+
+    enum class opcode : std::uint8_t
+    {
+        push_number,
+        push_string,
+        push_boolean,
+        push_error,
+        push_missing,
+        push_reference,
+        negate,
+        percent,
+        add,
+        subtract,
+        multiply,
+        divide,
+        power,
+        concatenate,
+        equal,
+        not_equal,
+        less,
+        less_equal,
+        greater,
+        greater_equal,
+        call
+    };
+
+    struct instruction
+    {
+        opcode code;
+        // number of arguments of a call
+        std::uint8_t argument_count;
+        // index into numbers_, strings_ or references_, the boolean, or the function of a call
+        std::uint32_t operand;
+    };
+
+    std::vector<instruction> code_;
+    std::vector<double> numbers_;
+    // string literals and error codes
+    std::vector<std::string> strings_;
+    std::vector<reference> references_;
+    bool supported_;
+};
+
+} // namespace detail
+} // namespace xlnt
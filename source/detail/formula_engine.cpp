@@ -0,0 +1,591 @@
+#include <algorithm>
+#include <thread>
+
+#include <xlnt/drawing/drawing.hpp>
+#include <xlnt/workbook/document_properties.hpp>
+#include <xlnt/workbook/workbook.hpp>
+#include <xlnt/worksheet/range_reference.hpp>
+#include <xlnt/worksheet/worksheet.hpp>
+
+#include "detail/formula_engine.hpp"
+#include "detail/workbook_impl.hpp"
+#include "detail/worker_pool.hpp"
+#include "detail/worksheet_impl.hpp"
+
+namespace {
+
+std::uint64_t make_position(column_t column, row_t row)
+{
+    return (static_cast<std::uint64_t>(row) << 32) | column;
+}
+
+column_t position_column(std::uint64_t position)
+{
+    return static_cast<column_t>(position & 0xffffffff);
+}
+
+row_t position_row(std::uint64_t position)
+{
+    return static_cast<row_t>(position >> 32);
+}
+
+template<typename T>
+void erase_value(std::vector<T> &values, const T &value)
+{
+    values.erase(std::remove(values.begin(), values.end(), value), values.end());
+}
+
+} // namespace
+
+namespace xlnt {
+namespace detail {
+
+formula_engine::formula_engine() : state_(state::rebuild), threads_(0)
+{
+}
+
+formula_engine::formula_engine(const formula_engine &other) : state_(state::rebuild), threads_(other.threads_)
+{
+}
+
+formula_engine::~formula_engine()
+{
+}
+
+formula_engine &formula_engine::operator=(const formula_engine &other)
+{
+    clear();
+    state_ = state::rebuild;
+    threads_ = other.threads_;
+    return *this;
+}
+
+void formula_engine::set_threads(std::size_t threads)
+{
+    threads_ = threads;
+}
+
+std::size_t formula_engine::get_threads() const
+{
+    return threads_;
+}
+
+std::size_t formula_engine::participants() const
+{
+    if(threads_ != 0)
+    {
+        return threads_;
+    }
+
+    return std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+}
+
+void formula_engine::invalidate()
+{
+    // the old graph stays until calculate, which compares the new one to it
+    if(state_ == state::incremental)
+    {
+        state_ = state::rebuild_changed;
+    }
+}
+
+void formula_engine::loaded(workbook_impl &workbook)
+{
+    clear();
+    bool any_formulas = false;
+
+    for(auto &ws : workbook.worksheets_)
+    {
+        ws->formula_edits_.clear();
+        ws->input_edits_.clear();
+        any_formulas = any_formulas || ws->formula_count_ > 0;
+    }
+
+    // until the graph is built, any cell could be an input
+    for(auto &ws : workbook.worksheets_)
+    {
+        ws->track_input_edits_ = any_formulas;
+    }
+
+    state_ = any_formulas ? state::rebuild_loaded : state::incremental;
+}
+
+void formula_engine::clear()
+{
+    nodes_.clear();
+    cell_readers_.clear();
+    range_readers_.clear();
+}
+
+void formula_engine::rebuild(workbook_impl &workbook)
+{
+    clear();
+
+    for(auto &ws : workbook.worksheets_)
+    {
+        if(ws->formula_count_ == 0)
+        {
+            continue;
+        }
+
+        for(auto &row : ws->cell_map_)
+        {
+            for(auto &cell : row.second)
+            {
+                if(!cell.second.formula_.empty())
+                {
+                    cell_id id = { ws.get(), make_position(cell.first, row.first) };
+                    add_node(id, cell.second.formula_, workbook);
+                }
+            }
+        }
+    }
+}
+
+formula_engine::node &formula_engine::add_node(const cell_id &id, const std::string &formula, workbook_impl &workbook)
+{
+    node added;
+    added.id = id;
+    added.formula = compiled_formula(formula, workbook, id.sheet);
+    added.dirty = false;
+    added.pending = 0;
+
+    auto &result = nodes_.emplace(id, std::move(added)).first->second;
+
+    // nodes_ never moves its elements, so the index can point into them
+    for(const auto &reference : result.formula.get_references())
+    {
+        if(reference.sheet == nullptr)
+        {
+            continue;
+        }
+
+        reference.sheet->track_input_edits_ = true;
+
+        if(reference.first_column == reference.last_column && reference.first_row == reference.last_row)
+        {
+            cell_id read = { reference.sheet, make_position(reference.first_column, reference.first_row) };
+            cell_readers_[read].push_back(&result);
+            continue;
+        }
+
+        auto &index = range_readers_[reference.sheet];
+        range_entry entry = { &reference, &result };
+
+        if(reference.last_column - reference.first_column < WideRange)
+        {
+            for(auto column = reference.first_column; column <= reference.last_column; column++)
+            {
+                index.columns[column].push_back(entry);
+            }
+        }
+        else
+        {
+            index.wide.push_back(entry);
+        }
+    }
+
+    return result;
+}
+
+void formula_engine::remove_node(const cell_id &id)
+{
+    auto match = nodes_.find(id);
+
+    if(match == nodes_.end())
+    {
+        return;
+    }
+
+    auto removed = &match->second;
+    auto is_removed = [removed](const range_entry &entry) { return entry.reader == removed; };
+
+    for(const auto &reference : removed->formula.get_references())
+    {
+        if(reference.sheet == nullptr)
+        {
+            continue;
+        }
+
+        if(reference.first_column == reference.last_column && reference.first_row == reference.last_row)
+        {
+            cell_id read = { reference.sheet, make_position(reference.first_column, reference.first_row) };
+            auto readers = cell_readers_.find(read);
+
+            if(readers != cell_readers_.end())
+            {
+                erase_value(readers->second, removed);
+
+                if(readers->second.empty())
+                {
+                    cell_readers_.erase(readers);
+                }
+            }
+
+            continue;
+        }
+
+        auto &index = range_readers_[reference.sheet];
+
+        if(reference.last_column - reference.first_column < WideRange)
+        {
+            for(auto column = reference.first_column; column <= reference.last_column; column++)
+            {
+                auto &entries = index.columns[column];
+                entries.erase(std::remove_if(entries.begin(), entries.end(), is_removed), entries.end());
+
+                if(entries.empty())
+                {
+                    index.columns.erase(column);
+                }
+            }
+        }
+        else
+        {
+            index.wide.erase(std::remove_if(index.wide.begin(), index.wide.end(), is_removed), index.wide.end());
+        }
+    }
+
+    nodes_.erase(match);
+}
+
+template<typename Visitor>
+void formula_engine::for_each_reader(const cell_id &id, Visitor visit)
+{
+    auto readers = cell_readers_.find(id);
+
+    if(readers != cell_readers_.end())
+    {
+        for(auto reader : readers->second)
+        {
+            visit(reader);
+        }
+    }
+
+    auto index = range_readers_.find(id.sheet);
+
+    if(index == range_readers_.end())
+    {
+        return;
+    }
+
+    auto column = position_column(id.position);
+    auto row = position_row(id.position);
+
+    auto contains = [column, row](const compiled_formula::reference &range)
+    {
+        return column >= range.first_column && column <= range.last_column
+            && row >= range.first_row && row <= range.last_row;
+    };
+
+    auto narrow = index->second.columns.find(column);
+
+    if(narrow != index->second.columns.end())
+    {
+        for(const auto &entry : narrow->second)
+        {
+            if(contains(*entry.range))
+            {
+                visit(entry.reader);
+            }
+        }
+    }
+
+    for(const auto &entry : index->second.wide)
+    {
+        if(contains(*entry.range))
+        {
+            visit(entry.reader);
+        }
+    }
+}
+
+std::size_t formula_engine::calculate(workbook_impl &workbook)
+{
+    std::vector<node *> dirty;
+
+    auto mark = [&dirty](node *marked)
+    {
+        if(!marked->dirty)
+        {
+            marked->dirty = true;
+            dirty.push_back(marked);
+        }
+    };
+
+    // the edits since the last calculation, each edited cell once
+    std::vector<cell_id> formula_edits;
+    std::vector<cell_id> input_edits;
+
+    for(auto &ws : workbook.worksheets_)
+    {
+        auto &positions = ws->formula_edits_;
+        std::sort(positions.begin(), positions.end());
+        positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+
+        for(auto position : positions)
+        {
+            cell_id id = { ws.get(), position };
+            formula_edits.push_back(id);
+        }
+
+        for(auto position : ws->input_edits_)
+        {
+            cell_id id = { ws.get(), position };
+            input_edits.push_back(id);
+        }
+
+        ws->formula_edits_.clear();
+        ws->input_edits_.clear();
+    }
+
+    // The graph is brought up to date before anything is marked, since
+    // replacing a node frees it and dirty must only hold live nodes
+    auto previous_state = state_;
+
+    if(previous_state == state::incremental)
+    {
+        for(const auto &id : formula_edits)
+        {
+            remove_node(id);
+
+            auto cell = id.sheet->find_cell(position_column(id.position), position_row(id.position));
+
+            if(cell != nullptr && !cell->formula_.empty())
+            {
+                add_node(id, cell->formula_, workbook);
+            }
+        }
+    }
+    else if(previous_state == state::rebuild_changed)
+    {
+        // the old nodes are only kept to compare the new ones with
+        std::unordered_map<cell_id, node, cell_id_hash> previous;
+        previous.swap(nodes_);
+        rebuild(workbook);
+
+        for(auto &entry : nodes_)
+        {
+            auto old = previous.find(entry.first);
+
+            if(old == previous.end()
+                || old->second.formula.is_supported() != entry.second.formula.is_supported()
+                || old->second.formula.get_references() != entry.second.formula.get_references())
+            {
+                mark(&entry.second);
+            }
+        }
+    }
+    else
+    {
+        rebuild(workbook);
+
+        for(auto &entry : nodes_)
+        {
+            auto &id = entry.second.id;
+            auto cell = id.sheet->find_cell(position_column(id.position), position_row(id.position));
+
+            if(previous_state == state::rebuild || cell->value_.is(value::type::null))
+            {
+                mark(&entry.second);
+            }
+        }
+    }
+
+    state_ = state::incremental;
+
+    // after a full rebuild everything is dirty already
+    if(previous_state != state::rebuild)
+    {
+        for(const auto &id : formula_edits)
+        {
+            auto edited = nodes_.find(id);
+
+            if(edited != nodes_.end())
+            {
+                mark(&edited->second);
+            }
+
+            for_each_reader(id, mark);
+        }
+
+        for(const auto &id : input_edits)
+        {
+            for_each_reader(id, mark);
+        }
+    }
+
+    // everything that reads a dirty formula is dirty too
+    for(std::size_t i = 0; i < dirty.size(); i++)
+    {
+        auto current = dirty[i];
+
+        for_each_reader(current->id, [&](node *reader)
+        {
+            current->dependents.push_back(reader);
+            mark(reader);
+        });
+    }
+
+    return evaluate(workbook, dirty);
+}
+
+std::size_t formula_engine::evaluate(workbook_impl &workbook, std::vector<node *> &dirty)
+{
+    for(auto current : dirty)
+    {
+        for(auto dependent : current->dependents)
+        {
+            dependent->pending++;
+        }
+    }
+
+    column_cache cache;
+
+    auto store = [&cache](node &evaluated, const value &result)
+    {
+        auto sheet = evaluated.id.sheet;
+        auto column = position_column(evaluated.id.position);
+        auto cell = sheet->find_cell(column, position_row(evaluated.id.position));
+
+        if(cell == nullptr)
+        {
+            return;
+        }
+
+        cell->resolve_value();
+
+        // unchanged results leave the sheet as it was, so save can still copy it
+        if(cell->value_ == result)
+        {
+            return;
+        }
+
+        sheet->before_write();
+        cell->discard_lazy_string();
+        cell->value_ = result;
+        cache.invalidate(sheet, column);
+    };
+
+    // evaluated level by level: each formula after every dirty formula it reads
+    std::vector<node *> level;
+    std::vector<node *> next_level;
+    std::vector<value> results;
+    std::size_t evaluated = 0;
+    bool prepared = false;
+
+    for(auto current : dirty)
+    {
+        if(current->pending == 0)
+        {
+            level.push_back(current);
+        }
+    }
+
+    while(!level.empty())
+    {
+        // the formulas of a level don't read each other, so they can be
+        // evaluated at once; results are stored afterwards, in order, so the
+        // outcome doesn't depend on the number of threads
+        results.assign(level.size(), value());
+        auto task = [&](std::size_t i)
+        {
+            if(level[i]->formula.is_supported())
+            {
+                results[i] = level[i]->formula.evaluate(cache);
+            }
+        };
+
+        if(level.size() >= MinimumParallelLevel && participants() > 1)
+        {
+            if(!prepared)
+            {
+                prepare_parallel(workbook);
+                prepared = true;
+            }
+
+            pool().run(level.size(), task);
+        }
+        else
+        {
+            for(std::size_t i = 0; i < level.size(); i++)
+            {
+                task(i);
+            }
+        }
+
+        next_level.clear();
+
+        for(std::size_t i = 0; i < level.size(); i++)
+        {
+            auto current = level[i];
+
+            if(current->formula.is_supported())
+            {
+                store(*current, results[i]);
+                evaluated++;
+            }
+
+            for(auto dependent : current->dependents)
+            {
+                if(--dependent->pending == 0)
+                {
+                    next_level.push_back(dependent);
+                }
+            }
+        }
+
+        std::swap(level, next_level);
+    }
+
+    for(auto current : dirty)
+    {
+        // what's left is part of a cycle or reads one
+        if(current->pending != 0 && current->formula.is_supported())
+        {
+            store(*current, value(0.0));
+            evaluated++;
+        }
+
+        current->dirty = false;
+        current->pending = 0;
+        current->dependents.clear();
+    }
+
+    return evaluated;
+}
+
+void formula_engine::prepare_parallel(workbook_impl &workbook)
+{
+    // evaluating resolves lazily loaded strings in place, which threads can't
+    // do at once, so they are all resolved first. Either way the values stay
+    // the same, so this doesn't count as a change to the sheet.
+    for(auto &ws : workbook.worksheets_)
+    {
+        if(ws->lazy_strings_ == nullptr)
+        {
+            continue;
+        }
+
+        if(ws->shared_with_snapshot_)
+        {
+            ws->detach_snapshots();
+        }
+
+        ws->resolve_lazy_strings();
+    }
+}
+
+worker_pool &formula_engine::pool()
+{
+    if(!pool_ || pool_->size() != participants())
+    {
+        pool_.reset();
+        pool_.reset(new worker_pool(participants()));
+    }
+
+    return *pool_;
+}
+
+} // namespace detail
+} // namespace xlnt
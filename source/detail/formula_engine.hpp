@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "formula.hpp"
+
+namespace xlnt {
+namespace detail {
+
+class worker_pool;
+struct workbook_impl;
+struct worksheet_impl;
+
+/// <summary>
+/// The formulas of a workbook compiled into a dependency graph, so that
+/// workbook::calculate only evaluates the formulas whose inputs changed since
+/// the last calculation (and the formulas that depend on those, in order).
+/// </summary>
+/// <remarks>
+/// Sheets report edits through worksheet_impl::value_changed and
+/// worksheet_impl::formula_changed. Anything that changes how formula text
+/// resolves (sheets added, removed or renamed and defined names) calls
+/// invalidate, after which the graph is built again and the formulas that
+/// now read different cells are evaluated. Formulas in a cycle evaluate to 0.
+/// Formulas that aren't compiled_formula::is_supported are never evaluated,
+/// so their cells keep the value they were loaded or set with.
+///
+/// Dirty formulas are evaluated in levels, each level holding the formulas
+/// whose inputs the previous levels computed. Large levels are spread over a
+/// worker_pool; the results are the same whatever the number of threads.
+/// </remarks>
+class formula_engine
+{
+public:
+    formula_engine();
+
+    /// <summary>
+    /// The graph refers to the sheets of one workbook, so a copy starts over.
+    /// Only the number of threads is copied.
+    /// </summary>
+    formula_engine(const formula_engine &other);
+    ~formula_engine();
+    formula_engine &operator=(const formula_engine &other);
+
+    /// <summary>
+    /// Set how many threads calculate uses, including the calling thread.
+    /// 0, the default, uses one per hardware thread and 1 calculates serially.
+    /// </summary>
+    void set_threads(std::size_t threads);
+
+    /// <summary>
+    /// The number of threads set by set_threads.
+    /// </summary>
+    std::size_t get_threads() const;
+
+    /// <summary>
+    /// Formula text may resolve differently; the next calculation builds the
+    /// graph again. It evaluates every formula if the graph was never built,
+    /// otherwise only the formulas whose references changed, and it still
+    /// keeps the stored values of a workbook that was just loaded.
+    /// </summary>
+    void invalidate();
+
+    /// <summary>
+    /// Called once workbook has been loaded. The values stored with formulas are
+    /// taken as current, so the next calculation only evaluates formulas without
+    /// one and those affected by edits made from now on.
+    /// </summary>
+    void loaded(workbook_impl &workbook);
+
+    /// <summary>
+    /// Bring the values of formula cells up to date and return how many formulas
+    /// were evaluated. The caller holds workbook.structure_mutex_ and has checked
+    /// that the workbook isn't read-only.
+    /// </summary>
+    std::size_t calculate(workbook_impl &workbook);
+
+private:
+    enum class state
+    {
+        // build the graph and evaluate everything
+        rebuild,
+        // build the graph and evaluate formulas without a value
+        rebuild_loaded,
+        // build the graph again and evaluate the formulas whose references changed
+        rebuild_changed,
+        // the graph is current; evaluate what the pending edits affect
+        incremental
+    };
+
+    struct cell_id
+    {
+        worksheet_impl *sheet;
+        // (row << 32) | column, like the keys of worksheet_impl::formula_edits_
+        std::uint64_t position;
+
+        bool operator==(const cell_id &other) const
+        {
+            return sheet == other.sheet && position == other.position;
+        }
+    };
+
+    struct cell_id_hash
+    {
+        std::size_t operator()(const cell_id &id) const
+        {
+            return std::hash<const void *>()(id.sheet) ^ std::hash<std::uint64_t>()(id.position * 0x9e3779b97f4a7c15ULL);
+        }
+    };
+
+    struct node
+    {
+        cell_id id;
+        compiled_formula formula;
+        // scratch space of calculate
+        bool dirty;
+        std::size_t pending;
+        std::vector<node *> dependents;
+    };
+
+    // A formula that reads a rectangle of cells
+    struct range_entry
+    {
+        const compiled_formula::reference *range;
+        node *reader;
+    };
+
+    // Formulas reading ranges of one sheet. Narrow ranges are filed under each
+    // of their columns so a changed cell is only tested against ranges that
+    // can contain it; ranges wider than WideRange columns (including whole rows)
+    // are tested for every change.
+    struct range_index
+    {
+        std::unordered_map<column_t, std::vector<range_entry>> columns;
+        std::vector<range_entry> wide;
+    };
+
+    static const column_t WideRange = 16;
+
+    // levels smaller than this aren't worth handing to other threads
+    static const std::size_t MinimumParallelLevel = 64;
+
+    void clear();
+    void rebuild(workbook_impl &workbook);
+    node &add_node(const cell_id &id, const std::string &formula, workbook_impl &workbook);
+    void remove_node(const cell_id &id);
+
+    // calls visit(node *) for every formula that reads the cell id
+    template<typename Visitor>
+    void for_each_reader(const cell_id &id, Visitor visit);
+
+    std::size_t evaluate(workbook_impl &workbook, std::vector<node *> &dirty);
+    void prepare_parallel(workbook_impl &workbook);
+    std::size_t participants() const;
+    worker_pool &pool();
+
+    state state_;
+    std::unordered_map<cell_id, node, cell_id_hash> nodes_;
+    // formulas that read single cells, by the cell they read
+    std::unordered_map<cell_id, std::vector<node *>, cell_id_hash> cell_readers_;
+    std::unordered_map<worksheet_impl *, range_index> range_readers_;
+    std::size_t threads_;
+    // created on first use by a parallel level
+    std::unique_ptr<worker_pool> pool_;
+};
+
+} // namespace detail
+} // namespace xlnt
@@ -0,0 +1,222 @@
+#include <algorithm>
+
+#include "detail/merged_cell_index.hpp"
+
+namespace xlnt {
+namespace detail {
+
+const std::size_t merged_cell_index::no_node;
+
+merged_cell_index::merged_cell_index() : built_(false), root_(no_node)
+{
+}
+
+merged_cell_index::merged_cell_index(const merged_cell_index &other)
+    : ranges_(other.ranges_), bounds_(other.bounds_), built_(false), root_(no_node)
+{
+}
+
+merged_cell_index &merged_cell_index::operator=(const merged_cell_index &other)
+{
+    ranges_ = other.ranges_;
+    bounds_ = other.bounds_;
+    built_ = false;
+
+    return *this;
+}
+
+merged_cell_index::bounds merged_cell_index::make_bounds(const range_reference &range)
+{
+    auto top_left = range.get_top_left();
+    auto bottom_right = range.get_bottom_right();
+
+    bounds result;
+    result.left = std::min(top_left.get_column_index(), bottom_right.get_column_index());
+    result.right = std::max(top_left.get_column_index(), bottom_right.get_column_index());
+    result.top = std::min(top_left.get_row_index(), bottom_right.get_row_index());
+    result.bottom = std::max(top_left.get_row_index(), bottom_right.get_row_index());
+
+    return result;
+}
+
+void merged_cell_index::add(const range_reference &range)
+{
+    ranges_.push_back(range);
+    bounds_.push_back(make_bounds(range));
+    built_ = false;
+}
+
+bool merged_cell_index::remove(const range_reference &range)
+{
+    auto match = std::find(ranges_.begin(), ranges_.end(), range);
+
+    if(match == ranges_.end())
+    {
+        return false;
+    }
+
+    bounds_.erase(bounds_.begin() + (match - ranges_.begin()));
+    ranges_.erase(match);
+    built_ = false;
+
+    return true;
+}
+
+void merged_cell_index::clear()
+{
+    ranges_.clear();
+    bounds_.clear();
+    built_ = false;
+}
+
+bool merged_cell_index::contains(column_t column, row_t row) const
+{
+    return !ranges_.empty() && find(column, row) != no_node;
+}
+
+std::size_t merged_cell_index::find(column_t column, row_t row) const
+{
+    if(!built_.load(std::memory_order_acquire))
+    {
+        std::lock_guard<std::mutex> lock(build_mutex_);
+
+        if(!built_.load(std::memory_order_relaxed))
+        {
+            build();
+            built_.store(true, std::memory_order_release);
+        }
+    }
+
+    auto covers_column = [&](std::size_t index)
+    {
+        return bounds_[index].left <= column && column <= bounds_[index].right;
+    };
+
+    auto current = root_;
+
+    while(current != no_node)
+    {
+        const node &n = nodes_[current];
+        auto first = n.first;
+        auto last = n.first + n.count;
+
+        if(row < n.center)
+        {
+            // every range here ends at or below center, so it contains row if it starts above it
+            for(auto i = first; i < last && bounds_[by_top_[i]].top <= row; i++)
+            {
+                if(covers_column(by_top_[i]))
+                {
+                    return by_top_[i];
+                }
+            }
+
+            current = n.left;
+        }
+        else if(row > n.center)
+        {
+            for(auto i = first; i < last && bounds_[by_bottom_[i]].bottom >= row; i++)
+            {
+                if(covers_column(by_bottom_[i]))
+                {
+                    return by_bottom_[i];
+                }
+            }
+
+            current = n.right;
+        }
+        else
+        {
+            for(auto i = first; i < last; i++)
+            {
+                if(covers_column(by_top_[i]))
+                {
+                    return by_top_[i];
+                }
+            }
+
+            break;
+        }
+    }
+
+    return no_node;
+}
+
+void merged_cell_index::build() const
+{
+    nodes_.clear();
+    by_top_.clear();
+    by_bottom_.clear();
+
+    std::vector<std::size_t> items(ranges_.size());
+
+    for(std::size_t i = 0; i < items.size(); i++)
+    {
+        items[i] = i;
+    }
+
+    root_ = build_node(items);
+}
+
+std::size_t merged_cell_index::build_node(std::vector<std::size_t> &items) const
+{
+    if(items.empty())
+    {
+        return no_node;
+    }
+
+    // The median top row is the top of at least one range, so every node keeps
+    // a range and each side gets at most half of the rest.
+    auto median = items.begin() + items.size() / 2;
+    std::nth_element(items.begin(), median, items.end(), [this](std::size_t a, std::size_t b)
+    {
+        return bounds_[a].top < bounds_[b].top;
+    });
+
+    node result;
+    result.center = bounds_[*median].top;
+    result.first = by_top_.size();
+
+    std::vector<std::size_t> left, right;
+
+    for(auto index : items)
+    {
+        if(bounds_[index].bottom < result.center)
+        {
+            left.push_back(index);
+        }
+        else if(bounds_[index].top > result.center)
+        {
+            right.push_back(index);
+        }
+        else
+        {
+            by_top_.push_back(index);
+        }
+    }
+
+    result.count = by_top_.size() - result.first;
+    by_bottom_.insert(by_bottom_.end(), by_top_.begin() + result.first, by_top_.end());
+
+    std::sort(by_top_.begin() + result.first, by_top_.end(), [this](std::size_t a, std::size_t b)
+    {
+        return bounds_[a].top < bounds_[b].top;
+    });
+    std::sort(by_bottom_.begin() + result.first, by_bottom_.end(), [this](std::size_t a, std::size_t b)
+    {
+        return bounds_[a].bottom > bounds_[b].bottom;
+    });
+
+    items.clear();
+    items.shrink_to_fit();
+
+    result.left = build_node(left);
+    result.right = build_node(right);
+
+    nodes_.push_back(result);
+
+    return nodes_.size() - 1;
+}
+
+} // namespace detail
+} // namespace xlnt
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include <xlnt/common/types.hpp>
+#include <xlnt/worksheet/range_reference.hpp>
+
+namespace xlnt {
+namespace detail {
+
+/// <summary>
+/// The merged ranges of a sheet, kept in the order they were merged (which is
+/// the order they are saved in) and indexed by an interval tree on their rows,
+/// so asking whether a cell is merged costs O(log n) instead of a flag on
+/// every covered cell. The tree is rebuilt on the first query after the ranges
+/// change; queries are safe to make from several threads.
+/// </summary>
+class merged_cell_index
+{
+public:
+    merged_cell_index();
+    merged_cell_index(const merged_cell_index &other);
+    merged_cell_index &operator=(const merged_cell_index &other);
+
+    void add(const range_reference &range);
+
+    /// <summary>
+    /// Remove a range that was added before. Returns false if it wasn't.
+    /// </summary>
+    bool remove(const range_reference &range);
+
+    void clear();
+
+    const std::vector<range_reference> &get_ranges() const
+    {
+        return ranges_;
+    }
+
+    /// <summary>
+    /// Return true if the cell at (column, row) is covered by a merged range.
+    /// </summary>
+    bool contains(column_t column, row_t row) const;
+
+private:
+    struct bounds
+    {
+        column_t left;
+        column_t right;
+        row_t top;
+        row_t bottom;
+    };
+
+    // A node of the tree holds the ranges whose rows contain center. Ranges that
+    // end above it are in the left subtree and ranges starting below it in the right.
+    struct node
+    {
+        row_t center;
+        // this node's ranges are [first, first + count) of by_top_ and by_bottom_
+        std::size_t first;
+        std::size_t count;
+        std::size_t left;
+        std::size_t right;
+    };
+
+    static const std::size_t no_node = static_cast<std::size_t>(-1);
+
+    static bounds make_bounds(const range_reference &range);
+
+    // the first index of a range containing (column, row), or no_node
+    std::size_t find(column_t column, row_t row) const;
+
+    void build() const;
+    std::size_t build_node(std::vector<std::size_t> &items) const;
+
+    std::vector<range_reference> ranges_;
+    // bounds_[i] are the bounds of ranges_[i]
+    std::vector<bounds> bounds_;
+
+    mutable std::mutex build_mutex_;
+    mutable std::atomic<bool> built_;
+    mutable std::vector<node> nodes_;
+    mutable std::size_t root_;
+    // indices into ranges_, grouped by node; by_top_ ascending by top row and
+    // by_bottom_ descending by bottom row within each node
+    mutable std::vector<std::size_t> by_top_;
+    mutable std::vector<std::size_t> by_bottom_;
+};
+
+} // namespace detail
+} // namespace xlnt
@@ -0,0 +1,697 @@
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#include "number_conversion.hpp"
+
+namespace {
+
+bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool is_digit(char c)
+{
+    return static_cast<unsigned char>(c - '0') < 10;
+}
+
+void trim(const char *&first, const char *&last)
+{
+    while(first != last && is_space(*first)) first++;
+    while(last != first && is_space(*(last - 1))) last--;
+}
+
+// Powers of ten that are exactly representable as a double.
+const double ExactPowersOfTen[] =
+{
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+const int MaxExactPowerOfTen = 22;
+const std::uint64_t MaxExactMantissa = std::uint64_t(1) << 53;
+
+// Significant digits kept for the slow path. More than enough to round correctly
+// for anything Excel writes (it never emits more than 17).
+const int MaxSignificantDigits = 64;
+
+// Decimal exponent range that format_double writes without an exponent. Numbers
+// below 1E+21 keep every integer digit, so 15-digit integers stay readable.
+const int MinPlainExponent = -4;
+const int MaxPlainExponent = 21;
+
+// Grisu2 (Loitsch, "Printing Floating-Point Numbers Quickly and Accurately
+// with Integers", PLDI 2010) with the boundary handling from Milo Yip's and
+// nlohmann::json's implementations. The output always round-trips and is the
+// shortest representation for all but a vanishingly small set of inputs.
+
+struct diy_fp
+{
+    diy_fp(std::uint64_t f, int e) : f(f), e(e) {}
+
+    std::uint64_t f;
+    int e;
+};
+
+diy_fp subtract(const diy_fp &x, const diy_fp &y)
+{
+    return diy_fp(x.f - y.f, x.e);
+}
+
+// 64x64->128 bit multiplication keeping the rounded upper half
+diy_fp multiply(const diy_fp &x, const diy_fp &y)
+{
+    const std::uint64_t u_lo = x.f & 0xFFFFFFFFu;
+    const std::uint64_t u_hi = x.f >> 32;
+    const std::uint64_t v_lo = y.f & 0xFFFFFFFFu;
+    const std::uint64_t v_hi = y.f >> 32;
+
+    const std::uint64_t p0 = u_lo * v_lo;
+    const std::uint64_t p1 = u_lo * v_hi;
+    const std::uint64_t p2 = u_hi * v_lo;
+    const std::uint64_t p3 = u_hi * v_hi;
+
+    std::uint64_t q = (p0 >> 32) + (p1 & 0xFFFFFFFFu) + (p2 & 0xFFFFFFFFu);
+    q += std::uint64_t(1) << 31;
+
+    return diy_fp(p3 + (p2 >> 32) + (p1 >> 32) + (q >> 32), x.e + y.e + 64);
+}
+
+diy_fp normalize(diy_fp x)
+{
+    while((x.f >> 63) == 0)
+    {
+        x.f <<= 1;
+        x.e--;
+    }
+
+    return x;
+}
+
+struct cached_power
+{
+    std::uint64_t f;
+    int e;
+    int k;
+};
+
+// Normalized approximations of 10^k for k = -300, -292, ..., 324.
+const cached_power CachedPowers[] =
+{
+    {0xAB70FE17C79AC6CA, -1060, -300},
+    {0xFF77B1FCBEBCDC4F, -1034, -292},
+    {0xBE5691EF416BD60C, -1007, -284},
+    {0x8DD01FAD907FFC3C, -980, -276},
+    {0xD3515C2831559A83, -954, -268},
+    {0x9D71AC8FADA6C9B5, -927, -260},
+    {0xEA9C227723EE8BCB, -901, -252},
+    {0xAECC49914078536D, -874, -244},
+    {0x823C12795DB6CE57, -847, -236},
+    {0xC21094364DFB5637, -821, -228},
+    {0x9096EA6F3848984F, -794, -220},
+    {0xD77485CB25823AC7, -768, -212},
+    {0xA086CFCD97BF97F4, -741, -204},
+    {0xEF340A98172AACE5, -715, -196},
+    {0xB23867FB2A35B28E, -688, -188},
+    {0x84C8D4DFD2C63F3B, -661, -180},
+    {0xC5DD44271AD3CDBA, -635, -172},
+    {0x936B9FCEBB25C996, -608, -164},
+    {0xDBAC6C247D62A584, -582, -156},
+    {0xA3AB66580D5FDAF6, -555, -148},
+    {0xF3E2F893DEC3F126, -529, -140},
+    {0xB5B5ADA8AAFF80B8, -502, -132},
+    {0x87625F056C7C4A8B, -475, -124},
+    {0xC9BCFF6034C13053, -449, -116},
+    {0x964E858C91BA2655, -422, -108},
+    {0xDFF9772470297EBD, -396, -100},
+    {0xA6DFBD9FB8E5B88F, -369, -92},
+    {0xF8A95FCF88747D94, -343, -84},
+    {0xB94470938FA89BCF, -316, -76},
+    {0x8A08F0F8BF0F156B, -289, -68},
+    {0xCDB02555653131B6, -263, -60},
+    {0x993FE2C6D07B7FAC, -236, -52},
+    {0xE45C10C42A2B3B06, -210, -44},
+    {0xAA242499697392D3, -183, -36},
+    {0xFD87B5F28300CA0E, -157, -28},
+    {0xBCE5086492111AEB, -130, -20},
+    {0x8CBCCC096F5088CC, -103, -12},
+    {0xD1B71758E219652C, -77, -4},
+    {0x9C40000000000000, -50, 4},
+    {0xE8D4A51000000000, -24, 12},
+    {0xAD78EBC5AC620000, 3, 20},
+    {0x813F3978F8940984, 30, 28},
+    {0xC097CE7BC90715B3, 56, 36},
+    {0x8F7E32CE7BEA5C70, 83, 44},
+    {0xD5D238A4ABE98068, 109, 52},
+    {0x9F4F2726179A2245, 136, 60},
+    {0xED63A231D4C4FB27, 162, 68},
+    {0xB0DE65388CC8ADA8, 189, 76},
+    {0x83C7088E1AAB65DB, 216, 84},
+    {0xC45D1DF942711D9A, 242, 92},
+    {0x924D692CA61BE758, 269, 100},
+    {0xDA01EE641A708DEA, 295, 108},
+    {0xA26DA3999AEF774A, 322, 116},
+    {0xF209787BB47D6B85, 348, 124},
+    {0xB454E4A179DD1877, 375, 132},
+    {0x865B86925B9BC5C2, 402, 140},
+    {0xC83553C5C8965D3D, 428, 148},
+    {0x952AB45CFA97A0B3, 455, 156},
+    {0xDE469FBD99A05FE3, 481, 164},
+    {0xA59BC234DB398C25, 508, 172},
+    {0xF6C69A72A3989F5C, 534, 180},
+    {0xB7DCBF5354E9BECE, 561, 188},
+    {0x88FCF317F22241E2, 588, 196},
+    {0xCC20CE9BD35C78A5, 614, 204},
+    {0x98165AF37B2153DF, 641, 212},
+    {0xE2A0B5DC971F303A, 667, 220},
+    {0xA8D9D1535CE3B396, 694, 228},
+    {0xFB9B7CD9A4A7443C, 720, 236},
+    {0xBB764C4CA7A44410, 747, 244},
+    {0x8BAB8EEFB6409C1A, 774, 252},
+    {0xD01FEF10A657842C, 800, 260},
+    {0x9B10A4E5E9913129, 827, 268},
+    {0xE7109BFBA19C0C9D, 853, 276},
+    {0xAC2820D9623BF429, 880, 284},
+    {0x80444B5E7AA7CF85, 907, 292},
+    {0xBF21E44003ACDD2D, 933, 300},
+    {0x8E679C2F5E44FF8F, 960, 308},
+    {0xD433179D9C8CB841, 986, 316},
+    {0x9E19DB92B4E31BA9, 1013, 324}
+};
+
+// Keep the scaled exponent in [Alpha, Gamma] so the integral part of the
+// product fits in 32 bits.
+const int Alpha = -60;
+
+const cached_power &cached_power_for_binary_exponent(int e)
+{
+    const int f = Alpha - e - 1;
+    const int k = (f * 78913) / (1 << 18) + (f > 0 ? 1 : 0);
+    const int index = (300 + k + 7) / 8;
+
+    return CachedPowers[index];
+}
+
+int largest_power_of_ten(std::uint32_t n, std::uint32_t &power)
+{
+    static const std::uint32_t Powers[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+
+    int digits = 10;
+
+    while(digits > 1 && n < Powers[digits - 1])
+    {
+        digits--;
+    }
+
+    power = Powers[digits - 1];
+    return digits;
+}
+
+void grisu2_round(char *buffer, int length, std::uint64_t distance, std::uint64_t delta, std::uint64_t rest, std::uint64_t ten_k)
+{
+    while(rest < distance && delta - rest >= ten_k
+        && (rest + ten_k < distance || distance - rest > rest + ten_k - distance))
+    {
+        buffer[length - 1]--;
+        rest += ten_k;
+    }
+}
+
+void grisu2_generate_digits(char *buffer, int &length, int &decimal_exponent, diy_fp low, diy_fp w, diy_fp high)
+{
+    std::uint64_t delta = subtract(high, low).f;
+    std::uint64_t distance = subtract(high, w).f;
+
+    const diy_fp one(std::uint64_t(1) << -high.e, high.e);
+
+    auto p1 = static_cast<std::uint32_t>(high.f >> -one.e);
+    std::uint64_t p2 = high.f & (one.f - 1);
+
+    std::uint32_t power = 0;
+    int n = largest_power_of_ten(p1, power);
+
+    while(n > 0)
+    {
+        buffer[length++] = static_cast<char>('0' + p1 / power);
+        p1 %= power;
+        n--;
+
+        const std::uint64_t rest = (std::uint64_t(p1) << -one.e) + p2;
+
+        if(rest <= delta)
+        {
+            decimal_exponent += n;
+            grisu2_round(buffer, length, distance, delta, rest, std::uint64_t(power) << -one.e);
+            return;
+        }
+
+        power /= 10;
+    }
+
+    int m = 0;
+
+    for(;;)
+    {
+        p2 *= 10;
+        buffer[length++] = static_cast<char>('0' + (p2 >> -one.e));
+        p2 &= one.f - 1;
+        m++;
+
+        delta *= 10;
+        distance *= 10;
+
+        if(p2 <= delta)
+        {
+            break;
+        }
+    }
+
+    decimal_exponent -= m;
+    grisu2_round(buffer, length, distance, delta, p2, one.f);
+}
+
+// Writes the shortest digit string d such that d * 10^decimal_exponent rounds to value (> 0).
+void grisu2(double value, char *buffer, int &length, int &decimal_exponent)
+{
+    const std::uint64_t HiddenBit = std::uint64_t(1) << 52;
+    const int Bias = 1023 + 52;
+
+    std::uint64_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(double));
+
+    const std::uint64_t biased_exponent = bits >> 52;
+    const std::uint64_t fraction = bits & (HiddenBit - 1);
+
+    diy_fp v = biased_exponent == 0
+        ? diy_fp(fraction, 1 - Bias)
+        : diy_fp(fraction + HiddenBit, static_cast<int>(biased_exponent) - Bias);
+
+    // the gap to the next lower double is halved at powers of two
+    const bool lower_boundary_is_closer = fraction == 0 && biased_exponent > 1;
+
+    diy_fp high = normalize(diy_fp(2 * v.f + 1, v.e - 1));
+    diy_fp low = lower_boundary_is_closer ? diy_fp(4 * v.f - 1, v.e - 2) : diy_fp(2 * v.f - 1, v.e - 1);
+    low = diy_fp(low.f << (low.e - high.e), high.e);
+    v = normalize(v);
+
+    const cached_power &cached = cached_power_for_binary_exponent(high.e);
+    const diy_fp c(cached.f, cached.e);
+
+    const diy_fp w = multiply(v, c);
+    const diy_fp w_low = multiply(low, c);
+    const diy_fp w_high = multiply(high, c);
+
+    // shrink the interval by one ulp on each side to account for the rounding above
+    length = 0;
+    decimal_exponent = -cached.k;
+    grisu2_generate_digits(buffer, length, decimal_exponent, diy_fp(w_low.f + 1, w_low.e), w, diy_fp(w_high.f - 1, w_high.e));
+}
+
+} // namespace
+
+namespace xlnt {
+namespace detail {
+
+bool parse_double(const char *first, const char *last, double &result)
+{
+    trim(first, last);
+
+    if(first == last)
+    {
+        return false;
+    }
+
+    bool negative = false;
+
+    if(*first == '-' || *first == '+')
+    {
+        negative = *first == '-';
+        first++;
+    }
+
+    // Collect significant digits into a fixed buffer for the slow path while
+    // accumulating the first 19 of them into an integer for the fast path.
+    char digits[MaxSignificantDigits + 1];
+    int digit_count = 0;
+    bool truncated = false;
+    std::uint64_t mantissa = 0;
+    int exponent = 0;
+    bool any_digits = false;
+
+    for(; first != last && is_digit(*first); first++)
+    {
+        any_digits = true;
+
+        if(digit_count == 0 && *first == '0')
+        {
+            continue;
+        }
+
+        if(digit_count < MaxSignificantDigits)
+        {
+            digits[digit_count++] = *first;
+            if(digit_count <= 19) mantissa = mantissa * 10 + static_cast<std::uint64_t>(*first - '0');
+            else truncated = true;
+        }
+        else
+        {
+            exponent++;
+            truncated = true;
+        }
+    }
+
+    if(first != last && *first == '.')
+    {
+        first++;
+
+        for(; first != last && is_digit(*first); first++)
+        {
+            any_digits = true;
+
+            if(digit_count == 0 && *first == '0')
+            {
+                exponent--;
+                continue;
+            }
+
+            if(digit_count < MaxSignificantDigits)
+            {
+                digits[digit_count++] = *first;
+                exponent--;
+                if(digit_count <= 19) mantissa = mantissa * 10 + static_cast<std::uint64_t>(*first - '0');
+                else truncated = true;
+            }
+            else
+            {
+                truncated = true;
+            }
+        }
+    }
+
+    if(!any_digits)
+    {
+        return false;
+    }
+
+    if(first != last && (*first == 'e' || *first == 'E'))
+    {
+        first++;
+        bool negative_exponent = false;
+
+        if(first != last && (*first == '-' || *first == '+'))
+        {
+            negative_exponent = *first == '-';
+            first++;
+        }
+
+        if(first == last || !is_digit(*first))
+        {
+            return false;
+        }
+
+        int explicit_exponent = 0;
+
+        for(; first != last && is_digit(*first); first++)
+        {
+            // saturate rather than overflow; the result underflows to 0 or overflows either way
+            if(explicit_exponent < 100000)
+            {
+                explicit_exponent = explicit_exponent * 10 + (*first - '0');
+            }
+        }
+
+        exponent += negative_exponent ? -explicit_exponent : explicit_exponent;
+    }
+
+    if(first != last)
+    {
+        return false;
+    }
+
+    if(digit_count == 0)
+    {
+        result = negative ? -0.0 : 0.0;
+        return true;
+    }
+
+    // Clinger's fast path: both operands are exact so one IEEE operation rounds correctly.
+    if(!truncated && digit_count <= 19 && mantissa <= MaxExactMantissa
+        && exponent >= -MaxExactPowerOfTen && exponent <= MaxExactPowerOfTen)
+    {
+        double value = static_cast<double>(mantissa);
+        value = exponent < 0 ? value / ExactPowersOfTen[-exponent] : value * ExactPowersOfTen[exponent];
+        result = negative ? -value : value;
+        return true;
+    }
+
+    // Slow path: hand strtod a normalized "<digits>e<exponent>" string. It has no
+    // decimal separator, so the C library's locale can't affect the result.
+    char buffer[MaxSignificantDigits + 16];
+    char *out = buffer;
+
+    if(negative) *out++ = '-';
+    std::memcpy(out, digits, static_cast<std::size_t>(digit_count));
+    out += digit_count;
+    *out++ = 'e';
+
+    unsigned int magnitude = static_cast<unsigned int>(exponent < 0 ? -exponent : exponent);
+    if(exponent < 0) *out++ = '-';
+
+    char exponent_digits[12];
+    int exponent_length = 0;
+
+    do
+    {
+        exponent_digits[exponent_length++] = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    } while(magnitude != 0);
+
+    while(exponent_length > 0)
+    {
+        *out++ = exponent_digits[--exponent_length];
+    }
+
+    *out = '\0';
+
+    double value = std::strtod(buffer, nullptr);
+
+    // out of range, like std::stod; Excel can't read the INF format_double would write
+    if(value > std::numeric_limits<double>::max() || value < -std::numeric_limits<double>::max())
+    {
+        return false;
+    }
+
+    result = value;
+    return true;
+}
+
+bool parse_double(const char *string, double &result)
+{
+    return parse_double(string, string + std::strlen(string), result);
+}
+
+bool parse_int(const char *first, const char *last, int &result)
+{
+    trim(first, last);
+
+    bool negative = false;
+
+    if(first != last && (*first == '-' || *first == '+'))
+    {
+        negative = *first == '-';
+        first++;
+    }
+
+    if(first == last)
+    {
+        return false;
+    }
+
+    // one past INT_MAX is allowed for negative numbers so INT_MIN round-trips
+    const long long limit = negative ? 2147483648LL : 2147483647LL;
+    long long value = 0;
+
+    for(; first != last; first++)
+    {
+        if(!is_digit(*first))
+        {
+            return false;
+        }
+
+        value = value * 10 + (*first - '0');
+
+        if(value > limit)
+        {
+            return false;
+        }
+    }
+
+    result = static_cast<int>(negative ? -value : value);
+    return true;
+}
+
+bool parse_int(const char *string, int &result)
+{
+    return parse_int(string, string + std::strlen(string), result);
+}
+
+bool parse_bool(const char *string, bool &result)
+{
+    const char *first = string;
+    const char *last = string + std::strlen(string);
+    trim(first, last);
+
+    auto length = static_cast<std::size_t>(last - first);
+
+    if(length == 1 && (*first == '0' || *first == '1'))
+    {
+        result = *first == '1';
+        return true;
+    }
+
+    if(length == 4 && std::strncmp(first, "true", 4) == 0)
+    {
+        result = true;
+        return true;
+    }
+
+    if(length == 5 && std::strncmp(first, "false", 5) == 0)
+    {
+        result = false;
+        return true;
+    }
+
+    return false;
+}
+
+std::size_t format_double(double value, char *buffer)
+{
+    char *out = buffer;
+
+    if(value != value)
+    {
+        std::memcpy(out, "NaN", 4);
+        return 3;
+    }
+
+    if(value < 0)
+    {
+        *out++ = '-';
+        value = -value;
+    }
+
+    if(value > std::numeric_limits<double>::max())
+    {
+        std::memcpy(out, "INF", 4);
+        return static_cast<std::size_t>(out - buffer) + 3;
+    }
+
+    if(value == 0)
+    {
+        // Excel has no negative zero
+        buffer[0] = '0';
+        buffer[1] = '\0';
+        return 1;
+    }
+
+    int length = 0;
+    int decimal_exponent = 0;
+    grisu2(value, out, length, decimal_exponent);
+
+    // value = digits * 10^(point - length)
+    const int point = length + decimal_exponent;
+
+    if(length <= point && point <= MaxPlainExponent)
+    {
+        // digits followed by zeros: 12300
+        std::memset(out + length, '0', static_cast<std::size_t>(point - length));
+        out += point;
+    }
+    else if(0 < point && point <= MaxPlainExponent)
+    {
+        // decimal point inside the digits: 12.3
+        std::memmove(out + point + 1, out + point, static_cast<std::size_t>(length - point));
+        out[point] = '.';
+        out += length + 1;
+    }
+    else if(MinPlainExponent < point && point <= 0)
+    {
+        // leading zeros: 0.00123
+        std::memmove(out + 2 - point, out, static_cast<std::size_t>(length));
+        out[0] = '0';
+        out[1] = '.';
+        std::memset(out + 2, '0', static_cast<std::size_t>(-point));
+        out += 2 - point + length;
+    }
+    else
+    {
+        // scientific, as Excel writes it: 1.23E-7, 1E+21
+        if(length > 1)
+        {
+            std::memmove(out + 2, out + 1, static_cast<std::size_t>(length - 1));
+            out[1] = '.';
+            out += length + 1;
+        }
+        else
+        {
+            out += 1;
+        }
+
+        int exponent = point - 1;
+        *out++ = 'E';
+        *out++ = exponent < 0 ? '-' : '+';
+        exponent = exponent < 0 ? -exponent : exponent;
+
+        if(exponent >= 100)
+        {
+            *out++ = static_cast<char>('0' + exponent / 100);
+            exponent %= 100;
+            *out++ = static_cast<char>('0' + exponent / 10);
+        }
+        else if(exponent >= 10)
+        {
+            *out++ = static_cast<char>('0' + exponent / 10);
+        }
+
+        *out++ = static_cast<char>('0' + exponent % 10);
+    }
+
+    *out = '\0';
+    return static_cast<std::size_t>(out - buffer);
+}
+
+std::size_t format_integer(std::int64_t value, char *buffer)
+{
+    char *out = buffer;
+    // negated as unsigned so that the minimum int64 doesn't overflow
+    auto magnitude = static_cast<std::uint64_t>(value);
+
+    if(value < 0)
+    {
+        *out++ = '-';
+        magnitude = 0 - magnitude;
+    }
+
+    char digits[20];
+    int length = 0;
+
+    do
+    {
+        digits[length++] = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    }
+    while(magnitude != 0);
+
+    while(length > 0)
+    {
+        *out++ = digits[--length];
+    }
+
+    *out = '\0';
+    return static_cast<std::size_t>(out - buffer);
+}
+
+} // namespace detail
+} // namespace xlnt
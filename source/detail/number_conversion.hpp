@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace xlnt {
+namespace detail {
+
+/// <summary>
+/// Parse the decimal number in [first, last) as a double.
+/// </summary>
+/// <remarks>
+/// The whole range (ignoring surrounding whitespace) must be consumed for the
+/// parse to succeed, and like std::stod it fails when the value is too large
+/// for a double. Unlike std::stod, this never throws, never allocates and
+/// always uses '.' as the decimal separator regardless of the global locale.
+/// </remarks>
+bool parse_double(const char *first, const char *last, double &result);
+bool parse_double(const char *string, double &result);
+
+/// <summary>
+/// Parse the decimal integer in [first, last). Fails on trailing garbage or overflow.
+/// </summary>
+bool parse_int(const char *first, const char *last, int &result);
+bool parse_int(const char *string, int &result);
+
+/// <summary>
+/// Parse an xsd:boolean ("1", "0", "true" or "false").
+/// </summary>
+bool parse_bool(const char *string, bool &result);
+
+/// <summary>
+/// Buffer size that is always large enough for format_double and format_integer, including the terminator.
+/// </summary>
+const std::size_t MaxDoubleLength = 32;
+
+/// <summary>
+/// Write a decimal string that reads back as exactly value into buffer and
+/// null-terminate it. The string is the shortest such string for almost all inputs. Returns the number of characters written.
+/// </summary>
+/// <remarks>
+/// buffer must hold at least MaxDoubleLength characters. Nothing is allocated and
+/// the output does not depend on the current locale.
+/// </remarks>
+std::size_t format_double(double value, char *buffer);
+
+/// <summary>
+/// Write value in decimal into buffer and null-terminate it. Returns the number of characters written.
+/// </summary>
+/// <remarks>
+/// Used for integral cell values, which may be beyond 2^53 where a double
+/// can no longer hold them exactly.
+/// </remarks>
+std::size_t format_integer(std::int64_t value, char *buffer);
+
+} // namespace detail
+} // namespace xlnt
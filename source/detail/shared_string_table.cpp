@@ -0,0 +1,592 @@
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include "detail/number_conversion.hpp"
+#include "detail/shared_string_table.hpp"
+
+namespace {
+
+bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+bool starts_with(const char *first, const char *last, const char *prefix)
+{
+    auto length = std::strlen(prefix);
+    return static_cast<std::size_t>(last - first) >= length && std::memcmp(first, prefix, length) == 0;
+}
+
+// Compares the local part of a possibly prefixed name (e.g. "x:si") in [first, last)
+bool local_name_is(const char *first, const char *last, const char *name)
+{
+    auto colon = static_cast<const char *>(std::memchr(first, ':', static_cast<std::size_t>(last - first)));
+
+    if(colon != nullptr)
+    {
+        first = colon + 1;
+    }
+
+    auto length = std::strlen(name);
+    return static_cast<std::size_t>(last - first) == length && std::memcmp(first, name, length) == 0;
+}
+
+// Finds the '>' that ends a tag, skipping over quoted attribute values, which may contain '>'
+const char *find_tag_end(const char *position, const char *last)
+{
+    char quote = 0;
+
+    for(; position < last; ++position)
+    {
+        if(quote != 0)
+        {
+            if(*position == quote)
+            {
+                quote = 0;
+            }
+        }
+        else if(*position == '"' || *position == '\'')
+        {
+            quote = *position;
+        }
+        else if(*position == '>')
+        {
+            return position;
+        }
+    }
+
+    return nullptr;
+}
+
+// Looks up attribute name among the attributes in [first, last) and returns its raw value
+bool find_attribute(const char *first, const char *last, const char *name, const char *&value_first, const char *&value_last)
+{
+    auto name_length = std::strlen(name);
+
+    while(first < last)
+    {
+        while(first < last && is_space(*first))
+        {
+            ++first;
+        }
+
+        auto attribute_name = first;
+
+        while(first < last && *first != '=' && !is_space(*first))
+        {
+            ++first;
+        }
+
+        auto attribute_name_end = first;
+
+        while(first < last && (is_space(*first) || *first == '='))
+        {
+            ++first;
+        }
+
+        if(first == last || (*first != '"' && *first != '\''))
+        {
+            return false;
+        }
+
+        auto quote = *first++;
+        auto value = first;
+
+        while(first < last && *first != quote)
+        {
+            ++first;
+        }
+
+        if(static_cast<std::size_t>(attribute_name_end - attribute_name) == name_length
+            && std::memcmp(attribute_name, name, name_length) == 0)
+        {
+            value_first = value;
+            value_last = first;
+            return true;
+        }
+
+        ++first;
+    }
+
+    return false;
+}
+
+void append_utf8(std::string &out, unsigned long code_point)
+{
+    if(code_point < 0x80)
+    {
+        out.push_back(static_cast<char>(code_point));
+    }
+    else if(code_point < 0x800)
+    {
+        out.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+        out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+    else if(code_point < 0x10000)
+    {
+        out.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+    else
+    {
+        out.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+}
+
+// Decodes the entity starting at first ('&'). Returns the position after the
+// ';', or first if it isn't an entity we know, in which case it is kept as text
+// like pugixml does.
+const char *append_entity(std::string &out, const char *first, const char *last)
+{
+    static const struct
+    {
+        const char *name;
+        char character;
+    } Named[] = {{"&lt;", '<'}, {"&gt;", '>'}, {"&amp;", '&'}, {"&quot;", '"'}, {"&apos;", '\''}};
+
+    for(const auto &entity : Named)
+    {
+        if(starts_with(first, last, entity.name))
+        {
+            out.push_back(entity.character);
+            return first + std::strlen(entity.name);
+        }
+    }
+
+    if(!starts_with(first, last, "&#"))
+    {
+        return first;
+    }
+
+    auto position = first + 2;
+    bool hex = position < last && *position == 'x';
+    position += hex ? 1 : 0;
+    unsigned long code_point = 0;
+    auto digits = position;
+
+    for(; position < last && *position != ';'; ++position)
+    {
+        auto c = *position;
+        unsigned long digit = 0;
+
+        if(c >= '0' && c <= '9')
+        {
+            digit = static_cast<unsigned long>(c - '0');
+        }
+        else if(hex && c >= 'a' && c <= 'f')
+        {
+            digit = static_cast<unsigned long>(c - 'a' + 10);
+        }
+        else if(hex && c >= 'A' && c <= 'F')
+        {
+            digit = static_cast<unsigned long>(c - 'A' + 10);
+        }
+        else
+        {
+            return first;
+        }
+
+        code_point = code_point * (hex ? 16 : 10) + digit;
+
+        if(code_point > 0x10FFFF)
+        {
+            return first;
+        }
+    }
+
+    if(position == last || position == digits)
+    {
+        return first;
+    }
+
+    append_utf8(out, code_point);
+    return position + 1;
+}
+
+} // namespace
+
+namespace xlnt {
+namespace detail {
+
+// Single pass over the sst part without building a DOM. Only what shared strings
+// use is understood: elements, attributes, text, entities, CDATA, comments and
+// processing instructions. Text is normalized like pugixml's default options
+// (CR LF and lone CR become LF, entities are expanded).
+class sst_parser
+{
+public:
+    sst_parser(shared_string_table &table, const char *xml, std::size_t length)
+        : table_(table), first_(xml), position_(xml), last_(xml + length), length_(length), entries_(nullptr)
+    {
+    }
+
+    /// <summary>
+    /// Instead of decoding, record the offset of each si element in entries.
+    /// </summary>
+    void index_into(std::vector<std::size_t> &entries)
+    {
+        entries_ = &entries;
+    }
+
+    void parse()
+    {
+        bool in_si = false;
+        bool in_t = false;
+        std::size_t phonetic_depth = 0;
+        long expected_count = -1;
+
+        while(position_ < last_)
+        {
+            auto tag = static_cast<const char *>(std::memchr(position_, '<', static_cast<std::size_t>(last_ - position_)));
+
+            if(tag == nullptr)
+            {
+                tag = last_;
+            }
+
+            if(in_t)
+            {
+                append_text(position_, tag);
+            }
+
+            if(tag == last_)
+            {
+                break;
+            }
+
+            position_ = tag + 1;
+
+            if(starts_with(position_, last_, "?"))
+            {
+                skip_past("?>");
+                continue;
+            }
+
+            if(starts_with(position_, last_, "!--"))
+            {
+                skip_past("-->");
+                continue;
+            }
+
+            if(starts_with(position_, last_, "![CDATA["))
+            {
+                position_ += 8;
+                auto data = position_;
+                skip_past("]]>");
+
+                if(in_t)
+                {
+                    append_raw(data, position_ - 3);
+                }
+
+                continue;
+            }
+
+            if(starts_with(position_, last_, "!"))
+            {
+                skip_past(">");
+                continue;
+            }
+
+            bool closing = *position_ == '/';
+            position_ += closing ? 1 : 0;
+
+            auto name = position_;
+
+            while(position_ < last_ && !is_space(*position_) && *position_ != '>' && *position_ != '/')
+            {
+                ++position_;
+            }
+
+            auto name_end = position_;
+            auto tag_end = find_tag_end(position_, last_);
+
+            if(tag_end == nullptr)
+            {
+                throw std::runtime_error("malformed shared strings");
+            }
+
+            bool empty = !closing && tag_end[-1] == '/';
+            auto attributes_end = empty ? tag_end - 1 : tag_end;
+            position_ = tag_end + 1;
+
+            if(closing)
+            {
+                if(local_name_is(name, name_end, "t"))
+                {
+                    in_t = false;
+                }
+                else if(local_name_is(name, name_end, "rPh") && phonetic_depth > 0)
+                {
+                    --phonetic_depth;
+                }
+                else if(local_name_is(name, name_end, "si") && in_si)
+                {
+                    finish_string();
+                    in_si = false;
+                    in_t = false;
+                    phonetic_depth = 0;
+                }
+            }
+            else if(in_si)
+            {
+                if(local_name_is(name, name_end, "rPh"))
+                {
+                    phonetic_depth += empty ? 0 : 1;
+                }
+                else if(local_name_is(name, name_end, "t"))
+                {
+                    in_t = !empty && phonetic_depth == 0;
+                }
+            }
+            else if(local_name_is(name, name_end, "si"))
+            {
+                if(entries_ != nullptr)
+                {
+                    entries_->push_back(static_cast<std::size_t>(tag - first_));
+                }
+                else if(empty)
+                {
+                    finish_string();
+                }
+                else
+                {
+                    in_si = true;
+                }
+            }
+            else if(local_name_is(name, name_end, "sst"))
+            {
+                expected_count = read_count(name_end, attributes_end);
+            }
+        }
+
+        if(in_si)
+        {
+            throw std::runtime_error("malformed shared strings");
+        }
+
+        auto count = entries_ != nullptr ? entries_->size() : table_.size();
+
+        if(expected_count >= 0 && static_cast<std::size_t>(expected_count) != count)
+        {
+            throw std::runtime_error("counts don't match");
+        }
+    }
+
+private:
+    long read_count(const char *first, const char *last)
+    {
+        const char *value = nullptr;
+        const char *value_end = nullptr;
+
+        // count is a workaround for WPS Office, which doesn't write uniqueCount
+        if(!find_attribute(first, last, "uniqueCount", value, value_end)
+            && !find_attribute(first, last, "count", value, value_end))
+        {
+            return -1;
+        }
+
+        int count = 0;
+
+        if(!parse_int(value, value_end, count) || count < 0)
+        {
+            throw std::runtime_error("malformed shared strings");
+        }
+
+        // every entry takes at least "<si></si>" plus its terminator in the table,
+        // so this bounds the buffer without overcommitting much
+        auto count_size = static_cast<std::size_t>(count);
+
+        if(entries_ != nullptr)
+        {
+            entries_->reserve(count_size + 1);
+        }
+        else
+        {
+            table_.offsets_.reserve(count_size + 1);
+        }
+
+        if(entries_ == nullptr && length_ > count_size * 8)
+        {
+            table_.characters_.reserve(length_ - count_size * 8);
+        }
+
+        return count;
+    }
+
+    void skip_past(const char *terminator)
+    {
+        auto length = std::strlen(terminator);
+
+        while(position_ < last_ && !starts_with(position_, last_, terminator))
+        {
+            ++position_;
+        }
+
+        if(position_ == last_)
+        {
+            throw std::runtime_error("malformed shared strings");
+        }
+
+        position_ += length;
+    }
+
+    void append_text(const char *first, const char *last)
+    {
+        auto &out = table_.characters_;
+
+        while(first < last)
+        {
+            auto run = first;
+
+            while(first < last && *first != '&' && *first != '\r')
+            {
+                ++first;
+            }
+
+            out.append(run, static_cast<std::size_t>(first - run));
+
+            if(first == last)
+            {
+                break;
+            }
+
+            if(*first == '\r')
+            {
+                out.push_back('\n');
+                ++first;
+                first += (first < last && *first == '\n') ? 1 : 0;
+                continue;
+            }
+
+            auto next = append_entity(out, first, last);
+
+            if(next == first)
+            {
+                out.push_back('&');
+                ++next;
+            }
+
+            first = next;
+        }
+    }
+
+    void append_raw(const char *first, const char *last)
+    {
+        auto &out = table_.characters_;
+
+        for(; first < last; ++first)
+        {
+            if(*first != '\r')
+            {
+                out.push_back(*first);
+            }
+            else if(first + 1 == last || first[1] != '\n')
+            {
+                out.push_back('\n');
+            }
+        }
+    }
+
+    void finish_string()
+    {
+        table_.characters_.push_back('\0');
+        table_.offsets_.push_back(table_.characters_.size());
+    }
+
+    shared_string_table &table_;
+    const char *first_;
+    const char *position_;
+    const char *last_;
+    std::size_t length_;
+    std::vector<std::size_t> *entries_;
+};
+
+shared_string_table::shared_string_table() : offsets_(1, 0)
+{
+}
+
+void shared_string_table::load(const char *xml, std::size_t length)
+{
+    clear();
+    sst_parser(*this, xml, length).parse();
+}
+
+void shared_string_table::add(const char *data, std::size_t length)
+{
+    characters_.append(data, length);
+    characters_.push_back('\0');
+    offsets_.push_back(characters_.size());
+}
+
+void shared_string_table::clear()
+{
+    characters_.clear();
+    offsets_.assign(1, 0);
+}
+
+std::string shared_string_table::at(std::size_t index) const
+{
+    if(index >= size())
+    {
+        throw std::out_of_range("shared string index out of range");
+    }
+
+    return std::string(data(index), length(index));
+}
+
+namespace {
+
+const std::size_t NotDecoded = static_cast<std::size_t>(-1);
+
+} // namespace
+
+lazy_shared_string_table::lazy_shared_string_table() : entries_(1, 0)
+{
+}
+
+void lazy_shared_string_table::load(std::string &&xml)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::vector<std::size_t> entries;
+    shared_string_table unused;
+    sst_parser parser(unused, xml.data(), xml.size());
+    parser.index_into(entries);
+    parser.parse();
+    entries.push_back(xml.size());
+
+    xml_ = std::move(xml);
+    entries_.swap(entries);
+    decoded_.assign(entries_.size() - 1, NotDecoded);
+    decoded_strings_.clear();
+}
+
+std::string lazy_shared_string_table::get(std::size_t index)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if(index >= decoded_.size())
+    {
+        throw std::out_of_range("shared string index out of range");
+    }
+
+    if(decoded_[index] == NotDecoded)
+    {
+        // the entry runs up to the next si; anything after its end tag is ignored
+        auto first = entries_[index];
+        sst_parser(decoded_strings_, xml_.data() + first, entries_[index + 1] - first).parse();
+        decoded_[index] = decoded_strings_.size() - 1;
+    }
+
+    auto decoded = decoded_[index];
+    return std::string(decoded_strings_.data(decoded), decoded_strings_.length(decoded));
+}
+
+} // namespace detail
+} // namespace xlnt
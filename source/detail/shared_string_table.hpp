@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace xlnt {
+namespace detail {
+
+/// <summary>
+/// The strings of a shared string table (xl/sharedStrings.xml) stored back to
+/// back in a single buffer. Each string is null-terminated in place, so an entry
+/// is just a pointer and a length into that buffer and loading two million
+/// strings costs a few reallocations instead of two million allocations.
+/// </summary>
+class shared_string_table
+{
+public:
+    shared_string_table();
+
+    /// <summary>
+    /// Replace the contents with the strings of the sst part in [xml, xml + length).
+    /// Rich text runs (r/t) are concatenated and phonetic runs (rPh) are skipped.
+    /// Throws std::runtime_error if the part is malformed or uniqueCount doesn't
+    /// match the number of strings.
+    /// </summary>
+    void load(const char *xml, std::size_t length);
+
+    /// <summary>
+    /// Append one string.
+    /// </summary>
+    void add(const char *data, std::size_t length);
+
+    void clear();
+
+    std::size_t size() const
+    {
+        return offsets_.size() - 1;
+    }
+
+    /// <summary>
+    /// The null-terminated characters of string index. Valid until the table is
+    /// next modified. index must be less than size().
+    /// </summary>
+    const char *data(std::size_t index) const
+    {
+        return characters_.data() + offsets_[index];
+    }
+
+    std::size_t length(std::size_t index) const
+    {
+        // excludes the terminator
+        return offsets_[index + 1] - offsets_[index] - 1;
+    }
+
+    /// <summary>
+    /// A copy of string index. Throws std::out_of_range for a bad index.
+    /// </summary>
+    std::string at(std::size_t index) const;
+
+private:
+    friend class sst_parser;
+
+    // all strings, each followed by '\0'
+    std::string characters_;
+    // offsets_[i] is where string i starts; the last entry is the end of the buffer
+    std::vector<std::size_t> offsets_;
+};
+
+/// <summary>
+/// Shared strings that are only decoded when they are asked for. load() keeps
+/// the part and makes one pass over it to record where each si element starts;
+/// get() decodes an entry the first time it is requested and caches it. Meant
+/// for huge string tables of which only a few entries are ever read. Safe to
+/// use from several threads.
+/// </summary>
+class lazy_shared_string_table
+{
+public:
+    lazy_shared_string_table();
+
+    /// <summary>
+    /// Index the sst part in xml, which is kept until the table is destroyed.
+    /// Throws std::runtime_error like shared_string_table::load.
+    /// </summary>
+    void load(std::string &&xml);
+
+    std::size_t size() const
+    {
+        return entries_.size() - 1;
+    }
+
+    /// <summary>
+    /// A copy of string index. Throws std::out_of_range for a bad index.
+    /// </summary>
+    std::string get(std::size_t index);
+
+private:
+    lazy_shared_string_table(const lazy_shared_string_table &);
+    lazy_shared_string_table &operator=(const lazy_shared_string_table &);
+
+    std::string xml_;
+    // entries_[i] is the offset of string i's si element in xml_; the last entry is xml_.size()
+    std::vector<std::size_t> entries_;
+    // index into decoded_strings_ of each entry decoded so far
+    std::vector<std::size_t> decoded_;
+    shared_string_table decoded_strings_;
+    std::mutex mutex_;
+};
+
+} // namespace detail
+} // namespace xlnt
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <xlnt/common/relationship.hpp>
+#include <xlnt/drawing/drawing.hpp>
+#include <xlnt/workbook/document_properties.hpp>
+
+#include "worksheet_impl.hpp"
+
+namespace xlnt {
+namespace detail {
+
+/// <summary>
+/// One worksheet of a snapshot. Until the workbook writes to the sheet, source_
+/// is the workbook's own worksheet_impl; the first write copies it into copy_.
+/// mutex_ orders that copy against snapshot readers on other threads, which
+/// hold it for as long as they read source_.
+/// </summary>
+struct sheet_slot
+{
+    explicit sheet_slot(const std::shared_ptr<worksheet_impl> &source) : source_(source)
+    {
+    }
+
+    void detach()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if(!copy_)
+        {
+            copy_.reset(new worksheet_impl(*source_));
+        }
+    }
+
+    std::shared_ptr<worksheet_impl> copy_sheet()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return std::make_shared<worksheet_impl>(copy_ ? *copy_ : *source_);
+    }
+
+    std::mutex mutex_;
+    // kept even after detaching so a sheet removed from the workbook outlives its last write
+    std::shared_ptr<worksheet_impl> source_;
+    std::unique_ptr<worksheet_impl> copy_;
+};
+
+struct snapshot_impl
+{
+    std::vector<std::shared_ptr<sheet_slot>> sheets_;
+    std::vector<std::string> titles_;
+    int active_sheet_index_;
+    std::vector<relationship> relationships_;
+    std::vector<drawing> drawings_;
+    document_properties properties_;
+    bool guess_types_;
+    bool data_only_;
+    bool lazy_shared_strings_;
+    bool calculate_on_save_;
+    // what workbook::save needs to copy parts that haven't changed from the loaded file
+    std::shared_ptr<zip_file> source_archive_;
+    std::shared_ptr<xf_table> source_xfs_;
+};
+
+} // namespace detail
+} // namespace xlnt
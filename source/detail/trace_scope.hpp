@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include <xlnt/config.hpp>
+
+namespace xlnt {
+namespace detail {
+
+// set while xlnt::trace is recording; read inline so a span costs only this
+// load while recording is off
+extern std::atomic<bool> TraceRecording;
+
+inline bool trace_recording()
+{
+    return TraceRecording.load(std::memory_order_relaxed);
+}
+
+std::int64_t trace_now();
+
+// Adds a span that started at start (from trace_now) and ends now; label is
+// moved from
+void trace_record(const char *name, const char *category, std::string &label, std::int64_t start);
+
+/// <summary>
+/// Records a span from construction to destruction while xlnt::trace is recording.
+/// name and category must be string literals. label (a part or sheet name) is
+/// only copied when recording.
+/// </summary>
+template<bool Enabled>
+class basic_trace_scope
+{
+public:
+    basic_trace_scope(const char *name, const char *category)
+        : recording_(trace_recording()), name_(name), category_(category), start_(recording_ ? trace_now() : 0)
+    {
+    }
+
+    basic_trace_scope(const char *name, const char *category, const std::string &label)
+        : recording_(trace_recording()), name_(name), category_(category), start_(0)
+    {
+        if(recording_)
+        {
+            label_ = label;
+            start_ = trace_now();
+        }
+    }
+
+    ~basic_trace_scope()
+    {
+        if(recording_)
+        {
+            trace_record(name_, category_, label_, start_);
+        }
+    }
+
+private:
+    basic_trace_scope(const basic_trace_scope &);
+    basic_trace_scope &operator=(const basic_trace_scope &);
+
+    bool recording_;
+    const char *name_;
+    const char *category_;
+    std::string label_;
+    std::int64_t start_;
+};
+
+/// <summary>
+/// With TracingEnabled false, spans are empty objects that compile to nothing.
+/// </summary>
+template<>
+class basic_trace_scope<false>
+{
+public:
+    basic_trace_scope(const char *, const char *)
+    {
+    }
+
+    basic_trace_scope(const char *, const char *, const std::string &)
+    {
+    }
+
+private:
+    basic_trace_scope(const basic_trace_scope &);
+    basic_trace_scope &operator=(const basic_trace_scope &);
+};
+
+typedef basic_trace_scope<TracingEnabled> trace_scope;
+
+} // namespace detail
+} // namespace xlnt
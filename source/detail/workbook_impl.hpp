@@ -1,20 +1,29 @@
 #pragma once
 
 #include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "formula_engine.hpp"
+#include "worksheet_impl.hpp"
+
 namespace xlnt {
 namespace detail {
 
+typedef std::lock_guard<std::recursive_mutex> structure_lock;
+
 struct workbook_impl
 {
     workbook_impl();
 
     workbook_impl &operator=(const workbook_impl &other)
     {
+        structure_lock lock(other.structure_mutex_);
         active_sheet_index_ = other.active_sheet_index_;
-        worksheets_.clear();
-        std::copy(other.worksheets_.begin(), other.worksheets_.end(), back_inserter(worksheets_));
+        copy_worksheets(other);
         relationships_.clear();
         std::copy(other.relationships_.begin(), other.relationships_.end(), std::back_inserter(relationships_));
         drawings_.clear();
@@ -22,30 +31,103 @@ struct workbook_impl
         properties_ = other.properties_;
         guess_types_ = other.guess_types_;
         data_only_ = other.data_only_;
+        lazy_shared_strings_ = other.lazy_shared_strings_;
+        calculate_on_save_ = other.calculate_on_save_;
+        read_only_ = false;
+        source_archive_ = other.source_archive_;
+        source_xfs_ = other.source_xfs_;
+        formulas_ = other.formulas_;
+        rebuild_indexes();
         return *this;
     }
 
     workbook_impl(const workbook_impl &other) 
         : active_sheet_index_(other.active_sheet_index_),
-        worksheets_(other.worksheets_), 
         relationships_(other.relationships_), 
         drawings_(other.drawings_), 
         properties_(other.properties_), 
         guess_types_(other.guess_types_),
-        data_only_(other.data_only_)
+        data_only_(other.data_only_),
+        lazy_shared_strings_(other.lazy_shared_strings_),
+        calculate_on_save_(other.calculate_on_save_),
+        read_only_(false),
+        source_archive_(other.source_archive_),
+        source_xfs_(other.source_xfs_),
+        formulas_(other.formulas_)
     {
-        
+        structure_lock lock(other.structure_mutex_);
+        copy_worksheets(other);
+        rebuild_indexes();
     }
 
+    void copy_worksheets(const workbook_impl &other)
+    {
+        worksheets_.clear();
+        worksheets_.reserve(other.worksheets_.size());
+
+        for(const auto &ws : other.worksheets_)
+        {
+            worksheets_.emplace_back(new worksheet_impl(*ws));
+        }
+    }
+
+    // The lookup tables below are kept in step with worksheets_, relationships_
+    // and the sheets' titles and named ranges by these functions. Callers hold
+    // structure_mutex_. When several sheets share a title or a name, lookups
+    // find the one indexed first, like the linear searches they replace. Each
+    // of them also invalidates formulas_, since formulas are resolved by name.
+
+    worksheet_impl *find_sheet(const std::string &title) const;
+    void index_sheet(worksheet_impl *ws);
+    void unindex_sheet(worksheet_impl *ws);
+    void rename_sheet(worksheet_impl *ws, const std::string &title);
+
+    worksheet_impl *find_named_range_owner(const std::string &name) const;
+    void index_named_range(const std::string &name, worksheet_impl *ws);
+    void unindex_named_range(const std::string &name, worksheet_impl *ws);
+
+    const relationship *find_relationship(const std::string &id) const;
+    void add_relationship(const relationship &rel);
+
+    /// <summary>
+    /// Recreate every table after worksheets_ or relationships_ were assigned wholesale.
+    /// </summary>
+    void rebuild_indexes();
+
     //bool guess_types_;
     //bool data_only_;
     int active_sheet_index_;
-    std::vector<worksheet_impl> worksheets_;
+    // each sheet is allocated separately so worksheet handles stay valid,
+    // adding, removing or reordering sheets never copies cells and snapshots
+    // can share sheets with the workbook
+    std::vector<std::shared_ptr<worksheet_impl>> worksheets_;
     std::vector<relationship> relationships_;
     std::vector<drawing> drawings_;
     document_properties properties_;
     bool guess_types_;
     bool data_only_;
+    bool lazy_shared_strings_;
+    bool calculate_on_save_;
+    // copies always start out writable
+    bool read_only_;
+    // the file the workbook was loaded from, kept so that save can copy the
+    // parts of sheets that haven't changed instead of writing them again
+    std::shared_ptr<zip_file> source_archive_;
+    // the cell formats of the source's styles.xml; sheets that are serialized
+    // again while it is copied refer to these by index
+    std::shared_ptr<xf_table> source_xfs_;
+    // guards worksheets_, relationships_ and sheet titles so sheets can be
+    // created and looked up while other threads are filling in their cells
+    mutable std::recursive_mutex structure_mutex_;
+    std::unordered_map<std::string, worksheet_impl *> sheet_titles_;
+    // "SheetN" is taken for every N below this, so create_sheet() starts there
+    int first_free_sheet_number_;
+    // defined name -> sheet whose named_ranges_ holds it
+    std::unordered_map<std::string, worksheet_impl *> named_range_owners_;
+    // id -> index into relationships_
+    std::unordered_map<std::string, std::size_t> relationship_ids_;
+    // dependency graph of the formulas in worksheets_, used by workbook::calculate
+    formula_engine formulas_;
 };
 
 } // namespace detail
@@ -0,0 +1,246 @@
+#include <algorithm>
+
+#include "detail/worker_pool.hpp"
+
+namespace {
+
+const std::size_t MaxBatch = 0xffffffff;
+
+std::uint64_t pack(std::uint64_t first, std::uint64_t last)
+{
+    return (first << 32) | last;
+}
+
+std::size_t first_of(std::uint64_t range)
+{
+    return static_cast<std::size_t>(range >> 32);
+}
+
+std::size_t last_of(std::uint64_t range)
+{
+    return static_cast<std::size_t>(range & 0xffffffff);
+}
+
+} // namespace
+
+namespace xlnt {
+namespace detail {
+
+worker_pool::worker_pool(std::size_t threads)
+    : shares_(new share[std::max<std::size_t>(threads, 1)]),
+      task_(nullptr),
+      generation_(0),
+      running_(0),
+      stopping_(false)
+{
+    for(std::size_t i = 0; i < std::max<std::size_t>(threads, 1); i++)
+    {
+        shares_[i].range.store(0);
+    }
+
+    for(std::size_t i = 1; i < threads; i++)
+    {
+        threads_.emplace_back(&worker_pool::worker_main, this, i);
+    }
+}
+
+worker_pool::~worker_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+
+    start_.notify_all();
+
+    for(auto &thread : threads_)
+    {
+        thread.join();
+    }
+}
+
+void worker_pool::run(std::size_t count, const std::function<void(std::size_t)> &task)
+{
+    if(threads_.empty() || count < 2)
+    {
+        for(std::size_t i = 0; i < count; i++)
+        {
+            task(i);
+        }
+
+        return;
+    }
+
+    // shares are 32-bit ranges, which no realistic caller exceeds
+    for(std::size_t offset = 0; offset < count; offset += MaxBatch)
+    {
+        auto batch = std::min(count - offset, MaxBatch);
+        std::function<void(std::size_t)> shifted;
+
+        if(offset != 0)
+        {
+            shifted = [&task, offset](std::size_t i) { task(offset + i); };
+        }
+
+        auto participants = size();
+
+        for(std::size_t i = 0; i < participants; i++)
+        {
+            shares_[i].range.store(pack(batch * i / participants, batch * (i + 1) / participants));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            task_ = offset == 0 ? &task : &shifted;
+            error_ = nullptr;
+            running_ = threads_.size();
+            generation_++;
+        }
+
+        start_.notify_all();
+        work(0);
+
+        std::exception_ptr error;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            finished_.wait(lock, [this]() { return running_ == 0; });
+            task_ = nullptr;
+            error = error_;
+        }
+
+        if(error != nullptr)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+bool worker_pool::claim(std::size_t participant, std::size_t &index)
+{
+    auto &range = shares_[participant].range;
+    auto current = range.load();
+
+    for(;;)
+    {
+        auto first = first_of(current);
+        auto last = last_of(current);
+
+        if(first >= last)
+        {
+            return false;
+        }
+
+        if(range.compare_exchange_weak(current, pack(first + 1, last)))
+        {
+            index = first;
+            return true;
+        }
+    }
+}
+
+bool worker_pool::steal(std::size_t participant)
+{
+    for(;;)
+    {
+        // the victim is whoever has the most left
+        std::size_t victim = participant;
+        std::uint64_t victim_range = 0;
+        std::size_t most = 0;
+
+        for(std::size_t i = 0; i < size(); i++)
+        {
+            auto current = shares_[i].range.load();
+            auto left = last_of(current) - std::min(first_of(current), last_of(current));
+
+            if(i != participant && left > most)
+            {
+                victim = i;
+                victim_range = current;
+                most = left;
+            }
+        }
+
+        if(most == 0)
+        {
+            return false;
+        }
+
+        auto first = first_of(victim_range);
+        auto last = last_of(victim_range);
+        auto split = last - (last - first) / 2;
+
+        // a single iteration left is taken whole
+        if(split == last)
+        {
+            split = first;
+        }
+
+        if(shares_[victim].range.compare_exchange_strong(victim_range, pack(first, split)))
+        {
+            // nobody takes from an empty share, so this can't race with other thieves
+            shares_[participant].range.store(pack(split, last));
+            return true;
+        }
+    }
+}
+
+void worker_pool::work(std::size_t participant)
+{
+    std::size_t index = 0;
+
+    do
+    {
+        while(claim(participant, index))
+        {
+            try
+            {
+                (*task_)(index);
+            }
+            catch(...)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+
+                if(error_ == nullptr)
+                {
+                    error_ = std::current_exception();
+                }
+            }
+        }
+    }
+    while(steal(participant));
+}
+
+void worker_pool::worker_main(std::size_t participant)
+{
+    std::uint64_t seen = 0;
+
+    for(;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            start_.wait(lock, [this, seen]() { return stopping_ || generation_ != seen; });
+
+            if(stopping_)
+            {
+                return;
+            }
+
+            seen = generation_;
+        }
+
+        work(participant);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            if(--running_ == 0)
+            {
+                finished_.notify_one();
+            }
+        }
+    }
+}
+
+} // namespace detail
+} // namespace xlnt
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace xlnt {
+namespace detail {
+
+/// <summary>
+/// A fixed set of threads that run the iterations of a loop together with the
+/// calling thread. Every participant starts with an equal share of the
+/// iterations and, once its share is used up, steals the back half of the
+/// largest share left, so iterations of uneven cost still keep all threads busy.
+/// </summary>
+class worker_pool
+{
+public:
+    /// <summary>
+    /// Start threads - 1 threads; the thread calling run is the last participant.
+    /// </summary>
+    explicit worker_pool(std::size_t threads);
+    ~worker_pool();
+
+    /// <summary>
+    /// Number of participants, including the caller of run.
+    /// </summary>
+    std::size_t size() const
+    {
+        return threads_.size() + 1;
+    }
+
+    /// <summary>
+    /// Call task(i) for every i in [0, count) and return once every call has
+    /// returned. The first exception thrown by task is rethrown here after the
+    /// remaining iterations have run. Only one thread may call run at a time.
+    /// </summary>
+    void run(std::size_t count, const std::function<void(std::size_t)> &task);
+
+private:
+    worker_pool(const worker_pool &);
+    worker_pool &operator=(const worker_pool &);
+
+    // The iterations [first, last) left to one participant, packed into one
+    // word as (first << 32) | last so that taking from the front (by the owner)
+    // and from the back (by thieves) are single compare-and-swaps. Padded to a
+    // cache line so participants don't contend for each other's shares.
+    struct share
+    {
+        std::atomic<std::uint64_t> range;
+        char padding[64 - sizeof(std::atomic<std::uint64_t>)];
+    };
+
+    bool claim(std::size_t participant, std::size_t &index);
+    bool steal(std::size_t participant);
+    void work(std::size_t participant);
+    void worker_main(std::size_t participant);
+
+    std::vector<std::thread> threads_;
+    std::unique_ptr<share[]> shares_;
+    std::mutex mutex_;
+    std::condition_variable start_;
+    std::condition_variable finished_;
+    // the following are guarded by mutex_
+    const std::function<void(std::size_t)> *task_;
+    std::uint64_t generation_;
+    std::size_t running_;
+    bool stopping_;
+    std::exception_ptr error_;
+};
+
+} // namespace detail
+} // namespace xlnt
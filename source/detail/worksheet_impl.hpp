@@ -1,19 +1,50 @@
+#pragma once
+
+#include <functional>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <scoped_allocator>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include <xlnt/common/exceptions.hpp>
+
+#include "cell_arena.hpp"
 #include "cell_impl.hpp"
+#include "merged_cell_index.hpp"
+#include "shared_string_table.hpp"
+#include "xf_table.hpp"
 
 namespace xlnt {
 
 class workbook;
+class zip_file;
 
 namespace detail {
 
+struct sheet_slot;
+
+/// <summary>
+/// Set while the current thread saves a workbook_snapshot, which reads the sheets
+/// it still shares with the workbook in place. On that thread every sheet is then
+/// treated as read-only, so saving can't change a sheet the workbook is using.
+/// </summary>
+extern thread_local bool SavingSnapshot;
+
 struct worksheet_impl
 {
+    typedef std::unordered_map<column_t, cell_impl, std::hash<column_t>, std::equal_to<column_t>,
+        arena_allocator<std::pair<const column_t, cell_impl>>> cell_row;
+    // the scoped adaptor hands the arena down to each row's map as it is created
+    typedef std::unordered_map<row_t, cell_row, std::hash<row_t>, std::equal_to<row_t>,
+        std::scoped_allocator_adaptor<arena_allocator<std::pair<const row_t, cell_row>>>> cell_map;
+
     worksheet_impl(workbook *parent_workbook, const std::string &title)
-    : parent_(parent_workbook), title_(title), freeze_panes_("A1"), comment_count_(0)
+    : parent_(parent_workbook), title_(title), freeze_panes_("A1"), cell_map_(cell_map::allocator_type(&arena_)), highest_row_(0), comment_count_(0),
+      shared_with_snapshot_(false), read_only_(false), changed_since_load_(true), styles_changed_(false),
+      track_input_edits_(false), formula_count_(0)
     {
         page_margins_.set_left(0.75);
         page_margins_.set_right(0.75);
@@ -24,6 +55,8 @@ struct worksheet_impl
     }
     
     worksheet_impl(const worksheet_impl &other)
+    : cell_map_(cell_map::allocator_type(&arena_)), shared_with_snapshot_(false), read_only_(false),
+      changed_since_load_(true), styles_changed_(false), track_input_edits_(false)
     {
         *this = other;
     }
@@ -34,11 +67,19 @@ struct worksheet_impl
         title_ = other.title_;
         freeze_panes_ = other.freeze_panes_;
         cell_map_ = other.cell_map_;
+        highest_row_ = other.highest_row_;
         for(auto &row : cell_map_)
         {
             for(auto &cell : row.second)
             {
                 cell.second.parent_ = this;
+
+                // cell::get_style modifies a style the cell owns in place, so
+                // the copy needs its own
+                if(cell.second.style_ != nullptr && !cell.second.shared_style_)
+                {
+                    cell.second.style_ = new style(*cell.second.style_);
+                }
             }
         }
         relationships_ = other.relationships_;
@@ -49,23 +90,158 @@ struct worksheet_impl
         named_ranges_ = other.named_ranges_;
         comment_count_ = other.comment_count_;
         header_footer_ = other.header_footer_;
+        row_properties_ = other.row_properties_;
+        column_dimensions_ = other.column_dimensions_;
+        row_dimensions_ = other.row_dimensions_;
+        lazy_strings_ = other.lazy_strings_;
+        xf_tables_ = other.xf_tables_;
+        source_archive_ = other.source_archive_;
+        source_part_ = other.source_part_;
+        changed_since_load_ = other.changed_since_load_;
+        styles_changed_ = other.styles_changed_;
+        formula_count_ = other.formula_count_;
+    }
+
+    /// <summary>
+    /// Must be called before anything in the sheet changes. Snapshots that still
+    /// share this sheet are given their own copy first.
+    /// </summary>
+    void before_write()
+    {
+        if(is_read_only())
+        {
+            throw read_only_workbook_exception();
+        }
+
+        if(shared_with_snapshot_)
+        {
+            detach_snapshots();
+        }
+
+        changed_since_load_ = true;
+    }
+
+    /// <summary>
+    /// Must be called before handing out a mutable reference into the sheet that
+    /// may only be read (e.g. cell::get_value). Unlike before_write this is
+    /// allowed in read-only mode, where it changes nothing: several threads may
+    /// be reading, and workbook::set_read_only has detached the snapshots. The
+    /// same holds for a snapshot's sheets while it is saved.
+    /// </summary>
+    void before_reference()
+    {
+        if(is_read_only())
+        {
+            return;
+        }
+
+        if(shared_with_snapshot_)
+        {
+            detach_snapshots();
+        }
+
+        // the reference could be used to change the sheet
+        changed_since_load_ = true;
+    }
+
+    void detach_snapshots();
+
+    bool is_read_only() const
+    {
+        return read_only_ || SavingSnapshot;
+    }
+
+    /// <summary>
+    /// Must be called when the value of the cell at (column, row) is set, so
+    /// that workbook::calculate evaluates the formulas that read it again.
+    /// </summary>
+    void value_changed(column_t column, row_t row)
+    {
+        if(track_input_edits_)
+        {
+            input_edits_.push_back((static_cast<std::uint64_t>(row) << 32) | column);
+        }
+    }
+
+    /// <summary>
+    /// Must be called when the formula of the cell at (column, row) is set or cleared.
+    /// </summary>
+    void formula_changed(column_t column, row_t row)
+    {
+        formula_edits_.push_back((static_cast<std::uint64_t>(row) << 32) | column);
     }
+
+    /// <summary>
+    /// Return the cell at (column, row) or nullptr if there is none, without changing anything.
+    /// </summary>
+    cell_impl *find_cell(column_t column, row_t row);
+
+    /// <summary>
+    /// Return the cell at (column, row), creating it if necessary. The caller
+    /// is responsible for calling before_write.
+    /// </summary>
+    cell_impl &get_or_create_cell(column_t column, row_t row);
+
+    /// <summary>
+    /// Decode every string that was loaded lazily and let go of the string table.
+    /// </summary>
+    void resolve_lazy_strings();
+
+    /// <summary>
+    /// In read-only mode, stands in for a cell that doesn't exist so lookups
+    /// never insert into cell_map_. Safe to call from several threads.
+    /// </summary>
+    cell_impl *get_blank_cell(column_t column, row_t row);
     
     workbook *parent_;
     std::unordered_map<row_t, row_properties> row_properties_;
     std::string title_;
     cell_reference freeze_panes_;
-    std::unordered_map<row_t, std::unordered_map<column_t, cell_impl>> cell_map_;
+    // owns the memory of cell_map_'s nodes, so it must be declared (and constructed) first
+    cell_arena arena_;
+    cell_map cell_map_;
+    // largest key in cell_map_ (0 when empty), kept up to date on every insertion
+    // and recomputed after garbage collection so appends don't scan every row
+    row_t highest_row_;
     std::vector<relationship> relationships_;
     page_setup page_setup_;
     range_reference auto_filter_;
     margins page_margins_;
-    std::vector<range_reference> merged_cells_;
+    merged_cell_index merged_cells_;
     std::unordered_map<std::string, range_reference> named_ranges_;
     std::size_t comment_count_;
     header_footer header_footer_;
     std::unordered_map<column_t, double> column_dimensions_;
     std::unordered_map<row_t, double> row_dimensions_;
+    // snapshots taken since the last write; only touched by the thread that owns the workbook
+    bool shared_with_snapshot_;
+    std::vector<std::weak_ptr<sheet_slot>> snapshots_;
+    // set by workbook::set_read_only; every write throws while it is set
+    bool read_only_;
+    std::mutex blank_cells_mutex_;
+    std::unordered_map<std::uint64_t, cell_impl> blank_cells_;
+    // strings of cells loaded with workbook::set_lazy_shared_strings, which
+    // are decoded on first access
+    std::shared_ptr<lazy_shared_string_table> lazy_strings_;
+    // owners of the shared styles of cells that were loaded with them
+    std::vector<std::shared_ptr<xf_table>> xf_tables_;
+    // the archive this sheet was loaded from and its part in it, so that
+    // workbook::save can copy the part as is while the sheet is unchanged
+    std::shared_ptr<zip_file> source_archive_;
+    std::string source_part_;
+    // cleared once the sheet is loaded and set by before_write and before_reference
+    bool changed_since_load_;
+    // set when a cell's style is created or handed out for modification, after
+    // which the styles (and style indices) of source_archive_ no longer apply
+    bool styles_changed_;
+    // cells whose formula or value changed since the last workbook::calculate,
+    // keyed like blank_cells_. Values are only recorded once a formula reads
+    // the sheet (see formula_engine).
+    std::vector<std::uint64_t> formula_edits_;
+    std::vector<std::uint64_t> input_edits_;
+    bool track_input_edits_;
+    // cells with a formula, so calculating skips sheets without any
+    std::size_t formula_count_;
 };
 
 } // namespace detail
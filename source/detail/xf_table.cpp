@@ -0,0 +1,98 @@
+#include "detail/xf_table.hpp"
+
+namespace {
+
+bool is_date_format(xlnt::number_format::format format)
+{
+    typedef xlnt::number_format::format f;
+
+    switch(format)
+    {
+    case f::date_yyyymmdd2:
+    case f::date_yyyymmdd:
+    case f::date_ddmmyyyy:
+    case f::date_dmyslash:
+    case f::date_dmyminus:
+    case f::date_dmminus:
+    case f::date_myminus:
+    case f::date_xlsx14:
+    case f::date_xlsx15:
+    case f::date_xlsx16:
+    case f::date_xlsx17:
+    case f::date_xlsx22:
+    case f::date_datetime:
+    case f::date_yyyymmddslash:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool has_time(xlnt::number_format::format format)
+{
+    typedef xlnt::number_format::format f;
+
+    switch(format)
+    {
+    case f::date_xlsx22:
+    case f::date_datetime:
+    case f::date_time1:
+    case f::date_time2:
+    case f::date_time3:
+    case f::date_time4:
+    case f::date_time5:
+    case f::date_time6:
+    case f::date_time7:
+    case f::date_time8:
+    case f::date_timedelta:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool is_percent_format(xlnt::number_format::format format)
+{
+    typedef xlnt::number_format::format f;
+
+    return format == f::percentage || format == f::percentage_00;
+}
+
+} // namespace
+
+namespace xlnt {
+namespace detail {
+
+xf_table::xf_table(const std::vector<int> &number_format_ids)
+{
+    styles_.resize(number_format_ids.size());
+    records_.reserve(number_format_ids.size());
+
+    for(std::size_t i = 0; i < number_format_ids.size(); i++)
+    {
+        record xf;
+        xf.format = number_format::lookup_format(number_format_ids[i]);
+        xf.is_date = is_date_format(xf.format);
+        xf.has_time = has_time(xf.format);
+        xf.is_percent = is_percent_format(xf.format);
+        xf.shared_style = &styles_[i];
+        xf.shared_style->get_number_format().set_format_code(xf.format);
+        records_.push_back(xf);
+    }
+}
+
+bool xf_table::find(const style &s, std::size_t &index) const
+{
+    std::less<const style *> before;
+
+    if(styles_.empty() || before(&s, styles_.data()) || !before(&s, styles_.data() + styles_.size()))
+    {
+        return false;
+    }
+
+    index = static_cast<std::size_t>(&s - styles_.data());
+    return true;
+}
+
+} // namespace detail
+} // namespace xlnt
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include <xlnt/styles/number_format.hpp>
+#include <xlnt/styles/style.hpp>
+
+namespace xlnt {
+namespace detail {
+
+/// <summary>
+/// The cell formats (cellXfs) of a workbook being loaded, resolved once per xf
+/// so that applying one to a cell is an array index instead of format lookups
+/// and a style allocation. Cells with the same xf share its style (see
+/// cell_impl::shared_style_), so sheets keep the table alive through
+/// worksheet_impl::xf_tables_.
+/// </summary>
+class xf_table
+{
+public:
+    struct record
+    {
+        number_format::format format;
+        // the format shows a date (with or without a time of day)
+        bool is_date;
+        // the format shows a time of day or a duration
+        bool has_time;
+        // the format shows the value as a percentage
+        bool is_percent;
+        // shared by every cell with this xf
+        style *shared_style;
+    };
+
+    explicit xf_table(const std::vector<int> &number_format_ids);
+
+    std::size_t size() const
+    {
+        return records_.size();
+    }
+
+    /// <summary>
+    /// Throws std::out_of_range for an xf index that isn't in the table.
+    /// </summary>
+    const record &at(std::size_t index) const
+    {
+        return records_.at(index);
+    }
+
+    /// <summary>
+    /// If s is the shared style of one of the xfs, set index to that xf and
+    /// return true.
+    /// </summary>
+    bool find(const style &s, std::size_t &index) const;
+
+private:
+    xf_table(const xf_table &);
+    xf_table &operator=(const xf_table &);
+
+    // never resized after construction, so records_ can point into it
+    std::vector<style> styles_;
+    std::vector<record> records_;
+};
+
+} // namespace detail
+} // namespace xlnt
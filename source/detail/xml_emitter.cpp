@@ -0,0 +1,177 @@
+#include <cstring>
+
+#include "detail/xml_emitter.hpp"
+
+namespace {
+
+// Mirrors pugixml's output escaping: control characters are written as
+// numeric references, except tab everywhere and CR/LF in text.
+const unsigned char EscapeText = 1;
+const unsigned char EscapeAttribute = 2;
+
+struct escape_table
+{
+    escape_table()
+    {
+        std::memset(flags, 0, sizeof(flags));
+
+        for(int c = 0; c < 32; c++)
+        {
+            flags[c] = EscapeText | EscapeAttribute;
+        }
+
+        flags[static_cast<unsigned char>('\t')] = 0;
+        flags[static_cast<unsigned char>('\n')] = EscapeAttribute;
+        flags[static_cast<unsigned char>('\r')] = EscapeAttribute;
+        flags[static_cast<unsigned char>('&')] = EscapeText | EscapeAttribute;
+        flags[static_cast<unsigned char>('<')] = EscapeText | EscapeAttribute;
+        flags[static_cast<unsigned char>('>')] = EscapeText | EscapeAttribute;
+        flags[static_cast<unsigned char>('"')] = EscapeAttribute;
+    }
+
+    unsigned char flags[256];
+};
+
+const escape_table EscapeTable;
+
+} // namespace
+
+namespace xlnt {
+namespace detail {
+
+xml_emitter::xml_emitter(std::string &buffer) : buffer_(buffer)
+{
+}
+
+void xml_emitter::start_element(const char *name, std::size_t depth)
+{
+    indent(depth);
+    buffer_.push_back('<');
+    buffer_.append(name);
+}
+
+void xml_emitter::attribute(const char *name, const char *value)
+{
+    buffer_.push_back(' ');
+    buffer_.append(name);
+    buffer_.append("=\"", 2);
+    escape(value, true);
+    buffer_.push_back('"');
+}
+
+void xml_emitter::attribute(const char *name, std::uint64_t value)
+{
+    buffer_.push_back(' ');
+    buffer_.append(name);
+    buffer_.append("=\"", 2);
+    append_unsigned(value);
+    buffer_.push_back('"');
+}
+
+void xml_emitter::end_empty_element()
+{
+    buffer_.append(" />\n", 4);
+}
+
+void xml_emitter::end_start_tag()
+{
+    buffer_.append(">\n", 2);
+}
+
+void xml_emitter::text(const char *name, const char *text)
+{
+    buffer_.push_back('>');
+    escape(text, false);
+    buffer_.append("</", 2);
+    buffer_.append(name);
+    buffer_.append(">\n", 2);
+}
+
+void xml_emitter::text(const char *name, std::uint64_t value)
+{
+    buffer_.push_back('>');
+    append_unsigned(value);
+    buffer_.append("</", 2);
+    buffer_.append(name);
+    buffer_.append(">\n", 2);
+}
+
+void xml_emitter::end_element(const char *name, std::size_t depth)
+{
+    indent(depth);
+    buffer_.append("</", 2);
+    buffer_.append(name);
+    buffer_.append(">\n", 2);
+}
+
+void xml_emitter::indent(std::size_t depth)
+{
+    buffer_.append(depth, '\t');
+}
+
+void xml_emitter::escape(const char *string, bool attribute)
+{
+    const unsigned char mask = attribute ? EscapeAttribute : EscapeText;
+
+    while(*string != '\0')
+    {
+        // copy the longest run that needs no escaping in one go
+        const char *run = string;
+
+        while(*string != '\0' && (EscapeTable.flags[static_cast<unsigned char>(*string)] & mask) == 0)
+        {
+            ++string;
+        }
+
+        buffer_.append(run, static_cast<std::size_t>(string - run));
+
+        switch(*string)
+        {
+        case '\0':
+            break;
+        case '&':
+            buffer_.append("&amp;", 5);
+            ++string;
+            break;
+        case '<':
+            buffer_.append("&lt;", 4);
+            ++string;
+            break;
+        case '>':
+            buffer_.append("&gt;", 4);
+            ++string;
+            break;
+        case '"':
+            buffer_.append("&quot;", 6);
+            ++string;
+            break;
+        default:
+        {
+            auto c = static_cast<unsigned char>(*string++);
+            const char reference[] = {'&', '#', static_cast<char>('0' + c / 10), static_cast<char>('0' + c % 10), ';'};
+            buffer_.append(reference, sizeof(reference));
+            break;
+        }
+        }
+    }
+}
+
+void xml_emitter::append_unsigned(std::uint64_t value)
+{
+    char digits[20];
+    std::size_t length = 0;
+
+    do
+    {
+        digits[length++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while(value > 0);
+
+    while(length > 0)
+    {
+        buffer_.push_back(digits[--length]);
+    }
+}
+
+} // namespace detail
+} // namespace xlnt
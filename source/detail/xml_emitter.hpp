@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace xlnt {
+namespace detail {
+
+/// <summary>
+/// Append-only XML writer for hot paths where building a pugixml DOM costs more
+/// than the data itself (e.g. sheetData). Output is byte-for-byte what
+/// pugi::xml_node::print produces with format_default: tab indentation, one
+/// element per line, " />" for empty elements and pugixml's escaping rules.
+/// </summary>
+class xml_emitter
+{
+public:
+    explicit xml_emitter(std::string &buffer);
+
+    /// <summary>
+    /// Write the indentation and "<name". Follow with attributes and then
+    /// exactly one of end_empty_element, end_start_tag or text.
+    /// </summary>
+    void start_element(const char *name, std::size_t depth);
+
+    void attribute(const char *name, const char *value);
+    void attribute(const char *name, std::uint64_t value);
+
+    /// <summary>
+    /// Write " />" for an element with no children.
+    /// </summary>
+    void end_empty_element();
+
+    /// <summary>
+    /// Write ">" for an element with element children, which are then written at depth + 1.
+    /// </summary>
+    void end_start_tag();
+
+    /// <summary>
+    /// Write ">text</name>" for an element whose only child is text.
+    /// </summary>
+    void text(const char *name, const char *text);
+    void text(const char *name, std::uint64_t value);
+
+    /// <summary>
+    /// Write "</name>" to close an element opened with end_start_tag.
+    /// </summary>
+    void end_element(const char *name, std::size_t depth);
+
+private:
+    void indent(std::size_t depth);
+    void escape(const char *string, bool attribute);
+    void append_unsigned(std::uint64_t value);
+
+    std::string &buffer_;
+};
+
+} // namespace detail
+} // namespace xlnt
@@ -32,6 +32,12 @@ invalid_file_exception::invalid_file_exception(const std::string &filename)
     
 }
 
+read_only_workbook_exception::read_only_workbook_exception()
+    : std::runtime_error("workbook is read-only")
+{
+
+}
+
 cell_coordinates_exception::cell_coordinates_exception(int row, int column)
     : std::runtime_error(std::string("bad cell coordinates: (") + std::to_string(row) + "," + std::to_string(column) + ")")
 {
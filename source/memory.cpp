@@ -0,0 +1,50 @@
+#include <cstdlib>
+#include <stdexcept>
+#include <pugixml.hpp>
+
+#include <xlnt/common/memory.hpp>
+
+namespace {
+
+xlnt::memory_functions default_functions()
+{
+    xlnt::memory_functions functions;
+    functions.allocate = &std::malloc;
+    functions.reallocate = &std::realloc;
+    functions.deallocate = &std::free;
+
+    return functions;
+}
+
+xlnt::memory_functions &current_functions()
+{
+    static xlnt::memory_functions functions = default_functions();
+    return functions;
+}
+
+} // namespace
+
+namespace xlnt {
+
+void set_memory_functions(const memory_functions &functions)
+{
+    if(functions.allocate == nullptr || functions.reallocate == nullptr || functions.deallocate == nullptr)
+    {
+        throw std::runtime_error("memory functions must not be null");
+    }
+
+    current_functions() = functions;
+    pugi::set_memory_management_functions(functions.allocate, functions.deallocate);
+}
+
+void reset_memory_functions()
+{
+    set_memory_functions(default_functions());
+}
+
+const memory_functions &get_memory_functions()
+{
+    return current_functions();
+}
+
+} // namespace xlnt
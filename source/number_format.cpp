@@ -3,6 +3,24 @@
 #include <xlnt/styles/number_format.hpp>
 
 namespace xlnt {
+namespace {
+
+// Builds the tables below during static initialization. VS2013 doesn't make
+// function-local static initialization thread-safe, and number formats are set
+// while sheets are being filled in from several threads.
+struct table_initializer
+{
+    table_initializer()
+    {
+        number_format::format_strings();
+        number_format::builtin_formats();
+        number_format::reversed_builtin_formats();
+    }
+};
+
+const table_initializer TableInitializer;
+
+} // namespace
 
 const std::unordered_map<number_format::format, std::string, number_format::format_hash> &number_format::format_strings()
 {
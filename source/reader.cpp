@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cstring>
 #include <pugixml.hpp>
 
 #include <xlnt/reader/reader.hpp>
@@ -13,6 +14,11 @@
 #include <xlnt/common/zip_file.hpp>
 #include <xlnt/common/exceptions.hpp>
 
+#include "detail/number_conversion.hpp"
+#include "detail/shared_string_table.hpp"
+#include "detail/worksheet_impl.hpp"
+#include "detail/xf_table.hpp"
+
 namespace xlnt {
 
 const std::string reader::CentralDirectorySignature = "\x50\x4b\x05\x06";
@@ -190,7 +196,7 @@ std::vector<std::pair<std::string, std::string>> reader::read_content_types(zip_
         auto content_types_string = archive.read("[Content_Types].xml");
         doc.load(content_types_string.c_str());
     }
-    catch(std::exception e)
+    catch(const std::exception &)
     {
         throw invalid_file_exception(archive.get_filename());
     }
@@ -236,7 +242,19 @@ std::string reader::determine_document_type(const std::vector<std::pair<std::str
     return "unsupported";
 }
 
-void read_worksheet_common(worksheet ws, const pugi::xml_node &root_node, const std::vector<std::string> &string_table, const std::vector<int> &number_format_ids)
+detail::shared_string_table make_string_table(const std::vector<std::string> &strings)
+{
+    detail::shared_string_table table;
+
+    for(const auto &string : strings)
+    {
+        table.add(string.data(), string.size());
+    }
+
+    return table;
+}
+
+void read_worksheet_common(worksheet ws, detail::worksheet_impl &sheet, const pugi::xml_node &root_node, const detail::shared_string_table &string_table, const detail::xf_table &xfs)
 {
     auto dimension_node = root_node.child("dimension");
     std::string dimension = dimension_node.attribute("ref").as_string();
@@ -259,90 +277,128 @@ void read_worksheet_common(worksheet ws, const pugi::xml_node &root_node, const
         }
     }
 
+    // set when strings are decoded on first access rather than now
+    auto lazy_strings = sheet.lazy_strings_.get();
+    auto base_date = ws.get_parent().get_properties().excel_base_date;
+    row_t row_index = 0;
+
     for(auto row_node : sheet_data_node.children("row"))
     {
-        int row_index = row_node.attribute("r").as_int();
-        std::string span_string = row_node.attribute("spans").as_string();
-        auto colon_index = span_string.find(':');
-
-        if(colon_index == std::string::npos)
-        {
-            continue;
-        }
+        // r is optional on rows too, in which case the row follows the previous one
+        row_index = row_node.attribute("r").as_uint(row_index + 1);
+        column_t next_column = 1;
 
-        int min_column = std::stoi(span_string.substr(0, colon_index));
-        int max_column = std::stoi(span_string.substr(colon_index + 1));
-
-        for(int i = min_column; i < max_column + 1; i++)
+        for(auto cell_node : row_node.children("c"))
         {
-            std::string address = xlnt::cell_reference::column_string_from_index(i) + std::to_string(row_index);
-            auto cell_node = row_node.find_child_by_attribute("c", "r", address.c_str());
+            // r is optional, in which case the cell follows the previous one
+            auto reference_attribute = cell_node.attribute("r");
+            cell_reference address = reference_attribute != nullptr
+                ? cell_reference(reference_attribute.value())
+                : cell_reference(next_column - 1, row_index - 1);
+            next_column = address.get_column_index() + 2;
+
+            auto value_node = cell_node.child("v");
+            bool has_value = value_node != nullptr;
+            // points into the parsed document; converted in place without copying
+            const char *value_string = value_node.text().get();
+
+            auto type_attribute = cell_node.attribute("t");
+            bool has_type = type_attribute != nullptr;
+            const char *type = type_attribute.value();
+
+            int style_index = 0;
+            bool has_style = cell_node.attribute("s") != nullptr && detail::parse_int(cell_node.attribute("s").value(), style_index);
+
+            auto formula_node = cell_node.child("f");
+            bool has_formula = formula_node != nullptr;
+            bool shared_formula = has_formula && std::strcmp(formula_node.attribute("t").value(), "shared") == 0;
+
+            if(has_formula && !shared_formula && !ws.get_parent().get_data_only())
+            {
+                std::string formula = formula_node.text().as_string();
+                ws.get_cell(address).set_formula(formula);
+            }
 
-            if(cell_node != nullptr)
+            if(has_type && std::strcmp(type, "inlineStr") == 0) // inline string
             {
-                bool has_value = cell_node.child("v") != nullptr;
-                std::string value_string = cell_node.child("v").text().as_string();
+                std::string inline_string = cell_node.child("is").child("t").text().as_string();
+                ws.get_cell(address).set_value(inline_string);
+            }
+            else if(has_type && std::strcmp(type, "s") == 0) // shared string
+            {
+                int shared_string_index = 0;
 
-                bool has_type = cell_node.attribute("t") != nullptr;
-                std::string type = cell_node.attribute("t").as_string();
+                auto string_count = lazy_strings != nullptr ? lazy_strings->size() : string_table.size();
 
-                bool has_style = cell_node.attribute("s") != nullptr;
-                std::string style = cell_node.attribute("s").as_string();
+                if(!detail::parse_int(value_string, shared_string_index) || shared_string_index < 0
+                    || static_cast<std::size_t>(shared_string_index) >= string_count)
+                {
+                    throw std::runtime_error("invalid shared string index");
+                }
 
-                bool has_formula = cell_node.child("f") != nullptr;
-                bool shared_formula = has_formula && cell_node.child("f").attribute("t") != nullptr && std::string(cell_node.child("f").attribute("t").as_string()) == "shared";
+                auto index = static_cast<std::size_t>(shared_string_index);
 
-                if(has_formula && !shared_formula && !ws.get_parent().get_data_only())
+                if(lazy_strings != nullptr)
                 {
-                    std::string formula = cell_node.child("f").text().as_string();
-                    ws.get_cell(address).set_formula(formula);
+                    auto &cell = sheet.get_or_create_cell(address.get_column_index(), address.get_row_index());
+                    cell.value_ = value(std::string());
+                    cell.lazy_string_ = index;
                 }
-
-                if(has_type && type == "inlineStr") // inline string
+                else
                 {
-                    std::string inline_string = cell_node.child("is").child("t").text().as_string();
-                    ws.get_cell(address).set_value(inline_string);
+                    ws.get_cell(address).set_value(std::string(string_table.data(index), string_table.length(index)));
                 }
-                else if(has_type && type == "s") // shared string
+            }
+            else if(has_type && std::strcmp(type, "b") == 0) // boolean
+            {
+                bool boolean_value = true;
+                detail::parse_bool(value_string, boolean_value);
+                ws.get_cell(address).set_value(value(boolean_value));
+            }
+            else if(has_type && std::strcmp(type, "str") == 0)
+            {
+                ws.get_cell(address).set_value(std::string(value_string));
+            }
+            else if(has_type && std::strcmp(type, "e") == 0 && has_value)
+            {
+                ws.get_cell(address).set_value(value::error(value_string));
+            }
+            else if(has_style)
+            {
+                const auto &xf = xfs.at(static_cast<std::size_t>(style_index));
+                auto &cell = sheet.get_or_create_cell(address.get_column_index(), address.get_row_index());
+                cell.style_ = xf.shared_style;
+                cell.shared_style_ = true;
+                double numeric_value = 0;
+
+                if(!detail::parse_double(value_string, numeric_value))
                 {
-                    auto shared_string_index = std::stoi(value_string);
-                    auto shared_string = string_table.at(shared_string_index);
-                    ws.get_cell(address).set_value(shared_string);
+                    continue;
                 }
-                else if(has_type && type == "b") // boolean
+
+                // only format 14 (m/d/yyyy) is moved to the 1900 base, as whole days
+                if(xf.format == number_format::format::date_xlsx14)
                 {
-                    ws.get_cell(address).set_value(value(value_string != "0"));
+                    // through datetime, which clamps serials too large for an int
+                    auto converted = datetime::from_number(numeric_value, base_date);
+                    cell.value_ = value(date(converted.year, converted.month, converted.day).to_number(calendar::windows_1900));
                 }
-                else if(has_type && type == "str")
+                else
                 {
-                    ws.get_cell(address).set_value(value_string);
+                    cell.value_ = value(numeric_value);
                 }
-                else if(has_style)
+            }
+            else if(has_value)
+            {
+                double numeric_value = 0;
+
+                if(detail::parse_double(value_string, numeric_value))
                 {
-                    auto number_format_id = number_format_ids.at(std::stoi(style));
-                    auto format = number_format::lookup_format(number_format_id);
-                    ws.get_cell(address).get_style().get_number_format().set_format_code(format);
-                    if(format == number_format::format::date_xlsx14)
-                    {
-                        auto base_date = ws.get_parent().get_properties().excel_base_date;
-                        auto converted = date::from_number(std::stoi(value_string), base_date);
-                        ws.get_cell(address).set_value(converted.to_number(calendar::windows_1900));
-                    }
-                    else
-                    {
-                        ws.get_cell(address).set_value(value(std::stod(value_string)));
-                    }
+                    ws.get_cell(address).set_value(value(numeric_value));
                 }
-                else if(has_value)
+                else
                 {
-                    try
-                    {
-                        ws.get_cell(address).set_value(value(std::stod(value_string)));
-                    }
-                    catch(std::invalid_argument)
-                    {
-                        ws.get_cell(address).set_value(value_string);
-                    }
+                    ws.get_cell(address).set_value(std::string(value_string));
                 }
             }
         }
@@ -361,14 +417,28 @@ void reader::fast_parse(worksheet ws, std::istream &xml_source, const std::vecto
 {
     pugi::xml_document doc;
     doc.load(xml_source);
-    read_worksheet_common(ws, doc.child("worksheet"), shared_string, {});
+    detail::xf_table no_xfs((std::vector<int>()));
+    read_worksheet_common(ws, *ws.d_, doc.child("worksheet"), make_string_table(shared_string), no_xfs);
 }
 
 void reader::read_worksheet(worksheet ws, const std::string &xml_string, const std::vector<std::string> &string_table, const std::vector<int> &number_format_ids)
 {
+    read_worksheet(ws, xml_string, make_string_table(string_table), std::make_shared<detail::xf_table>(number_format_ids));
+}
+
+void reader::read_worksheet(worksheet ws, const std::string &xml_string, const detail::shared_string_table &string_table, const std::shared_ptr<detail::xf_table> &xfs)
+{
+    // cells loaded with an xf share its style, so the sheet has to keep the table alive
+    auto &tables = ws.d_->xf_tables_;
+
+    if(std::find(tables.begin(), tables.end(), xfs) == tables.end())
+    {
+        tables.push_back(xfs);
+    }
+
     pugi::xml_document doc;
     doc.load(xml_string.c_str());
-    read_worksheet_common(ws, doc.child("worksheet"), string_table, number_format_ids);
+    read_worksheet_common(ws, *ws.d_, doc.child("worksheet"), string_table, *xfs);
 }
 
 worksheet xlnt::reader::read_worksheet(std::istream &handle, xlnt::workbook &wb, const std::string &title, const std::vector<std::string> &string_table)
@@ -377,32 +447,22 @@ worksheet xlnt::reader::read_worksheet(std::istream &handle, xlnt::workbook &wb,
     ws.set_title(title);
     pugi::xml_document doc;
     doc.load(handle);
-    read_worksheet_common(ws, doc.child("worksheet"), string_table, {});
+    detail::xf_table no_xfs((std::vector<int>()));
+    read_worksheet_common(ws, *ws.d_, doc.child("worksheet"), make_string_table(string_table), no_xfs);
     return ws;
 }
 
 std::vector<std::string> reader::read_shared_string(const std::string &xml_string)
 {
-    std::vector<std::string> shared_strings;
-    pugi::xml_document doc;
-    doc.load(xml_string.c_str());
-    auto root_node = doc.child("sst");
-    //int count = root_node.attribute("count").as_int();
-	int unique_count;
-
-	if(root_node.attribute("uniqueCount"))
-		unique_count = root_node.attribute("uniqueCount").as_int();
-	else
-		unique_count = root_node.attribute("count").as_int();//Workaround for WPS Office
+    detail::shared_string_table table;
+    table.load(xml_string.data(), xml_string.size());
 
-    for(auto si_node : root_node)
-    {
-        shared_strings.push_back(si_node.child("t").text().as_string());
-    }
+    std::vector<std::string> shared_strings;
+    shared_strings.reserve(table.size());
 
-    if(unique_count != (int)shared_strings.size())
+    for(std::size_t i = 0; i < table.size(); i++)
     {
-        throw std::runtime_error("counts don't match");
+        shared_strings.push_back(std::string(table.data(i), table.length(i)));
     }
 
     return shared_strings;
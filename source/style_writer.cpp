@@ -41,7 +41,9 @@ std::vector<style> style_writer::get_styles() const
     {
         for(auto row : ws.rows())
         {
-            for(auto cell : row)
+            // through const cells: the non-const get_style copies shared styles
+            // and counts as a change to the sheet
+            for(const auto cell : row)
             {
                 if(cell.has_style())
                 {
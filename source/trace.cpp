@@ -0,0 +1,186 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <xlnt/common/trace.hpp>
+
+#include "detail/trace_scope.hpp"
+
+namespace {
+
+typedef std::chrono::steady_clock trace_clock;
+
+struct trace_event
+{
+    const char *name;
+    const char *category;
+    std::string label;
+    std::int64_t start;
+    std::int64_t duration;
+    std::size_t thread;
+};
+
+struct trace_state
+{
+    std::mutex mutex;
+    trace_clock::time_point origin;
+    std::vector<trace_event> events;
+    std::vector<std::thread::id> threads;
+};
+
+// Namespace scope rather than a function-local static, whose initialization
+// VS2013 doesn't make thread-safe and spans are recorded from several threads
+trace_state State;
+
+trace_state &get_state()
+{
+    return State;
+}
+
+std::int64_t now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(trace_clock::now().time_since_epoch()).count();
+}
+
+// Chrome wants small integer thread ids; number threads in order of first appearance.
+std::size_t thread_index(trace_state &state)
+{
+    auto id = std::this_thread::get_id();
+
+    for(std::size_t i = 0; i < state.threads.size(); i++)
+    {
+        if(state.threads[i] == id)
+        {
+            return i + 1;
+        }
+    }
+
+    state.threads.push_back(id);
+    return state.threads.size();
+}
+
+void write_json_string(std::ostream &stream, const char *string)
+{
+    stream << '"';
+
+    for(; *string != '\0'; ++string)
+    {
+        auto c = static_cast<unsigned char>(*string);
+
+        if(c == '"' || c == '\\')
+        {
+            stream << '\\' << *string;
+        }
+        else if(c < 0x20)
+        {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            stream << escaped;
+        }
+        else
+        {
+            stream << *string;
+        }
+    }
+
+    stream << '"';
+}
+
+} // namespace
+
+namespace xlnt {
+
+void trace::start()
+{
+    auto &state = get_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.events.clear();
+    state.threads.clear();
+    state.origin = trace_clock::now();
+    detail::TraceRecording.store(true);
+}
+
+void trace::stop()
+{
+    detail::TraceRecording.store(false);
+}
+
+bool trace::is_recording()
+{
+    return TracingEnabled && detail::trace_recording();
+}
+
+void trace::write_chrome_json(std::ostream &stream)
+{
+    auto &state = get_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    auto origin = std::chrono::duration_cast<std::chrono::microseconds>(state.origin.time_since_epoch()).count();
+
+    stream << "{\"traceEvents\":[";
+
+    for(std::size_t i = 0; i < state.events.size(); i++)
+    {
+        const auto &event = state.events[i];
+
+        stream << (i == 0 ? "\n" : ",\n");
+        stream << "{\"name\":";
+        write_json_string(stream, event.name);
+        stream << ",\"cat\":";
+        write_json_string(stream, event.category);
+        stream << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread;
+        stream << ",\"ts\":" << event.start - origin << ",\"dur\":" << event.duration;
+
+        if(!event.label.empty())
+        {
+            stream << ",\"args\":{\"label\":";
+            write_json_string(stream, event.label.c_str());
+            stream << "}";
+        }
+
+        stream << "}";
+    }
+
+    stream << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+namespace detail {
+
+std::atomic<bool> TraceRecording(false);
+
+std::int64_t trace_now()
+{
+    return now_us();
+}
+
+void trace_record(const char *name, const char *category, std::string &label, std::int64_t start)
+{
+    auto end = now_us();
+    auto &state = get_state();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    // drop spans that were open across a stop() or a restart
+    auto origin = std::chrono::duration_cast<std::chrono::microseconds>(state.origin.time_since_epoch()).count();
+
+    if(!trace_recording() || start < origin)
+    {
+        return;
+    }
+
+    trace_event event;
+    event.name = name;
+    event.category = category;
+    event.label.swap(label);
+    event.start = start;
+    event.duration = end - start;
+    event.thread = thread_index(state);
+    state.events.push_back(std::move(event));
+}
+
+} // namespace detail
+} // namespace xlnt
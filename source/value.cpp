@@ -1,9 +1,14 @@
 #include <stdexcept>
 #include <codecvt>
+#include <limits>
+#include <locale>
+#include <utility>
 
 #include <xlnt/cell/value.hpp>
 #include <xlnt/common/datetime.hpp>
 
+#include "detail/number_conversion.hpp"
+
 namespace xlnt {
 
 value value::error(const std::string &error_string)
@@ -53,6 +58,10 @@ value::value(const std::string &s) : type_(type::string), string_value_(s)
 {
 }
 
+value::value(std::string &&s) : type_(type::string), string_value_(std::move(s))
+{
+}
+
 value::value(const wchar_t *s) : value(std::wstring(s))
 {
 }
@@ -168,7 +177,11 @@ bool value::as() const
 
 bool value::is_integral() const
 {
-    return type_ == type::numeric && (int64_t)numeric_value_ == numeric_value_;
+    // bounds first: converting a value int64_t can't hold is undefined
+    const auto lowest = static_cast<long double>(std::numeric_limits<int64_t>::min());
+
+    return type_ == type::numeric && numeric_value_ >= lowest && numeric_value_ < -lowest
+        && (int64_t)numeric_value_ == numeric_value_;
 }
 
 template<>
@@ -194,7 +207,12 @@ std::string value::to_string() const
     case type::boolean:
         return numeric_value_ != 0 ? "1" : "0";
     case type::numeric:
-        return std::to_string(numeric_value_);
+    {
+        char buffer[detail::MaxDoubleLength];
+        auto length = is_integral() ? detail::format_integer(static_cast<int64_t>(numeric_value_), buffer)
+            : detail::format_double(static_cast<double>(numeric_value_), buffer);
+        return std::string(buffer, length);
+    }
     case type::string:
     case type::error:
         return string_value_;
@@ -214,7 +232,20 @@ std::wstring value::to_wstring() const
 	case type::boolean:
 		return numeric_value_ != 0 ? L"1" : L"0";
 	case type::numeric:
-		return std::to_wstring(numeric_value_);
+	{
+		char buffer[detail::MaxDoubleLength];
+
+		if (is_integral())
+		{
+			detail::format_integer(static_cast<int64_t>(numeric_value_), buffer);
+		}
+		else
+		{
+			detail::format_double(static_cast<double>(numeric_value_), buffer);
+		}
+
+		return utf8_conv.from_bytes(buffer);
+	}
 	case type::string:
 	case type::error:
 		return utf8_conv.from_bytes(string_value_);
@@ -1,8 +1,14 @@
 #include <algorithm>
 #include <array>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <mutex>
 #include <set>
 #include <sstream>
+#include <unordered_map>
 #include <pugixml.hpp>
 
 #ifdef _WIN32
@@ -19,11 +25,19 @@
 #include <xlnt/writer/writer.hpp>
 #include <xlnt/common/zip_file.hpp>
 #include <xlnt/workbook/document_properties.hpp>
+#include <xlnt/workbook/io_metrics.hpp>
+#include <xlnt/workbook/workbook_snapshot.hpp>
 #include <xlnt/writer/style_writer.hpp>
 
 #include "detail/cell_impl.hpp"
+#include "detail/number_conversion.hpp"
+#include "detail/shared_string_table.hpp"
+#include "detail/snapshot_impl.hpp"
+#include "detail/trace_scope.hpp"
 #include "detail/workbook_impl.hpp"
 #include "detail/worksheet_impl.hpp"
+#include "detail/xf_table.hpp"
+#include "detail/xml_emitter.hpp"
 
 static std::string CreateTemporaryFilename()
 {
@@ -46,13 +60,801 @@ static std::string CreateTemporaryFilename()
 }
 
 namespace xlnt {
+namespace {
+
+typedef std::chrono::steady_clock metrics_clock;
+
+// Appends a finished phase to metrics, if metrics are being collected, and
+// returns its index so the caller can fill in volumes.
+std::size_t record_phase(io_metrics *metrics, const char *phase, const std::string &part, metrics_clock::time_point start)
+{
+    if(metrics == nullptr)
+    {
+        return 0;
+    }
+
+    phase_metrics result;
+    result.phase = phase;
+    result.part = part;
+    result.milliseconds = std::chrono::duration<double, std::milli>(metrics_clock::now() - start).count();
+    metrics->phases.push_back(result);
+
+    return metrics->phases.size() - 1;
+}
+
+std::string read_part(zip_file &archive, const std::string &name, io_metrics *metrics)
+{
+    auto start = metrics_clock::now();
+    auto contents = archive.read(name);
+    auto index = record_phase(metrics, "inflate", name, start);
+
+    if(metrics != nullptr)
+    {
+        metrics->phases[index].uncompressed_bytes = contents.size();
+        metrics->phases[index].compressed_bytes = archive.getinfo(name).compress_size;
+    }
+
+    return contents;
+}
+
+// Serializes a part with serialize() and adds it to the archive, timing the two separately
+template<typename Serializer>
+void write_part(zip_file &archive, const std::string &name, Serializer serialize, io_metrics *metrics, const char *phase = "write_part", std::size_t cells = 0)
+{
+    auto start = metrics_clock::now();
+    std::string contents;
+
+    {
+        detail::trace_scope trace("serialize", "save", name);
+        contents = serialize();
+    }
+
+    auto index = record_phase(metrics, phase, name, start);
+
+    if(metrics != nullptr)
+    {
+        metrics->phases[index].uncompressed_bytes = contents.size();
+        metrics->phases[index].cells = cells;
+    }
+
+    start = metrics_clock::now();
+    archive.writestr(name, contents);
+    index = record_phase(metrics, "deflate", name, start);
+
+    if(metrics != nullptr)
+    {
+        metrics->phases[index].uncompressed_bytes = contents.size();
+    }
+}
+
+// Adds a part of source to the archive without recompressing it
+void copy_part(zip_file &archive, zip_file &source, const std::string &name, io_metrics *metrics)
+{
+    auto start = metrics_clock::now();
+    archive.write_from(source, name);
+    auto index = record_phase(metrics, "copy_part", name, start);
+
+    if(metrics != nullptr)
+    {
+        metrics->phases[index].compressed_bytes = source.getinfo(name).compress_size;
+    }
+}
+
+// The part each sheet is saved to, as (sheet index, part name) in relationship order
+std::vector<std::pair<std::size_t, std::string>> get_sheet_parts(const detail::workbook_impl &d)
+{
+    std::vector<std::pair<std::size_t, std::string>> parts;
+
+    for(const auto &relationship : d.relationships_)
+    {
+        if(relationship.get_type() == relationship::type::worksheet)
+        {
+            std::string sheet_index_string = relationship.get_target_uri().substr(16);
+            std::size_t sheet_index = std::stoi(sheet_index_string.substr(0, sheet_index_string.find('.'))) - 1;
+            parts.push_back(std::make_pair(sheet_index, "xl/" + relationship.get_target_uri()));
+        }
+    }
+
+    return parts;
+}
+
+// Whether every styled cell of ws uses one of the source's cell formats
+// unchanged, so that it can be written next to the source's styles.xml
+bool uses_source_styles(const detail::workbook_impl &d, const detail::worksheet_impl &ws)
+{
+    std::size_t index = 0;
+
+    for(const auto &row : ws.cell_map_)
+    {
+        for(const auto &cell : row.second)
+        {
+            if(cell.second.style_ != nullptr && (d.source_xfs_ == nullptr || !d.source_xfs_->find(*cell.second.style_, index)))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// Sheets whose part in the source archive can be copied into the new file: they
+// haven't changed since they were loaded, are saved under the same name and
+// don't need relationships of their own. Copied sheets keep referring to the
+// source's styles, so none can be copied once any cell's style has changed,
+// nor when a sheet that is serialized again has a style that isn't one of the
+// source's cell formats.
+std::vector<bool> find_reusable_sheets(const detail::workbook_impl &d, const std::vector<std::pair<std::size_t, std::string>> &sheet_parts)
+{
+    std::vector<bool> reusable(d.worksheets_.size(), false);
+
+    if(d.source_archive_ == nullptr)
+    {
+        return reusable;
+    }
+
+    for(const auto &ws : d.worksheets_)
+    {
+        if(ws->styles_changed_)
+        {
+            return reusable;
+        }
+    }
+
+    for(const auto &sheet_part : sheet_parts)
+    {
+        if(sheet_part.first >= d.worksheets_.size())
+        {
+            continue;
+        }
+
+        const auto &ws = *d.worksheets_[sheet_part.first];
+        const auto &name = sheet_part.second;
+        auto separator = name.find_last_of('/');
+        auto rels_name = name.substr(0, separator) + "/_rels/" + name.substr(separator + 1) + ".rels";
+
+        reusable[sheet_part.first] = !ws.changed_since_load_
+            && ws.source_archive_ == d.source_archive_
+            && ws.source_part_ == name
+            && !d.source_archive_->has_file(rels_name);
+    }
+
+    for(std::size_t i = 0; i < d.worksheets_.size(); i++)
+    {
+        if(!reusable[i] && !uses_source_styles(d, *d.worksheets_[i]))
+        {
+            return std::vector<bool>(d.worksheets_.size(), false);
+        }
+    }
+
+    return reusable;
+}
+
+std::size_t count_cells(const detail::worksheet_impl &ws)
+{
+    std::size_t cells = 0;
+
+    for(const auto &row : ws.cell_map_)
+    {
+        cells += row.second.size();
+    }
+
+    return cells;
+}
+
+void check_writable(const detail::workbook_impl &d)
+{
+    if(d.read_only_)
+    {
+        throw read_only_workbook_exception();
+    }
+}
+
+// Adds the phases recorded since first_phase to the totals
+void summarize(io_metrics *metrics, std::size_t first_phase, metrics_clock::time_point start)
+{
+    if(metrics == nullptr)
+    {
+        return;
+    }
+
+    metrics->total_milliseconds += std::chrono::duration<double, std::milli>(metrics_clock::now() - start).count();
+
+    for(auto i = first_phase; i < metrics->phases.size(); i++)
+    {
+        const auto &phase = metrics->phases[i];
+
+        if(phase.phase == "inflate")
+        {
+            metrics->bytes_inflated += phase.uncompressed_bytes;
+        }
+        else if(phase.phase == "deflate")
+        {
+            metrics->bytes_deflated += phase.uncompressed_bytes;
+        }
+
+        metrics->cells += phase.cells;
+        metrics->strings += phase.strings;
+    }
+}
+
+// Offsets of an attribute's value within an XML start tag
+struct attribute_span
+{
+    std::size_t begin;
+    std::size_t end;
+};
+
+// Finds attribute name in the start tag beginning at xml[tag] ("<name ...>").
+// Returns false if the tag doesn't have it.
+bool find_attribute(const std::string &xml, std::size_t tag, const char *name, attribute_span &span)
+{
+    auto name_length = std::strlen(name);
+    auto i = xml.find_first_of(" \t\r\n/>", tag);
+
+    while(i < xml.size())
+    {
+        i = xml.find_first_not_of(" \t\r\n", i);
+
+        if(i == std::string::npos || xml[i] == '/' || xml[i] == '>')
+        {
+            return false;
+        }
+
+        auto equals = xml.find('=', i);
+        auto quote = equals == std::string::npos ? equals : xml.find_first_of("\"'", equals);
+
+        if(quote == std::string::npos)
+        {
+            return false;
+        }
+
+        auto close = xml.find(xml[quote], quote + 1);
+
+        if(close == std::string::npos)
+        {
+            return false;
+        }
+
+        auto name_end = xml.find_last_not_of(" \t\r\n", equals - 1) + 1;
+
+        if(name_end - i == name_length && xml.compare(i, name_length, name) == 0)
+        {
+            span.begin = quote + 1;
+            span.end = close;
+            return true;
+        }
+
+        i = close + 1;
+    }
+
+    return false;
+}
+
+// Finds the next start tag "<name" at or after from and before end, skipping
+// tags that only start with name (e.g. "<rowBreaks" when looking for "<row").
+std::size_t find_start_tag(const std::string &xml, const char *name, std::size_t from, std::size_t end)
+{
+    std::string open = std::string("<") + name;
+
+    for(auto i = xml.find(open, from); i != std::string::npos && i < end; i = xml.find(open, i + 1))
+    {
+        auto next = i + open.size();
+
+        if(next < xml.size() && std::strchr(" \t\r\n/>", xml[next]) != nullptr)
+        {
+            return i;
+        }
+    }
+
+    return std::string::npos;
+}
+
+// Parses the r attribute of the row start tag at xml[tag]. Returns false if the row leaves it out.
+bool get_row_number(const std::string &xml, std::size_t tag, row_t &row)
+{
+    attribute_span r;
+
+    if(!find_attribute(xml, tag, "r", r))
+    {
+        return false;
+    }
+
+    row = static_cast<row_t>(std::stoul(xml.substr(r.begin, r.end - r.begin)));
+
+    return true;
+}
+
+// The number of the last row in sheetData (xml[begin, end)), or 0 if there are
+// none. Rows are in ascending order, so only the last one is looked at unless
+// it leaves out its optional r attribute, which makes it one past the row before it.
+row_t find_last_row(const std::string &xml, std::size_t begin, std::size_t end)
+{
+    auto last = std::string::npos;
+
+    for(auto i = xml.rfind("<row", end); i != std::string::npos && i >= begin; i = i == 0 ? std::string::npos : xml.rfind("<row", i - 1))
+    {
+        if(find_start_tag(xml, "row", i, i + 1) == i)
+        {
+            last = i;
+            break;
+        }
+    }
+
+    row_t row = 0;
+
+    if(last == std::string::npos || get_row_number(xml, last, row))
+    {
+        return row;
+    }
+
+    for(auto i = find_start_tag(xml, "row", begin, end); i != std::string::npos; i = find_start_tag(xml, "row", i + 1, end))
+    {
+        if(!get_row_number(xml, i, row))
+        {
+            row++;
+        }
+    }
+
+    return row;
+}
+
+// Serializes rows for append_rows. Strings are written inline so the shared
+// string table doesn't have to be rewritten. min_column and max_column are
+// widened (1-based, 0 for none) to the columns the rows use.
+std::string write_appended_rows(const std::vector<std::vector<value>> &rows, row_t first_row, column_t &min_column, column_t &max_column, row_t &last_row, std::size_t &cells)
+{
+    std::string xml;
+    detail::xml_emitter emitter(xml);
+    char reference_buffer[cell_reference::MaxStringLength];
+    char number_buffer[detail::MaxDoubleLength];
+
+    for(std::size_t i = 0; i < rows.size(); i++)
+    {
+        const auto &row = rows[i];
+        auto row_number = first_row + static_cast<row_t>(i);
+        column_t min = 0;
+        column_t max = 0;
+
+        for(column_t column = 0; column < row.size(); column++)
+        {
+            if(!row[column].is(value::type::null))
+            {
+                min = min == 0 ? column + 1 : min;
+                max = column + 1;
+            }
+        }
+
+        if(max == 0)
+        {
+            continue;
+        }
+
+        emitter.start_element("row", 2);
+        emitter.attribute("r", row_number);
+        char spans_buffer[24];
+        std::sprintf(spans_buffer, "%u:%u", min, max);
+        emitter.attribute("spans", spans_buffer);
+        emitter.end_start_tag();
+
+        for(column_t column = min - 1; column < max; column++)
+        {
+            const auto &cell_value = row[column];
+
+            if(cell_value.is(value::type::null))
+            {
+                continue;
+            }
+
+            emitter.start_element("c", 3);
+            cell_reference(column, row_number - 1).to_string(reference_buffer);
+            emitter.attribute("r", reference_buffer);
+
+            if(cell_value.is(value::type::string))
+            {
+                emitter.attribute("t", "inlineStr");
+                emitter.end_start_tag();
+                emitter.start_element("is", 4);
+                emitter.end_start_tag();
+                emitter.start_element("t", 5);
+                emitter.text("t", cell_value.get<std::string>().c_str());
+                emitter.end_element("is", 4);
+            }
+            else
+            {
+                if(cell_value.is(value::type::boolean))
+                {
+                    emitter.attribute("t", "b");
+                }
+                else if(cell_value.is(value::type::error))
+                {
+                    emitter.attribute("t", "e");
+                }
+                else
+                {
+                    emitter.attribute("t", "n");
+                }
+
+                emitter.end_start_tag();
+                emitter.start_element("v", 4);
+
+                if(cell_value.is(value::type::numeric))
+                {
+                    if(cell_value.is_integral())
+                    {
+                        detail::format_integer(cell_value.as<int64_t>(), number_buffer);
+                    }
+                    else
+                    {
+                        detail::format_double(cell_value.as<double>(), number_buffer);
+                    }
+
+                    emitter.text("v", number_buffer);
+                }
+                else if(cell_value.is(value::type::boolean))
+                {
+                    emitter.text("v", cell_value.as<bool>() ? "1" : "0");
+                }
+                else
+                {
+                    emitter.text("v", cell_value.to_string().c_str());
+                }
+            }
+
+            emitter.end_element("c", 3);
+            cells++;
+        }
+
+        emitter.end_element("row", 2);
+        min_column = min_column == 0 ? min : std::min(min_column, min);
+        max_column = std::max(max_column, max);
+        last_row = row_number;
+    }
+
+    return xml;
+}
+
+// Inserts rows after the last row of the worksheet part xml and widens its
+// dimension to cover them. Returns the number of cells added.
+std::size_t splice_rows(std::string &xml, const std::vector<std::vector<value>> &rows)
+{
+    auto sheet_data = find_start_tag(xml, "sheetData", 0, xml.size());
+    auto start_tag_end = sheet_data == std::string::npos ? sheet_data : xml.find('>', sheet_data);
+
+    if(start_tag_end == std::string::npos)
+    {
+        throw std::runtime_error("worksheet has no sheetData");
+    }
+
+    bool empty_element = xml[start_tag_end - 1] == '/';
+    auto close = empty_element ? start_tag_end : xml.find("</sheetData>", start_tag_end);
+
+    if(close == std::string::npos)
+    {
+        throw std::runtime_error("worksheet has no sheetData");
+    }
+
+    auto last_row = empty_element ? 0 : find_last_row(xml, start_tag_end, close);
+    column_t min_column = 0;
+    column_t max_column = 0;
+    row_t new_last_row = 0;
+    std::size_t cells = 0;
+    auto rows_xml = write_appended_rows(rows, last_row + 1, min_column, max_column, new_last_row, cells);
+
+    if(cells == 0)
+    {
+        return 0;
+    }
+
+    if(empty_element)
+    {
+        auto tag_end = xml.find_last_not_of(" \t\r\n", start_tag_end - 2) + 1;
+        xml.replace(tag_end, start_tag_end + 1 - tag_end, ">\n" + rows_xml + "\t</sheetData>");
+    }
+    else
+    {
+        // keep the closing tag's indentation, if it's on a line of its own
+        auto line_start = xml.find_last_not_of(" \t", close - 1) + 1;
+        xml.insert(xml[line_start - 1] == '\n' ? line_start : close, rows_xml);
+    }
+
+    // the dimension comes before sheetData, so the insertion didn't move it
+    auto dimension = find_start_tag(xml, "dimension", 0, sheet_data);
+    attribute_span ref;
+
+    if(dimension != std::string::npos && find_attribute(xml, dimension, "ref", ref))
+    {
+        range_reference bounds(min_column - 1, last_row, max_column - 1, new_last_row - 1);
+
+        if(last_row > 0)
+        {
+            range_reference existing(xml.substr(ref.begin, ref.end - ref.begin));
+            bounds = range_reference(std::min(existing.get_top_left().get_column_index(), min_column - 1),
+                std::min(existing.get_top_left().get_row_index(), bounds.get_top_left().get_row_index()),
+                std::max(existing.get_bottom_right().get_column_index(), max_column - 1),
+                new_last_row - 1);
+        }
+
+        xml.replace(ref.begin, ref.end - ref.begin, bounds.to_string());
+    }
+
+    return cells;
+}
+
+// Appends strings [first, strings.size()) to the shared string part xml as
+// plain text entries and updates its counts. The entries already there are
+// kept byte for byte, so rich text runs in them survive.
+void append_shared_strings(std::string &xml, const std::vector<std::string> &strings, std::size_t first)
+{
+    auto sst = find_start_tag(xml, "sst", 0, xml.size());
+    auto start_tag_end = sst == std::string::npos ? sst : xml.find('>', sst);
+
+    if(start_tag_end == std::string::npos)
+    {
+        throw std::runtime_error("shared string table has no sst");
+    }
+
+    std::string entries;
+    detail::xml_emitter emitter(entries);
+
+    for(std::size_t i = first; i < strings.size(); i++)
+    {
+        const auto &string = strings[i];
+        emitter.start_element("si", 1);
+        emitter.end_start_tag();
+        emitter.start_element("t", 2);
+
+        if(!string.empty() && (std::isspace(static_cast<unsigned char>(string.front())) || std::isspace(static_cast<unsigned char>(string.back()))))
+        {
+            emitter.attribute("xml:space", "preserve");
+        }
+
+        emitter.text("t", string.c_str());
+        emitter.end_element("si", 1);
+    }
+
+    if(xml[start_tag_end - 1] == '/')
+    {
+        auto tag_end = xml.find_last_not_of(" \t\r\n", start_tag_end - 2) + 1;
+        xml.replace(tag_end, start_tag_end + 1 - tag_end, ">\n" + entries + "</sst>");
+    }
+    else
+    {
+        auto close = xml.rfind("</sst>");
+
+        if(close == std::string::npos || close < start_tag_end)
+        {
+            throw std::runtime_error("shared string table has no sst");
+        }
+
+        xml.insert(close, xml[close - 1] == '\n' ? entries : "\n" + entries);
+    }
+
+    attribute_span span;
+
+    if(find_attribute(xml, sst, "uniqueCount", span))
+    {
+        xml.replace(span.begin, span.end - span.begin, std::to_string(strings.size()));
+    }
+
+    // count is the number of references to the strings, which rewritten sheets
+    // change. It's optional, so it is dropped rather than left wrong.
+    if(find_attribute(xml, sst, "count", span))
+    {
+        auto name = xml.rfind("count", span.begin);
+        auto attribute_start = xml.find_last_not_of(" \t\r\n", name - 1) + 1;
+        xml.erase(attribute_start, span.end + 1 - attribute_start);
+    }
+}
+
+// Everything of a snapshot except its sheets
+void copy_snapshot_settings(const detail::snapshot_impl &snapshot, detail::workbook_impl &d)
+{
+    d.active_sheet_index_ = snapshot.active_sheet_index_;
+    d.relationships_ = snapshot.relationships_;
+    d.drawings_ = snapshot.drawings_;
+    d.properties_ = snapshot.properties_;
+    d.guess_types_ = snapshot.guess_types_;
+    d.data_only_ = snapshot.data_only_;
+    d.lazy_shared_strings_ = snapshot.lazy_shared_strings_;
+    d.calculate_on_save_ = snapshot.calculate_on_save_;
+    d.source_archive_ = snapshot.source_archive_;
+    d.source_xfs_ = snapshot.source_xfs_;
+    d.rebuild_indexes();
+}
+
+// Fill d with the sheets of a snapshot as they were when it was taken, to be saved
+// in place rather than copied. Sheets keep the workbook the snapshot was taken of
+// as their parent. The slots of sheets it still shares stay locked in locks, so
+// that its next write to one of them waits until they are released.
+void share_snapshot_sheets(const detail::snapshot_impl &snapshot, detail::workbook_impl &d, std::vector<std::unique_lock<std::mutex>> &locks)
+{
+    d.worksheets_.clear();
+
+    for(auto &slot : snapshot.sheets_)
+    {
+        std::unique_lock<std::mutex> lock(slot->mutex_);
+
+        if(slot->copy_)
+        {
+            // a copy never changes once it is made; the alias keeps its slot alive
+            d.worksheets_.push_back(std::shared_ptr<detail::worksheet_impl>(slot, slot->copy_.get()));
+        }
+        else
+        {
+            d.worksheets_.push_back(slot->source_);
+            locks.push_back(std::move(lock));
+        }
+    }
+
+    copy_snapshot_settings(snapshot, d);
+
+    // workbook::snapshot has already calculated
+    d.read_only_ = true;
+}
+
+// Treats every sheet as read-only on this thread while it lives (see detail::SavingSnapshot)
+class saving_snapshot
+{
+public:
+    saving_snapshot()
+    {
+        detail::SavingSnapshot = true;
+    }
+
+    ~saving_snapshot()
+    {
+        detail::SavingSnapshot = false;
+    }
+};
+
+} // namespace
+
 namespace detail {
 
-workbook_impl::workbook_impl() : active_sheet_index_(0), guess_types_(false), data_only_(false)
+workbook_impl::workbook_impl() : active_sheet_index_(0), guess_types_(false), data_only_(false), lazy_shared_strings_(false), calculate_on_save_(true), read_only_(false), first_free_sheet_number_(1)
 {
     
 }
 
+worksheet_impl *workbook_impl::find_sheet(const std::string &title) const
+{
+    auto match = sheet_titles_.find(title);
+    return match == sheet_titles_.end() ? nullptr : match->second;
+}
+
+void workbook_impl::index_sheet(worksheet_impl *ws)
+{
+    formulas_.invalidate();
+
+    sheet_titles_.emplace(ws->title_, ws);
+
+    for(auto &named_range : ws->named_ranges_)
+    {
+        named_range_owners_.emplace(named_range.first, ws);
+    }
+}
+
+void workbook_impl::unindex_sheet(worksheet_impl *ws)
+{
+    formulas_.invalidate();
+
+    auto title = sheet_titles_.find(ws->title_);
+
+    if(title != sheet_titles_.end() && title->second == ws)
+    {
+        sheet_titles_.erase(title);
+        first_free_sheet_number_ = 1;
+
+        // another sheet may have the same title
+        for(auto &other : worksheets_)
+        {
+            if(other.get() != ws && other->title_ == ws->title_)
+            {
+                sheet_titles_.emplace(ws->title_, other.get());
+                break;
+            }
+        }
+    }
+
+    for(auto &named_range : ws->named_ranges_)
+    {
+        unindex_named_range(named_range.first, ws);
+    }
+}
+
+void workbook_impl::rename_sheet(worksheet_impl *ws, const std::string &title)
+{
+    formulas_.invalidate();
+
+    auto match = sheet_titles_.find(ws->title_);
+
+    if(match != sheet_titles_.end() && match->second == ws)
+    {
+        sheet_titles_.erase(match);
+        first_free_sheet_number_ = 1;
+
+        for(auto &other : worksheets_)
+        {
+            if(other.get() != ws && other->title_ == ws->title_)
+            {
+                sheet_titles_.emplace(ws->title_, other.get());
+                break;
+            }
+        }
+    }
+
+    ws->title_ = title;
+    sheet_titles_.emplace(title, ws);
+}
+
+worksheet_impl *workbook_impl::find_named_range_owner(const std::string &name) const
+{
+    auto match = named_range_owners_.find(name);
+    return match == named_range_owners_.end() ? nullptr : match->second;
+}
+
+void workbook_impl::index_named_range(const std::string &name, worksheet_impl *ws)
+{
+    formulas_.invalidate();
+
+    named_range_owners_.emplace(name, ws);
+}
+
+void workbook_impl::unindex_named_range(const std::string &name, worksheet_impl *ws)
+{
+    formulas_.invalidate();
+
+    auto match = named_range_owners_.find(name);
+
+    if(match == named_range_owners_.end() || match->second != ws)
+    {
+        return;
+    }
+
+    named_range_owners_.erase(match);
+
+    // another sheet may define the same name
+    for(auto &other : worksheets_)
+    {
+        if(other.get() != ws && other->named_ranges_.find(name) != other->named_ranges_.end())
+        {
+            named_range_owners_.emplace(name, other.get());
+            break;
+        }
+    }
+}
+
+const relationship *workbook_impl::find_relationship(const std::string &id) const
+{
+    auto match = relationship_ids_.find(id);
+    return match == relationship_ids_.end() ? nullptr : &relationships_[match->second];
+}
+
+void workbook_impl::add_relationship(const relationship &rel)
+{
+    relationships_.push_back(rel);
+    relationship_ids_.emplace(rel.get_id(), relationships_.size() - 1);
+}
+
+void workbook_impl::rebuild_indexes()
+{
+    sheet_titles_.clear();
+    named_range_owners_.clear();
+    relationship_ids_.clear();
+    first_free_sheet_number_ = 1;
+
+    for(auto &ws : worksheets_)
+    {
+        index_sheet(ws.get());
+    }
+
+    for(std::size_t i = 0; i < relationships_.size(); i++)
+    {
+        relationship_ids_.emplace(relationships_[i].get_id(), i);
+    }
+}
+
 } // namespace detail
     
 workbook::workbook() : d_(new detail::workbook_impl())
@@ -131,61 +933,59 @@ bool workbook::const_iterator::operator==(const const_iterator &comparand) const
     
 worksheet workbook::get_sheet_by_name(const std::string &name)
 {
-    for(auto &impl : d_->worksheets_)
-    {
-        if(impl.title_ == name)
-        {
-            return worksheet(&impl);
-        }
-    }
-
-    return worksheet();
+    detail::structure_lock lock(d_->structure_mutex_);
+    auto match = d_->find_sheet(name);
+    return match == nullptr ? worksheet() : worksheet(match);
 }
 
 worksheet workbook::get_sheet_by_index(std::size_t index)
 {
-    return worksheet(&d_->worksheets_[index]);
+    detail::structure_lock lock(d_->structure_mutex_);
+    return worksheet(d_->worksheets_[index].get());
 }
     
 const worksheet workbook::get_sheet_by_index(std::size_t index) const
 {
-    return worksheet(&d_->worksheets_.at(index));
+    detail::structure_lock lock(d_->structure_mutex_);
+    return worksheet(d_->worksheets_.at(index).get());
 }
 
 worksheet workbook::get_active_sheet()
 {
-    return worksheet(&d_->worksheets_[d_->active_sheet_index_]);
+    detail::structure_lock lock(d_->structure_mutex_);
+    return worksheet(d_->worksheets_[d_->active_sheet_index_].get());
 }
 
 bool workbook::has_named_range(const std::string &name) const
 {
-    for(auto worksheet : *this)
-    {
-        if(worksheet.has_named_range(name))
-        {
-            return true;
-        }
-    }
-    return false;
+    detail::structure_lock lock(d_->structure_mutex_);
+    return d_->find_named_range_owner(name) != nullptr;
 }
 
 worksheet workbook::create_sheet()
 {   
-    std::string title = "Sheet1";
-    int index = 1;
+    check_writable(*d_);
+    detail::structure_lock lock(d_->structure_mutex_);
+    int index = d_->first_free_sheet_number_;
+    std::string title = "Sheet" + std::to_string(index);
 
-    while(get_sheet_by_name(title) != nullptr)
+    while(d_->find_sheet(title) != nullptr)
     {
         title = "Sheet" + std::to_string(++index);
     }
 
-    d_->worksheets_.push_back(detail::worksheet_impl(this, title));
+    d_->first_free_sheet_number_ = index + 1;
+
+    d_->worksheets_.emplace_back(new detail::worksheet_impl(this, title));
+    d_->index_sheet(d_->worksheets_.back().get());
     create_relationship("rId" + std::to_string(d_->relationships_.size() + 1), "worksheets/sheet" + std::to_string(d_->worksheets_.size()) + ".xml", relationship::type::worksheet);
-    return worksheet(&d_->worksheets_.back());
+    return worksheet(d_->worksheets_.back().get());
 }
 
 void workbook::add_sheet(xlnt::worksheet worksheet)
 {
+    check_writable(*d_);
+    detail::structure_lock lock(d_->structure_mutex_);
     for(auto ws : *this)
     {
         if(worksheet == ws)
@@ -194,17 +994,22 @@ void workbook::add_sheet(xlnt::worksheet worksheet)
         }
     }
     
-    d_->worksheets_.emplace_back(*worksheet.d_);
+    d_->worksheets_.emplace_back(new detail::worksheet_impl(*worksheet.d_));
+    // the copy may come from another workbook
+    d_->worksheets_.back()->parent_ = this;
+    d_->index_sheet(d_->worksheets_.back().get());
 }
 
 void workbook::add_sheet(xlnt::worksheet worksheet, std::size_t index)
 {
+    detail::structure_lock lock(d_->structure_mutex_);
     add_sheet(worksheet);
     std::swap(d_->worksheets_[index], d_->worksheets_.back());
 }
 
 int workbook::get_index(xlnt::worksheet worksheet)
 {
+    detail::structure_lock lock(d_->structure_mutex_);
     int i = 0;
     for(auto ws : *this)
     {
@@ -230,29 +1035,28 @@ void workbook::create_named_range(const std::string &name, worksheet range_owner
 
 void workbook::remove_named_range(const std::string &name)
 {
-    for(auto ws : *this)
+    detail::structure_lock lock(d_->structure_mutex_);
+    auto owner = d_->find_named_range_owner(name);
+
+    if(owner == nullptr)
     {
-        if(ws.has_named_range(name))
-        {
-            ws.remove_named_range(name);
-            return;
-        }
+        throw std::runtime_error("named range not found");
     }
-    
-    throw std::runtime_error("named range not found");
+
+    worksheet(owner).remove_named_range(name);
 }
 
 range workbook::get_named_range(const std::string &name)
 {
-    for(auto ws : *this)
+    detail::structure_lock lock(d_->structure_mutex_);
+    auto owner = d_->find_named_range_owner(name);
+
+    if(owner == nullptr)
     {
-        if(ws.has_named_range(name))
-        {
-            return ws.get_named_range(name);
-        }
+        throw std::runtime_error("named range not found");
     }
-    
-    throw std::runtime_error("named range not found");
+
+    return worksheet(owner).get_named_range(name);
 }
 
 bool workbook::load(const std::istream &stream)
@@ -286,17 +1090,37 @@ bool workbook::load(const std::vector<unsigned char> &data)
 
 bool workbook::load(const std::string &filename)
 {
-    zip_file f;
+    return load(filename, nullptr);
+}
+
+bool workbook::load(const std::string &filename, io_metrics &metrics)
+{
+    return load(filename, &metrics);
+}
+
+bool workbook::load(const std::string &filename, io_metrics *metrics)
+{
+    detail::trace_scope load_trace("load", "workbook", filename);
+    const auto load_start = metrics_clock::now();
+    const auto first_phase = metrics == nullptr ? 0 : metrics->phases.size();
+
+    // kept after loading, see workbook_impl::source_archive_
+    auto archive = std::make_shared<zip_file>();
+    auto &f = *archive;
+
+    auto start = metrics_clock::now();
 
     try
     {
         f.load(filename);
     }
-    catch(std::exception e)
+    catch(const std::exception &)
     {
         throw invalid_file_exception(filename);
     }
 
+    record_phase(metrics, "open", filename, start);
+
     auto content_types = reader::read_content_types(f);
     auto type = reader::determine_document_type(content_types);
 
@@ -307,15 +1131,18 @@ bool workbook::load(const std::string &filename)
     
     clear();
     
+    start = metrics_clock::now();
     auto workbook_relationships = reader::read_relationships(f, "xl/workbook.xml");
+    std::unordered_map<std::string, std::string> sheet_parts;
 
     for(auto relationship : workbook_relationships)
     {
-        create_relationship(relationship.get_id(), relationship.get_target_uri(), relationship.get_type());
+        sheet_parts.emplace(relationship.get_id(), relationship.get_target_uri());
     }
     
     pugi::xml_document doc;
     doc.load(f.read("xl/workbook.xml").c_str());
+    record_phase(metrics, "read_workbook", "xl/workbook.xml", start);
     
     auto root_node = doc.child("workbook");
     
@@ -324,17 +1151,43 @@ bool workbook::load(const std::string &filename)
     
     auto sheets_node = root_node.child("sheets");
     
-    std::vector<std::string> shared_strings;
+    detail::shared_string_table shared_strings;
+    std::shared_ptr<detail::lazy_shared_string_table> lazy_strings;
     if(f.has_file("xl/sharedStrings.xml"))
     {
-        shared_strings = xlnt::reader::read_shared_string(f.read("xl/sharedStrings.xml"));
+        auto xml = read_part(f, "xl/sharedStrings.xml", metrics);
+        auto xml_size = xml.size();
+        start = metrics_clock::now();
+        detail::trace_scope shared_strings_trace("read_shared_strings", "shared_strings");
+
+        // type guessing has to look at every string anyway
+        if(d_->lazy_shared_strings_ && !d_->guess_types_)
+        {
+            lazy_strings = std::make_shared<detail::lazy_shared_string_table>();
+            lazy_strings->load(std::move(xml));
+        }
+        else
+        {
+            shared_strings.load(xml.data(), xml.size());
+        }
+
+        auto index = record_phase(metrics, "read_shared_strings", "xl/sharedStrings.xml", start);
+
+        if(metrics != nullptr)
+        {
+            metrics->phases[index].uncompressed_bytes = xml_size;
+            metrics->phases[index].strings = lazy_strings != nullptr ? lazy_strings->size() : shared_strings.size();
+        }
     }
 
     std::vector<int> number_format_ids;
     if(f.has_file("xl/styles.xml"))
     {
+        auto xml = read_part(f, "xl/styles.xml", metrics);
+        start = metrics_clock::now();
+        detail::trace_scope styles_trace("read_styles", "styles");
         pugi::xml_document styles_doc;
-        styles_doc.load(f.read("xl/styles.xml").c_str());
+        styles_doc.load(xml.c_str());
         auto stylesheet_node = styles_doc.child("styleSheet");
         auto cell_xfs_node = stylesheet_node.child("cellXfs");
 
@@ -342,21 +1195,81 @@ bool workbook::load(const std::string &filename)
         {
             number_format_ids.push_back(xf_node.attribute("numFmtId").as_int());
         }
+
+        record_phase(metrics, "read_styles", "xl/styles.xml", start);
     }
+
+    // resolved once here rather than for every styled cell
+    auto xfs = std::make_shared<detail::xf_table>(number_format_ids);
     
     for(auto sheet_node : sheets_node.children("sheet"))
     {
         std::string relation_id = sheet_node.attribute("r:id").as_string();
         auto ws = create_sheet(sheet_node.attribute("name").as_string());
-        auto sheet_filename = get_relationship(relation_id).get_target_uri();
-        xlnt::reader::read_worksheet(ws, f.read(sheet_filename).c_str(), shared_strings, number_format_ids);
+        auto sheet_part = sheet_parts.find(relation_id);
+
+        if(sheet_part == sheet_parts.end())
+        {
+            throw std::runtime_error("missing relationship " + relation_id);
+        }
+
+        auto sheet_filename = sheet_part->second;
+        auto xml = read_part(f, sheet_filename, metrics);
+        start = metrics_clock::now();
+
+        {
+            detail::trace_scope worksheet_trace("read_worksheet", "worksheet", ws.d_->title_);
+            ws.d_->lazy_strings_ = lazy_strings;
+            xlnt::reader::read_worksheet(ws, xml, shared_strings, xfs);
+        }
+
+        auto index = record_phase(metrics, "read_worksheet", sheet_filename, start);
+
+        if(metrics != nullptr)
+        {
+            metrics->phases[index].uncompressed_bytes = xml.size();
+            metrics->phases[index].cells = count_cells(*ws.d_);
+            metrics->phases[index].peak_cell_bytes = ws.d_->arena_.get_peak_bytes();
+        }
+
+        ws.d_->source_archive_ = archive;
+        ws.d_->source_part_ = sheet_filename;
+        ws.d_->changed_since_load_ = false;
+        ws.d_->styles_changed_ = false;
+    }
+
+    // create_sheet gave each sheet a relationship in the form save expects
+    // (relative to xl/ and numbered by position). Of the others, only keep the
+    // ones save writes parts for, under ids that can't collide with those.
+    for(auto relationship : workbook_relationships)
+    {
+        auto type = relationship.get_type();
+
+        if(type == relationship::type::shared_strings || type == relationship::type::styles || type == relationship::type::theme)
+        {
+            auto target = relationship.get_target_uri();
+
+            if(target.compare(0, 3, "xl/") == 0)
+            {
+                target = target.substr(3);
+            }
+
+            create_relationship("rId" + std::to_string(d_->relationships_.size() + 1), target, type);
+        }
     }
 
+    d_->source_archive_ = archive;
+    d_->source_xfs_ = xfs;
+    d_->formulas_.loaded(*d_);
+
+    summarize(metrics, first_phase, load_start);
+
     return true;
 }
 
 void workbook::set_guess_types(bool guess)
 {
+    check_writable(*d_);
     d_->guess_types_ = guess;
 }
 
@@ -367,37 +1280,43 @@ bool workbook::get_guess_types() const
 
 void workbook::create_relationship(const std::string &id, const std::string &target, relationship::type type)
 {
-    d_->relationships_.push_back(relationship(type, id, target));
+    check_writable(*d_);
+    detail::structure_lock lock(d_->structure_mutex_);
+    d_->add_relationship(relationship(type, id, target));
 }
 
 relationship workbook::get_relationship(const std::string &id) const
 {
-    for(auto &rel : d_->relationships_)
+    detail::structure_lock lock(d_->structure_mutex_);
+    auto match = d_->find_relationship(id);
+
+    if(match == nullptr)
     {
-        if(rel.get_id() == id)
-        {
-            return rel;
-        }
+        throw std::runtime_error("");
     }
 
-    throw std::runtime_error("");
+    return *match;
 }
     
 void workbook::remove_sheet(worksheet ws)
 {
-    auto match_iter = std::find_if(d_->worksheets_.begin(), d_->worksheets_.end(), [=](detail::worksheet_impl &comp) { return worksheet(&comp) == ws; });
+    check_writable(*d_);
+    detail::structure_lock lock(d_->structure_mutex_);
+    auto match_iter = std::find_if(d_->worksheets_.begin(), d_->worksheets_.end(), [=](const std::shared_ptr<detail::worksheet_impl> &comp) { return worksheet(comp.get()) == ws; });
 
     if(match_iter == d_->worksheets_.end())
     {
         throw std::runtime_error("worksheet not owned by this workbook");
     }
 
-    
+    auto removed = *match_iter;
     d_->worksheets_.erase(match_iter);
+    d_->unindex_sheet(removed.get());
 }
 
 worksheet workbook::create_sheet(std::size_t index)
 {
+    detail::structure_lock lock(d_->structure_mutex_);
     create_sheet();
     
     if(index != d_->worksheets_.size())
@@ -405,11 +1324,12 @@ worksheet workbook::create_sheet(std::size_t index)
         std::swap(d_->worksheets_[index], d_->worksheets_.back());
     }
     
-    return worksheet(&d_->worksheets_[index]);
+    return worksheet(d_->worksheets_[index].get());
 }
 
 worksheet workbook::create_sheet(std::size_t index, const std::string &title)
 {
+    detail::structure_lock lock(d_->structure_mutex_);
     auto ws = create_sheet(index);
     ws.set_title(title);
     
@@ -429,13 +1349,14 @@ worksheet workbook::create_sheet(const std::string &title)
         throw sheet_title_exception(title);
     }
     
+    detail::structure_lock lock(d_->structure_mutex_);
     std::string unique_title = title;
     
-    if(std::find_if(d_->worksheets_.begin(), d_->worksheets_.end(), [&](detail::worksheet_impl &ws) { return worksheet(&ws).get_title() == unique_title; }) != d_->worksheets_.end())
+    if(d_->find_sheet(unique_title) != nullptr)
     {
         std::size_t suffix = 1;
         
-        while(std::find_if(d_->worksheets_.begin(), d_->worksheets_.end(), [&](detail::worksheet_impl &ws) { return worksheet(&ws).get_title() == unique_title; }) != d_->worksheets_.end())
+        while(d_->find_sheet(unique_title) != nullptr)
         {
             unique_title = title + std::to_string(suffix);
             suffix++;
@@ -455,6 +1376,7 @@ workbook::iterator workbook::begin()
 
 workbook::iterator workbook::end()
 {
+    detail::structure_lock lock(d_->structure_mutex_);
     return iterator(*this, d_->worksheets_.size());
 }
 
@@ -465,11 +1387,13 @@ workbook::const_iterator workbook::cbegin() const
 
 workbook::const_iterator workbook::cend() const
 {
+    detail::structure_lock lock(d_->structure_mutex_);
     return const_iterator(*this, d_->worksheets_.size());
 }
 
 std::vector<std::string> workbook::get_sheet_names() const
 {
+    detail::structure_lock lock(d_->structure_mutex_);
     std::vector<std::string> names;
     
     for(auto ws : *this)
@@ -487,16 +1411,41 @@ worksheet workbook::operator[](const std::string &name)
 
 worksheet workbook::operator[](std::size_t index)
 {
-    return worksheet(&d_->worksheets_[index]);
+    detail::structure_lock lock(d_->structure_mutex_);
+    return worksheet(d_->worksheets_[index].get());
+}
+
+std::size_t workbook::calculate()
+{
+    check_writable(*d_);
+    detail::structure_lock lock(d_->structure_mutex_);
+    return d_->formulas_.calculate(*d_);
+}
+
+void workbook::set_calculation_threads(std::size_t threads)
+{
+    detail::structure_lock lock(d_->structure_mutex_);
+    d_->formulas_.set_threads(threads);
+}
+
+std::size_t workbook::get_calculation_threads() const
+{
+    detail::structure_lock lock(d_->structure_mutex_);
+    return d_->formulas_.get_threads();
 }
 
 void workbook::clear()
 {
+    check_writable(*d_);
+    detail::structure_lock lock(d_->structure_mutex_);
     d_->worksheets_.clear();
     d_->relationships_.clear();
+    d_->rebuild_indexes();
     d_->active_sheet_index_ = 0;
     d_->drawings_.clear();
     d_->properties_ = document_properties();
+    d_->source_archive_.reset();
+    d_->source_xfs_.reset();
 }
 
 bool workbook::save(std::vector<unsigned char> &data)
@@ -516,57 +1465,348 @@ bool workbook::save(std::vector<unsigned char> &data)
 
 bool workbook::save(const std::string &filename)
 {
+    return save(filename, nullptr);
+}
+
+bool workbook::save(const std::string &filename, io_metrics &metrics)
+{
+    return save(filename, &metrics);
+}
+
+bool workbook::save(const std::string &filename, io_metrics *metrics)
+{
+    detail::trace_scope save_trace("save", "workbook", filename);
+    const auto save_start = metrics_clock::now();
+    const auto first_phase = metrics == nullptr ? 0 : metrics->phases.size();
+
+    // stores the values of formulas; read-only workbooks are saved as they are
+    if(d_->calculate_on_save_ && !d_->read_only_)
+    {
+        auto start = metrics_clock::now();
+
+        {
+            detail::trace_scope trace("calculate", "workbook");
+            calculate();
+        }
+
+        record_phase(metrics, "calculate", filename, start);
+    }
+
     zip_file f;
 
-	f.writestr("[Content_Types].xml", writer::write_content_types(*this));
-    
-    f.writestr("docProps/app.xml", writer::write_properties_app(*this));
-    f.writestr("docProps/core.xml", writer::write_properties_core(get_properties()));
+    write_part(f, "[Content_Types].xml", [&]() { return writer::write_content_types(*this); }, metrics);
     
-    std::set<std::string> shared_strings_set;
+    write_part(f, "docProps/app.xml", [&]() { return writer::write_properties_app(*this); }, metrics);
+    write_part(f, "docProps/core.xml", [&]() { return writer::write_properties_core(get_properties()); }, metrics);
     
-    for(auto ws : *this)
+    // Which sheets are worth serializing again has to be decided before anything
+    // below touches them, since even reading through non-const handles counts
+    // as a change.
+    auto sheet_parts = get_sheet_parts(*d_);
+    auto reusable = find_reusable_sheets(*d_, sheet_parts);
+    bool reuse_any = std::find(reusable.begin(), reusable.end(), true) != reusable.end();
+
+    auto start = metrics_clock::now();
+    std::vector<std::string> shared_strings;
+    bool shared_strings_changed = true;
+    // when sheets are copied, the source's string table, which new strings are appended to
+    std::string source_strings_xml;
+    std::size_t source_string_count = 0;
+
     {
-        for(auto row : ws.rows())
+        detail::trace_scope trace("collect_shared_strings", "shared_strings");
+
+        if(reuse_any)
+        {
+            // Copied sheets index into the source's string table, so it is kept
+            // as is and only strings it doesn't have are appended.
+            auto &source = *d_->source_archive_;
+            std::unordered_map<std::string, std::size_t> known;
+
+            if(source.has_file("xl/sharedStrings.xml"))
+            {
+                source_strings_xml = source.read("xl/sharedStrings.xml");
+                const auto &xml = source_strings_xml;
+                detail::shared_string_table source_strings;
+                source_strings.load(xml.data(), xml.size());
+                source_string_count = source_strings.size();
+                shared_strings.reserve(source_strings.size());
+
+                for(std::size_t i = 0; i < source_strings.size(); i++)
+                {
+                    shared_strings.push_back(std::string(source_strings.data(i), source_strings.length(i)));
+                    known.emplace(shared_strings.back(), i);
+                }
+            }
+
+            shared_strings_changed = !source.has_file("xl/sharedStrings.xml");
+
+            for(std::size_t i = 0; i < d_->worksheets_.size(); i++)
+            {
+                if(reusable[i])
+                {
+                    continue;
+                }
+
+                for(auto row : worksheet(d_->worksheets_[i].get()).rows())
+                {
+                    for(auto cell : row)
+                    {
+                        if(cell.get_value().is(value::type::string))
+                        {
+                            const auto &string_value = cell.get_value().get<std::string>();
+
+                            if(known.emplace(string_value, shared_strings.size()).second)
+                            {
+                                shared_strings.push_back(string_value);
+                                shared_strings_changed = true;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        else
         {
-            for(auto cell : row)
+            std::set<std::string> shared_strings_set;
+
+            for(auto ws : *this)
             {
-                if(cell.get_value().is(value::type::string))
+                for(auto row : ws.rows())
                 {
-                    shared_strings_set.insert(cell.get_value().get<std::string>());
+                    for(auto cell : row)
+                    {
+                        if(cell.get_value().is(value::type::string))
+                        {
+                            shared_strings_set.insert(cell.get_value().get<std::string>());
+                        }
+                    }
                 }
             }
+
+            shared_strings.assign(shared_strings_set.begin(), shared_strings_set.end());
         }
     }
+
+    auto index = record_phase(metrics, "collect_shared_strings", "xl/sharedStrings.xml", start);
+
+    if(metrics != nullptr)
+    {
+        metrics->phases[index].strings = shared_strings.size();
+    }
+
+    if(shared_strings_changed && !source_strings_xml.empty())
+    {
+        // the source's entries may hold rich text, which shared_strings has lost
+        write_part(f, "xl/sharedStrings.xml", [&]()
+        {
+            append_shared_strings(source_strings_xml, shared_strings, source_string_count);
+            return std::move(source_strings_xml);
+        }, metrics);
+    }
+    else if(shared_strings_changed)
+    {
+        write_part(f, "xl/sharedStrings.xml", [&]() { return writer::write_shared_strings(shared_strings); }, metrics);
+    }
+    else
+    {
+        copy_part(f, *d_->source_archive_, "xl/sharedStrings.xml", metrics);
+    }
     
-    std::vector<std::string> shared_strings(shared_strings_set.begin(), shared_strings_set.end());
-    f.writestr("xl/sharedStrings.xml", writer::write_shared_strings(shared_strings));
-    
-    f.writestr("xl/theme/theme1.xml", writer::write_theme());
-    f.writestr("xl/styles.xml", style_writer(*this).write_table());
+    write_part(f, "xl/theme/theme1.xml", [&]() { return writer::write_theme(); }, metrics);
+
+    // the style indices in copied sheets refer to the source's cellXfs, and
+    // sheets serialized again then use them too (see find_reusable_sheets)
+    bool copy_styles = reuse_any && d_->source_xfs_ != nullptr && d_->source_archive_->has_file("xl/styles.xml");
+
+    if(copy_styles)
+    {
+        copy_part(f, *d_->source_archive_, "xl/styles.xml", metrics);
+    }
+    else
+    {
+        write_part(f, "xl/styles.xml", [&]()
+        {
+            detail::trace_scope trace("write_styles", "styles");
+            return style_writer(*this).write_table();
+        }, metrics);
+    }
     
-    f.writestr("_rels/.rels", writer::write_root_rels());
-    f.writestr("xl/_rels/workbook.xml.rels", writer::write_workbook_rels(*this));
+    write_part(f, "_rels/.rels", [&]() { return writer::write_root_rels(); }, metrics);
+    write_part(f, "xl/_rels/workbook.xml.rels", [&]() { return writer::write_workbook_rels(*this); }, metrics);
 
-    f.writestr("xl/workbook.xml", writer::write_workbook(*this));
+    write_part(f, "xl/workbook.xml", [&]() { return writer::write_workbook(*this); }, metrics);
     
-    for(auto relationship : d_->relationships_)
+    for(const auto &sheet_part : sheet_parts)
     {
-        if(relationship.get_type() == relationship::type::worksheet)
+        auto sheet_index = sheet_part.first;
+        const auto &sheet_uri = sheet_part.second;
+
+        if(reusable[sheet_index])
         {
-            std::string sheet_index_string = relationship.get_target_uri().substr(16);
-            std::size_t sheet_index = std::stoi(sheet_index_string.substr(0, sheet_index_string.find('.'))) - 1;
-            std::string sheet_uri = "xl/" + relationship.get_target_uri();
-            auto ws = get_sheet_by_index(sheet_index);
-            f.writestr(sheet_uri, writer::write_worksheet(ws, shared_strings));
+            copy_part(f, *d_->source_archive_, sheet_uri, metrics);
+            continue;
         }
+
+        auto ws = get_sheet_by_index(sheet_index);
+        auto cells = metrics == nullptr ? 0 : count_cells(*ws.d_);
+        write_part(f, sheet_uri, [&]() -> std::string
+        {
+            detail::trace_scope trace("write_worksheet", "worksheet", ws.d_->title_);
+
+            if(copy_styles)
+            {
+                return writer::write_worksheet(ws, shared_strings, *d_->source_xfs_);
+            }
+
+            return writer::write_worksheet(ws, shared_strings);
+        }, metrics, "write_worksheet", cells);
+    }
+
+    start = metrics_clock::now();
+
+    {
+        detail::trace_scope trace("write_archive", "zip", filename);
+        f.save(filename);
     }
 
-    f.save(filename);
+    index = record_phase(metrics, "zip_save", filename, start);
+
+    if(metrics != nullptr)
+    {
+        std::ifstream file(filename, std::ios::binary | std::ios::ate);
+        metrics->phases[index].compressed_bytes = static_cast<std::size_t>(file.tellg());
+    }
+
+    summarize(metrics, first_phase, save_start);
 
     return true;
 }
 
+void workbook::append_rows(const std::string &filename, const std::string &sheet_title, const std::vector<std::vector<value>> &rows)
+{
+    append_rows(filename, sheet_title, rows, nullptr);
+}
+
+void workbook::append_rows(const std::string &filename, const std::string &sheet_title, const std::vector<std::vector<value>> &rows, io_metrics &metrics)
+{
+    append_rows(filename, sheet_title, rows, &metrics);
+}
+
+void workbook::append_rows(const std::string &filename, const std::string &sheet_title, const std::vector<std::vector<value>> &rows, io_metrics *metrics)
+{
+    detail::trace_scope append_trace("append_rows", "workbook", filename);
+    const auto append_start = metrics_clock::now();
+    const auto first_phase = metrics == nullptr ? 0 : metrics->phases.size();
+
+    zip_file source;
+    auto start = metrics_clock::now();
+
+    try
+    {
+        source.load(filename);
+    }
+    catch(std::exception &)
+    {
+        throw invalid_file_exception(filename);
+    }
+
+    record_phase(metrics, "open", filename, start);
+
+    start = metrics_clock::now();
+    std::string sheet_part;
+
+    {
+        pugi::xml_document doc;
+        doc.load(source.read("xl/workbook.xml").c_str());
+        std::string relation_id;
+
+        for(auto sheet_node : doc.child("workbook").child("sheets").children("sheet"))
+        {
+            if(sheet_title == sheet_node.attribute("name").as_string())
+            {
+                relation_id = sheet_node.attribute("r:id").as_string();
+                break;
+            }
+        }
+
+        if(relation_id.empty())
+        {
+            throw std::runtime_error("no sheet named " + sheet_title);
+        }
+
+        for(auto relationship : reader::read_relationships(source, "xl/workbook.xml"))
+        {
+            if(relationship.get_id() == relation_id)
+            {
+                sheet_part = relationship.get_target_uri();
+            }
+        }
+
+        if(sheet_part.empty())
+        {
+            throw std::runtime_error("missing relationship " + relation_id);
+        }
+    }
+
+    record_phase(metrics, "read_workbook", "xl/workbook.xml", start);
+
+    auto xml = read_part(source, sheet_part, metrics);
+    start = metrics_clock::now();
+    std::size_t cells = 0;
+
+    {
+        detail::trace_scope trace("splice_rows", "worksheet", sheet_part);
+        cells = splice_rows(xml, rows);
+    }
+
+    auto index = record_phase(metrics, "append_rows", sheet_part, start);
+
+    if(metrics != nullptr)
+    {
+        metrics->phases[index].uncompressed_bytes = xml.size();
+        metrics->phases[index].cells = cells;
+    }
+
+    zip_file archive;
+
+    // everything but the sheet keeps its place in the archive and its compressed bytes
+    for(const auto &name : source.namelist())
+    {
+        if(name != sheet_part)
+        {
+            copy_part(archive, source, name, metrics);
+            continue;
+        }
+
+        start = metrics_clock::now();
+        archive.writestr(name, xml);
+        index = record_phase(metrics, "deflate", name, start);
+
+        if(metrics != nullptr)
+        {
+            metrics->phases[index].uncompressed_bytes = xml.size();
+        }
+    }
+
+    start = metrics_clock::now();
+
+    {
+        detail::trace_scope trace("write_archive", "zip", filename);
+        archive.save(filename);
+    }
+
+    index = record_phase(metrics, "zip_save", filename, start);
+
+    if(metrics != nullptr)
+    {
+        std::ifstream file(filename, std::ios::binary | std::ios::ate);
+        metrics->phases[index].compressed_bytes = static_cast<std::size_t>(file.tellg());
+    }
+
+    summarize(metrics, first_phase, append_start);
+}
+
 bool workbook::operator==(std::nullptr_t) const
 {
     return d_.get() == nullptr;
@@ -579,6 +1819,7 @@ bool workbook::operator==(const workbook &rhs) const
 
 std::vector<relationship> xlnt::workbook::get_relationships() const
 {
+    detail::structure_lock lock(d_->structure_mutex_);
 	return d_->relationships_;
 }
  
@@ -647,6 +1888,126 @@ workbook::workbook(const workbook &other) : workbook()
     }
 }
 
+workbook_snapshot workbook::snapshot()
+{
+    detail::structure_lock lock(d_->structure_mutex_);
+    auto snapshot = std::make_shared<detail::snapshot_impl>();
+
+    // the snapshot is saved with the values saving the workbook would store
+    if(d_->calculate_on_save_ && !d_->read_only_)
+    {
+        calculate();
+    }
+
+    for(auto &ws : d_->worksheets_)
+    {
+        // saving the snapshot reads the sheet in place, where decoding a string would change it
+        ws->resolve_lazy_strings();
+
+        auto &shared = ws->snapshots_;
+        shared.erase(std::remove_if(shared.begin(), shared.end(), [](const std::weak_ptr<detail::sheet_slot> &slot) { return slot.expired(); }), shared.end());
+
+        auto slot = std::make_shared<detail::sheet_slot>(ws);
+        shared.push_back(slot);
+        ws->shared_with_snapshot_ = true;
+
+        snapshot->sheets_.push_back(slot);
+        snapshot->titles_.push_back(ws->title_);
+    }
+
+    snapshot->active_sheet_index_ = d_->active_sheet_index_;
+    snapshot->relationships_ = d_->relationships_;
+    snapshot->drawings_ = d_->drawings_;
+    snapshot->properties_ = d_->properties_;
+    snapshot->guess_types_ = d_->guess_types_;
+    snapshot->data_only_ = d_->data_only_;
+    snapshot->lazy_shared_strings_ = d_->lazy_shared_strings_;
+    snapshot->calculate_on_save_ = d_->calculate_on_save_;
+    snapshot->source_archive_ = d_->source_archive_;
+    snapshot->source_xfs_ = d_->source_xfs_;
+
+    return workbook_snapshot(snapshot);
+}
+
+workbook_snapshot::workbook_snapshot(std::shared_ptr<detail::snapshot_impl> d) : d_(d)
+{
+}
+
+workbook workbook_snapshot::to_workbook() const
+{
+    workbook wb;
+    auto &d = *wb.d_;
+
+    d.worksheets_.clear();
+
+    for(auto &slot : d_->sheets_)
+    {
+        d.worksheets_.push_back(slot->copy_sheet());
+    }
+
+    copy_snapshot_settings(*d_, d);
+
+    for(auto ws : wb)
+    {
+        ws.set_parent(wb);
+    }
+
+    return wb;
+}
+
+bool workbook_snapshot::save(const std::string &filename) const
+{
+    std::vector<std::unique_lock<std::mutex>> locks;
+    workbook wb;
+    share_snapshot_sheets(*d_, *wb.d_, locks);
+
+    saving_snapshot saving;
+    return wb.save(filename);
+}
+
+bool workbook_snapshot::save(std::vector<unsigned char> &data) const
+{
+    std::vector<std::unique_lock<std::mutex>> locks;
+    workbook wb;
+    share_snapshot_sheets(*d_, *wb.d_, locks);
+
+    saving_snapshot saving;
+    return wb.save(data);
+}
+
+std::vector<std::string> workbook_snapshot::get_sheet_names() const
+{
+    return d_->titles_;
+}
+
+void workbook::set_read_only(bool read_only)
+{
+    detail::structure_lock lock(d_->structure_mutex_);
+    d_->read_only_ = read_only;
+
+    for(auto &ws : d_->worksheets_)
+    {
+        // reading threads must find nothing left to do: detaching snapshots
+        // and decoding strings on first access would both write to the sheet
+        if(read_only && ws->shared_with_snapshot_)
+        {
+            ws->detach_snapshots();
+        }
+
+        if(read_only && ws->lazy_strings_ != nullptr)
+        {
+            ws->resolve_lazy_strings();
+        }
+
+        ws->read_only_ = read_only;
+    }
+}
+
+bool workbook::is_read_only() const
+{
+    return d_->read_only_;
+}
+
 bool workbook::get_data_only() const
 {
     return d_->data_only_;
@@ -654,7 +2015,30 @@ bool workbook::get_data_only() const
 
 void workbook::set_data_only(bool data_only)
 {
+    check_writable(*d_);
     d_->data_only_ = data_only;
 }
 
+bool workbook::get_calculate_on_save() const
+{
+    return d_->calculate_on_save_;
+}
+
+void workbook::set_calculate_on_save(bool calculate)
+{
+    check_writable(*d_);
+    d_->calculate_on_save_ = calculate;
+}
+
+bool workbook::get_lazy_shared_strings() const
+{
+    return d_->lazy_shared_strings_;
+}
+
+void workbook::set_lazy_shared_strings(bool lazy)
+{
+    check_writable(*d_);
+    d_->lazy_shared_strings_ = lazy;
+}
+
 }
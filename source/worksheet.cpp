@@ -1,4 +1,6 @@
 #include <algorithm>
+#include <cmath>
+#include <limits>
 
 #include <xlnt/worksheet/worksheet.hpp>
 #include <xlnt/cell/cell.hpp>
@@ -10,9 +12,94 @@
 #include <xlnt/workbook/workbook.hpp>
 #include <xlnt/common/exceptions.hpp>
 
+#include "constants.hpp"
+#include "detail/snapshot_impl.hpp"
+#include "detail/workbook_impl.hpp"
 #include "detail/worksheet_impl.hpp"
 
 namespace xlnt {
+namespace detail {
+
+thread_local bool SavingSnapshot = false;
+
+void worksheet_impl::detach_snapshots()
+{
+    for(auto &weak_slot : snapshots_)
+    {
+        auto slot = weak_slot.lock();
+
+        if(slot)
+        {
+            slot->detach();
+        }
+    }
+
+    snapshots_.clear();
+    shared_with_snapshot_ = false;
+}
+
+cell_impl *worksheet_impl::find_cell(column_t column, row_t row)
+{
+    auto row_match = cell_map_.find(row);
+
+    if(row_match == cell_map_.end())
+    {
+        return nullptr;
+    }
+
+    auto match = row_match->second.find(column);
+
+    return match == row_match->second.end() ? nullptr : &match->second;
+}
+
+cell_impl &worksheet_impl::get_or_create_cell(column_t column, row_t row)
+{
+    auto &cells = cell_map_[row];
+    highest_row_ = std::max(highest_row_, row);
+    auto match = cells.find(column);
+
+    if(match == cells.end())
+    {
+        match = cells.emplace(column, cell_impl(this, column, row)).first;
+    }
+
+    return match->second;
+}
+
+void worksheet_impl::resolve_lazy_strings()
+{
+    if(lazy_strings_ == nullptr)
+    {
+        return;
+    }
+
+    for(auto &row : cell_map_)
+    {
+        for(auto &cell : row.second)
+        {
+            cell.second.resolve_value();
+        }
+    }
+
+    lazy_strings_.reset();
+}
+
+cell_impl *worksheet_impl::get_blank_cell(column_t column, row_t row)
+{
+    auto key = (static_cast<std::uint64_t>(row) << 32) | column;
+
+    std::lock_guard<std::mutex> lock(blank_cells_mutex_);
+    auto match = blank_cells_.find(key);
+
+    if(match == blank_cells_.end())
+    {
+        match = blank_cells_.emplace(key, cell_impl(this, column, row)).first;
+    }
+
+    return &match->second;
+}
+
+} // namespace detail
 
 worksheet::worksheet() : d_(nullptr)
 {
@@ -53,7 +140,10 @@ std::string worksheet::unique_sheet_name(const std::string &value) const
 
 void worksheet::create_named_range(const std::string &name, const range_reference &reference)
 {
+    d_->before_write();
+    detail::structure_lock lock(d_->parent_->d_->structure_mutex_);
     d_->named_ranges_[name] = reference;
+    d_->parent_->d_->index_named_range(name, d_);
 }
 
 range worksheet::operator()(const xlnt::cell_reference &top_left, const xlnt::cell_reference &bottom_right)
@@ -68,16 +158,23 @@ cell worksheet::operator[](const cell_reference &ref)
 
 std::vector<range_reference> worksheet::get_merged_ranges() const
 {
-    return d_->merged_cells_;
+    return d_->merged_cells_.get_ranges();
 }
 
 margins &worksheet::get_page_margins()
+{
+    d_->before_write();
+    return d_->page_margins_;
+}
+
+const margins &worksheet::get_page_margins() const
 {
     return d_->page_margins_;
 }
 
 void worksheet::auto_filter(const range_reference &reference)
 {
+    d_->before_write();
     d_->auto_filter_ = reference;
 }
 
@@ -98,10 +195,17 @@ bool worksheet::has_auto_filter() const
 
 void worksheet::unset_auto_filter()
 {
+    d_->before_write();
     d_->auto_filter_ = range_reference(0, 0, 0, 0);
 }
 
 page_setup &worksheet::get_page_setup()
+{
+    d_->before_write();
+    return d_->page_setup_;
+}
+
+const page_setup &worksheet::get_page_setup() const
 {
     return d_->page_setup_;
 }
@@ -118,6 +222,7 @@ workbook &worksheet::get_parent() const
 
 void worksheet::garbage_collect()
 {
+    d_->before_write();
     auto cell_map_iter = d_->cell_map_.begin();
 
     while(cell_map_iter != d_->cell_map_.end())
@@ -145,6 +250,13 @@ void worksheet::garbage_collect()
 
         cell_map_iter++;
     }
+
+    d_->highest_row_ = 0;
+
+    for(auto &row : d_->cell_map_)
+    {
+        d_->highest_row_ = std::max(d_->highest_row_, row.first);
+    }
 }
 
 std::list<cell> worksheet::get_cell_collection()
@@ -171,7 +283,10 @@ std::string worksheet::get_title() const
 
 void worksheet::set_title(const std::string &title)
 {
-    d_->title_ = title;
+    d_->before_write();
+    // other threads may be looking sheets up by title
+    detail::structure_lock lock(d_->parent_->d_->structure_mutex_);
+    d_->parent_->d_->rename_sheet(d_, title);
 }
 
 cell_reference worksheet::get_frozen_panes() const
@@ -181,16 +296,19 @@ cell_reference worksheet::get_frozen_panes() const
 
 void worksheet::freeze_panes(xlnt::cell top_left_cell)
 {
+    d_->before_write();
     d_->freeze_panes_ = top_left_cell.get_reference();
 }
 
 void worksheet::freeze_panes(const std::string &top_left_coordinate)
 {
+    d_->before_write();
     d_->freeze_panes_ = cell_reference(top_left_coordinate);
 }
 
 void worksheet::unfreeze_panes()
 {
+    d_->before_write();
     d_->freeze_panes_ = cell_reference("A1");
 }
 
@@ -206,31 +324,54 @@ const std::unordered_map<row_t, double> &worksheet::get_row_dimensions() const
 
 cell worksheet::get_cell(const cell_reference &reference)
 {
-    if(d_->cell_map_.find(reference.get_row_index()) == d_->cell_map_.end())
+    auto column = reference.get_column_index();
+    auto row = reference.get_row_index();
+    auto existing = d_->find_cell(column, row);
+
+    if(existing != nullptr)
     {
-        d_->cell_map_[reference.get_row_index()] = std::unordered_map<column_t, detail::cell_impl>();
+        return cell(existing);
     }
-    
-    auto &row = d_->cell_map_[reference.get_row_index()];
-    
-    if(row.find(reference.get_column_index()) == row.end())
+
+    if(d_->is_read_only())
     {
-        row[reference.get_column_index()] = detail::cell_impl(d_, reference.get_column_index(), reference.get_row_index());
+        return cell(d_->get_blank_cell(column, row));
     }
-    
-    return cell(&row[reference.get_column_index()]);
+
+    // only creating the cell changes the sheet; writes through the handle are checked by cell
+    d_->before_write();
+
+    return cell(&d_->get_or_create_cell(column, row));
 }
 
 const cell worksheet::get_cell(const cell_reference &reference) const
 {
-    return cell(&d_->cell_map_.at(reference.get_row_index()).at(reference.get_column_index()));
+    auto existing = d_->find_cell(reference.get_column_index(), reference.get_row_index());
+
+    if(existing != nullptr)
+    {
+        return cell(existing);
+    }
+
+    if(d_->is_read_only())
+    {
+        return cell(d_->get_blank_cell(reference.get_column_index(), reference.get_row_index()));
+    }
+
+    throw std::out_of_range("cell " + reference.to_string() + " doesn't exist");
 }
 
 row_properties &worksheet::get_row_properties(row_t row)
 {
+    d_->before_write();
     return d_->row_properties_[row];
 }
 
+const row_properties &worksheet::get_row_properties(row_t row) const
+{
+    return d_->row_properties_.at(row);
+}
+
 bool worksheet::has_row_properties(row_t row) const
 {
     return d_->row_properties_.find(row) != d_->row_properties_.end();
@@ -285,14 +426,7 @@ row_t worksheet::get_lowest_row() const
 
 row_t worksheet::get_highest_row() const
 {
-    row_t highest = 0;
-    
-    for(auto &row : d_->cell_map_)
-    {
-        highest = std::max(highest, (row_t)row.first);
-    }
-    
-    return highest + 1;
+    return d_->highest_row_ + 1;
 }
 
 column_t worksheet::get_highest_column() const
@@ -338,6 +472,7 @@ std::vector<relationship> worksheet::get_relationships()
 
 relationship worksheet::create_relationship(relationship::type type, const std::string &target_uri)
 {
+    d_->before_write();
     std::string r_id = "rId" + std::to_string(d_->relationships_.size() + 1);
     d_->relationships_.push_back(relationship(type, r_id, target_uri));
     return d_->relationships_.back();
@@ -345,50 +480,96 @@ relationship worksheet::create_relationship(relationship::type type, const std::
 
 void worksheet::merge_cells(const range_reference &reference)
 {
-    d_->merged_cells_.push_back(reference);
-    bool first = true;
+    d_->before_write();
+    d_->merged_cells_.add(reference);
 
-    for(auto row : get_range(reference))
+    // Only cells that already exist can hold something to clear, so the rest
+    // of the range is never created. Walk whichever is smaller, the range or
+    // the sheet.
+    auto top_left = reference.get_top_left();
+    auto bottom_right = reference.get_bottom_right();
+    auto first_column = std::min(top_left.get_column_index(), bottom_right.get_column_index());
+    auto last_column = std::max(top_left.get_column_index(), bottom_right.get_column_index());
+    auto first_row = std::min(top_left.get_row_index(), bottom_right.get_row_index());
+    auto last_row = std::max(top_left.get_row_index(), bottom_right.get_row_index());
+
+    auto clear_cells = [&](row_t row, detail::worksheet_impl::cell_row &cells)
     {
-        for(auto cell : row)
+        auto clear_cell = [&](column_t column, detail::cell_impl &impl)
         {
-            cell.set_merged(true);
+            if(column == first_column && row == first_row)
+            {
+                return;
+            }
+
+            cell current(&impl);
+
+            if(current.get_value().is(value::type::string))
+            {
+                current.set_value(value(""));
+            }
+            else
+            {
+                current.set_value(value::null());
+            }
+        };
 
-            if(!first)
+        if(static_cast<std::size_t>(last_column - first_column) < cells.size())
+        {
+            for(auto column = first_column; column <= last_column; column++)
             {
-                if(cell.get_value().is(value::type::string))
+                auto match = cells.find(column);
+
+                if(match != cells.end())
                 {
-                    cell.set_value(value(""));
+                    clear_cell(column, match->second);
                 }
-                else
+            }
+        }
+        else
+        {
+            for(auto &entry : cells)
+            {
+                if(entry.first >= first_column && entry.first <= last_column)
                 {
-                    cell.set_value(value::null());
+                    clear_cell(entry.first, entry.second);
                 }
             }
+        }
+    };
 
-            first = false;
+    if(static_cast<std::size_t>(last_row - first_row) < d_->cell_map_.size())
+    {
+        for(auto row = first_row; row <= last_row; row++)
+        {
+            auto match = d_->cell_map_.find(row);
+
+            if(match != d_->cell_map_.end())
+            {
+                clear_cells(row, match->second);
+            }
+        }
+    }
+    else
+    {
+        for(auto &row : d_->cell_map_)
+        {
+            if(row.first >= first_row && row.first <= last_row)
+            {
+                clear_cells(row.first, row.second);
+            }
         }
     }
 }
 
 void worksheet::unmerge_cells(const range_reference &reference)
 {
-    auto match = std::find(d_->merged_cells_.begin(), d_->merged_cells_.end(), reference);
-    
-    if(match == d_->merged_cells_.end())
+    d_->before_write();
+
+    if(!d_->merged_cells_.remove(reference))
     {
         throw std::runtime_error("cells not merged");
     }
-    
-    d_->merged_cells_.erase(match);
-    
-    for(auto row : get_range(reference))
-    {
-        for(auto cell : row)
-        {
-            cell.set_merged(false);
-        }
-    }
 }
 
 void worksheet::append(const std::vector<std::string> &cells)
@@ -472,6 +653,269 @@ void worksheet::append(const std::unordered_map<int, std::string> &cells)
     }
 }
 
+namespace {
+
+// Rows [first_row, first_row + count) in column must all be addressable
+void check_column_run(const cell_reference &first_cell, std::size_t count)
+{
+    if(count > 0)
+    {
+        auto last_row = static_cast<std::uint64_t>(first_cell.get_row_index()) + count - 1;
+
+        if(last_row >= constants::MaxRow)
+        {
+            throw cell_coordinates_exception(first_cell.get_column_index(), static_cast<row_t>(std::min<std::uint64_t>(last_row, UINT32_MAX)));
+        }
+    }
+}
+
+// Calls write(cell, i) for the cell of each row [first_row, first_row + count)
+// in column, creating cells as needed. The row map is grown once for the whole
+// run instead of rehashing as rows are added. A written value replaces the
+// cell's formula, since calculate would overwrite the value otherwise.
+template<typename Writer>
+void write_column_cells(detail::worksheet_impl *d, const cell_reference &first_cell, std::size_t count, Writer write)
+{
+    check_column_run(first_cell, count);
+
+    if(count == 0)
+    {
+        return;
+    }
+
+    auto column = first_cell.get_column_index();
+    auto first_row = first_cell.get_row_index();
+    d->cell_map_.reserve(d->cell_map_.size() + count);
+
+    for(std::size_t i = 0; i < count; i++)
+    {
+        auto row = first_row + static_cast<row_t>(i);
+        auto &cell = d->get_or_create_cell(column, row);
+
+        if(!cell.formula_.empty())
+        {
+            cell.formula_.clear();
+            d->formula_count_--;
+            d->formula_changed(column, row);
+        }
+
+        d->value_changed(column, row);
+        cell.discard_lazy_string();
+        write(cell, i);
+    }
+}
+
+template<typename T>
+void write_column_values(detail::worksheet_impl *d, const cell_reference &first_cell, const T *values, std::size_t count)
+{
+    write_column_cells(d, first_cell, count, [values](detail::cell_impl &cell, std::size_t i)
+    {
+        cell.value_ = value(values[i]);
+        cell.is_date_ = false;
+    });
+}
+} // namespace
+
+void worksheet::write_column(const cell_reference &first_cell, const double *values, std::size_t count)
+{
+    d_->before_write();
+    write_column_values(d_, first_cell, values, count);
+}
+
+void worksheet::write_column(const cell_reference &first_cell, const std::vector<double> &values)
+{
+    d_->before_write();
+    write_column_values(d_, first_cell, values.data(), values.size());
+}
+
+void worksheet::write_column(const cell_reference &first_cell, const std::vector<std::string> &values)
+{
+    d_->before_write();
+    write_column_values(d_, first_cell, values.data(), values.size());
+}
+
+void worksheet::read_column(const cell_reference &first_cell, std::size_t count, std::vector<double> &values, std::vector<bool> &valid) const
+{
+    check_column_run(first_cell, count);
+
+    values.assign(count, 0);
+    valid.assign(count, false);
+
+    auto column = first_cell.get_column_index();
+    auto row = first_cell.get_row_index();
+
+    for(std::size_t i = 0; i < count; i++)
+    {
+        auto cell = d_->find_cell(column, row + static_cast<row_t>(i));
+
+        if(cell != nullptr && cell->value_.is(value::type::numeric))
+        {
+            values[i] = cell->value_.as<double>();
+            valid[i] = true;
+        }
+    }
+}
+
+void worksheet::read_column(const cell_reference &first_cell, std::size_t count, std::vector<std::string> &values, std::vector<bool> &valid) const
+{
+    check_column_run(first_cell, count);
+
+    values.assign(count, std::string());
+    valid.assign(count, false);
+
+    auto column = first_cell.get_column_index();
+    auto row = first_cell.get_row_index();
+
+    for(std::size_t i = 0; i < count; i++)
+    {
+        auto cell = d_->find_cell(column, row + static_cast<row_t>(i));
+
+        if(cell != nullptr && cell->value_.is(value::type::string))
+        {
+            cell->resolve_value();
+            values[i] = cell->value_.as<std::string>();
+            valid[i] = true;
+        }
+    }
+}
+
+namespace {
+
+style make_date_style(number_format::format format)
+{
+    style result;
+    result.set_number_format(number_format(format));
+    return result;
+}
+
+// Styles of unstyled cells written by the date column functions. Like an
+// xf_table's styles they are shared (see cell_impl::shared_style_), so they are
+// copied before a cell's style is modified and never change themselves.
+style DateStyle = make_date_style(number_format::format::date_xlsx14);
+style DateTimeStyle = make_date_style(number_format::format::date_xlsx22);
+
+// Store serials like cell::set_value(date) does: flag the cells as dates and
+// give them format, keeping the rest of any style they already have.
+void write_date_column(detail::worksheet_impl *d, const cell_reference &first_cell, const std::vector<double> &serials, style &date_style)
+{
+    auto format = date_style.get_number_format().get_format_code();
+    d->styles_changed_ = true;
+
+    write_column_cells(d, first_cell, serials.size(), [&](detail::cell_impl &cell, std::size_t i)
+    {
+        cell.value_ = value(serials[i]);
+        cell.is_date_ = true;
+
+        if(cell.style_ == nullptr)
+        {
+            cell.style_ = &date_style;
+            cell.shared_style_ = true;
+        }
+        else if(cell.style_->get_number_format().get_format_code() != format)
+        {
+            if(cell.shared_style_)
+            {
+                cell.style_ = new style(*cell.style_);
+                cell.shared_style_ = false;
+            }
+
+            cell.style_->set_number_format(number_format(format));
+        }
+    });
+}
+
+} // namespace
+
+void worksheet::write_column(const cell_reference &first_cell, const std::vector<date> &values)
+{
+    d_->before_write();
+
+    std::vector<int> days(values.size());
+    date::to_numbers(values.data(), values.size(), get_parent().get_properties().excel_base_date, days.data());
+
+    write_date_column(d_, first_cell, std::vector<double>(days.begin(), days.end()), DateStyle);
+}
+
+void worksheet::write_column(const cell_reference &first_cell, const std::vector<datetime> &values)
+{
+    d_->before_write();
+
+    std::vector<double> serials(values.size());
+    datetime::to_numbers(values.data(), values.size(), get_parent().get_properties().excel_base_date, serials.data());
+
+    write_date_column(d_, first_cell, serials, DateTimeStyle);
+}
+
+void worksheet::read_column(const cell_reference &first_cell, std::size_t count, std::vector<date> &values, std::vector<bool> &valid) const
+{
+    std::vector<double> serials;
+    read_column(first_cell, count, serials, valid);
+
+    // the datetime kernel truncates serials and clamps those out of range
+    // before converting them to whole days
+    std::vector<datetime> datetimes(count, datetime(0, 0, 0));
+    datetime::from_numbers(serials.data(), count, get_parent().get_properties().excel_base_date, datetimes.data());
+    values.assign(count, date(0, 0, 0));
+
+    for(std::size_t i = 0; i < count; i++)
+    {
+        if(valid[i])
+        {
+            values[i] = date(datetimes[i].year, datetimes[i].month, datetimes[i].day);
+        }
+    }
+}
+
+void worksheet::read_column(const cell_reference &first_cell, std::size_t count, std::vector<datetime> &values, std::vector<bool> &valid) const
+{
+    std::vector<double> serials;
+    read_column(first_cell, count, serials, valid);
+
+    values.assign(count, datetime(0, 0, 0));
+    datetime::from_numbers(serials.data(), count, get_parent().get_properties().excel_base_date, values.data());
+
+    for(std::size_t i = 0; i < count; i++)
+    {
+        if(!valid[i])
+        {
+            values[i] = datetime(0, 0, 0);
+        }
+    }
+}
+
+void worksheet::append_row(value *cells, std::size_t count)
+{
+    d_->before_write();
+    if(count > constants::MaxColumn)
+    {
+        throw cell_coordinates_exception(static_cast<int>(count - 1), 0);
+    }
+    
+    row_t row = d_->cell_map_.empty() ? 0 : d_->highest_row_ + 1;
+    
+    if(row >= constants::MaxRow)
+    {
+        throw cell_coordinates_exception(0, static_cast<int>(row));
+    }
+    
+    auto &row_cells = d_->cell_map_[row];
+    row_cells.reserve(count);
+    d_->highest_row_ = row;
+    
+    for(std::size_t i = 0; i < count; i++)
+    {
+        auto column = static_cast<column_t>(i);
+        auto &cell = row_cells.emplace(column, detail::cell_impl(d_, column, row)).first->second;
+        d_->value_changed(column, row);
+        cell.value_ = std::move(cells[i]);
+    }
+}
+
+void worksheet::append_row(std::vector<value> &&cells)
+{
+    append_row(cells.data(), cells.size());
+}
+
 xlnt::range worksheet::rows() const
 {
     return get_range(calculate_dimension());
@@ -534,26 +978,32 @@ bool worksheet::has_named_range(const std::string &name)
 
 void worksheet::remove_named_range(const std::string &name)
 {
+    d_->before_write();
     if(!has_named_range(name))
     {
         throw std::runtime_error("worksheet doesn't have named range");
     }
 
+    detail::structure_lock lock(d_->parent_->d_->structure_mutex_);
     d_->named_ranges_.erase(name);
+    d_->parent_->d_->unindex_named_range(name, d_);
 }
 
 void worksheet::reserve(std::size_t n)
 {
+    d_->before_write();
     d_->cell_map_.reserve(n);
 }
     
 void worksheet::increment_comments()
 {
+    d_->before_write();
     d_->comment_count_++;
 }
 
 void worksheet::decrement_comments()
 {
+    d_->before_write();
     d_->comment_count_--;
 }
 
@@ -564,6 +1014,7 @@ std::size_t worksheet::get_comment_count() const
 
 header_footer &worksheet::get_header_footer()
 {
+    d_->before_write();
     return d_->header_footer_;
 }
 
@@ -589,6 +1040,13 @@ footer::footer() : default_(true), font_size_(12)
 
 void worksheet::set_parent(xlnt::workbook &wb)
 {
+    if(d_->parent_ == &wb)
+    {
+        return;
+    }
+
+    // not a change to the sheet's contents, so allowed in read-only mode
+    d_->before_reference();
     d_->parent_ = &wb;
 }
 
@@ -1,6 +1,7 @@
 #include <algorithm>
 #include <array>
 #include <cmath>
+#include <cstdio>
 #include <sstream>
 #include <string>
 #include <unordered_map>
@@ -18,6 +19,9 @@
 #include <xlnt/workbook/document_properties.hpp>
 
 #include "constants.hpp"
+#include "detail/number_conversion.hpp"
+#include "detail/xf_table.hpp"
+#include "detail/xml_emitter.hpp"
 
 namespace xlnt {
 
@@ -201,9 +205,66 @@ std::string writer::write_workbook(const workbook &wb)
     return ss.str();
 }
 
+namespace {
+
+// Appends pugixml output to a string without going through a stream
+class string_xml_writer : public pugi::xml_writer
+{
+public:
+    explicit string_xml_writer(std::string &buffer) : buffer_(buffer)
+    {
+    }
+    
+    void write(const void *data, std::size_t size) override
+    {
+        buffer_.append(static_cast<const char *>(data), size);
+    }
+    
+private:
+    std::string &buffer_;
+};
+
+} // namespace
+
 std::string writer::write_worksheet(worksheet ws, const std::vector<std::string> &string_table, const std::unordered_map<std::size_t, std::string> &style_id_by_hash)
 {
-    ws.get_cell("A1");
+    return write_worksheet(ws, string_table, style_id_by_hash, nullptr);
+}
+
+std::string writer::write_worksheet(worksheet ws, const std::vector<std::string> &string_table, const detail::xf_table &source_xfs)
+{
+    return write_worksheet(ws, string_table, std::unordered_map<std::size_t, std::string>(), &source_xfs);
+}
+
+std::string writer::write_worksheet(worksheet ws, const std::vector<std::string> &string_table,
+    const std::unordered_map<std::size_t, std::string> &style_id_by_hash, const detail::xf_table *source_xfs)
+{
+    // styled cells refer to xf 1 of the table style_writer writes, or to their
+    // own xf when saving next to the source's styles.xml
+    auto style_index = [source_xfs](const cell &styled) -> std::uint64_t
+    {
+        std::size_t index = 1;
+
+        if(source_xfs != nullptr)
+        {
+            source_xfs->find(styled.get_style(), index);
+        }
+
+        return index;
+    };
+
+    // properties are read through a const handle so serializing doesn't count as
+    // changing the sheet (see workbook::set_read_only and workbook::snapshot)
+    const worksheet &const_ws = ws;
+
+    // the first index of each string, looked up once per string cell
+    std::unordered_map<std::string, std::size_t> string_indices;
+    string_indices.reserve(string_table.size());
+
+    for(std::size_t i = 0; i < string_table.size(); i++)
+    {
+        string_indices.emplace(string_table[i], i);
+    }
 
     pugi::xml_document doc;
     auto root_node = doc.append_child("worksheet");
@@ -211,10 +272,10 @@ std::string writer::write_worksheet(worksheet ws, const std::vector<std::string>
     root_node.append_attribute("xmlns:r").set_value(constants::Namespaces.at("r").c_str());
     auto sheet_pr_node = root_node.append_child("sheetPr");
     auto outline_pr_node = sheet_pr_node.append_child("outlinePr");
-    if(!ws.get_page_setup().is_default())
+    if(!const_ws.get_page_setup().is_default())
     {
         auto page_set_up_pr_node = sheet_pr_node.append_child("pageSetUpPr");
-        page_set_up_pr_node.append_attribute("fitToPage").set_value(ws.get_page_setup().fit_to_page() ? 1 : 0);
+        page_set_up_pr_node.append_attribute("fitToPage").set_value(const_ws.get_page_setup().fit_to_page() ? 1 : 0);
     }
     outline_pr_node.append_attribute("summaryBelow").set_value(1);
     outline_pr_node.append_attribute("summaryRight").set_value(1);
@@ -290,7 +351,7 @@ std::string writer::write_worksheet(worksheet ws, const std::vector<std::string>
             {
                 if(cell.has_style())
                 {
-                    styled_columns.push_back(xlnt::cell_reference::column_index_from_string(cell.get_column()));
+                    styled_columns.push_back(cell.get_reference().get_column_index() + 1);
                 }
             }
         }
@@ -308,7 +369,34 @@ std::string writer::write_worksheet(worksheet ws, const std::vector<std::string>
 
     std::unordered_map<std::string, std::string> hyperlink_references;
     
+    // sheetData is emitted straight into the output rather than built as a DOM.
+    // Everything before it is printed now and everything after it at the end,
+    // which gives exactly what doc.save would for the equivalent tree.
     auto sheet_data_node = root_node.append_child("sheetData");
+    std::string xml;
+    string_xml_writer xml_writer(xml);
+    detail::xml_emitter emitter(xml);
+    
+    xml.append("<?xml version=\"1.0\"?>\n");
+    emitter.start_element("worksheet", 0);
+    
+    for(auto attribute : root_node.attributes())
+    {
+        emitter.attribute(attribute.name(), attribute.value());
+    }
+    
+    emitter.end_start_tag();
+    
+    for(auto child = root_node.first_child(); child != sheet_data_node; child = child.next_sibling())
+    {
+        child.print(xml_writer, "\t", pugi::format_default, pugi::encoding_auto, 1);
+    }
+    
+    emitter.start_element("sheetData", 1);
+    bool any_rows = false;
+    pugi::xml_document scratch_document;
+    auto scratch_attribute = scratch_document.append_child("scratch").append_attribute("value");
+    
     for(auto row : ws.rows())
     {
         row_t min = (int)row.num_cells();
@@ -317,8 +405,9 @@ std::string writer::write_worksheet(worksheet ws, const std::vector<std::string>
         
         for(auto cell : row)
         {
-            min = std::min(min, cell_reference::column_index_from_string(cell.get_column()));
-            max = std::max(max, cell_reference::column_index_from_string(cell.get_column()));
+            auto column = cell.get_reference().get_column_index() + 1;
+            min = std::min(min, column);
+            max = std::max(max, column);
             
             if(!cell.garbage_collectible())
             {
@@ -331,122 +420,194 @@ std::string writer::write_worksheet(worksheet ws, const std::vector<std::string>
             continue;
         }
         
-        auto row_node = sheet_data_node.append_child("row");
-        row_node.append_attribute("r").set_value(row.front().get_row());
+        if(!any_rows)
+        {
+            emitter.end_start_tag();
+            any_rows = true;
+        }
+        
+        emitter.start_element("row", 2);
+        emitter.attribute("r", row.front().get_row());
+        
+        char spans_buffer[24];
+        std::sprintf(spans_buffer, "%u:%u", min, max);
+        emitter.attribute("spans", spans_buffer);
         
-        row_node.append_attribute("spans").set_value((std::to_string(min) + ":" + std::to_string(max)).c_str());
         if(ws.has_row_properties(row.front().get_row()))
         {
-            row_node.append_attribute("customHeight").set_value(1);
-            auto height = ws.get_row_properties(row.front().get_row()).height;
+            emitter.attribute("customHeight", 1);
+            auto height = const_ws.get_row_properties(row.front().get_row()).height;
             if(height == std::floor(height))
             {
-                row_node.append_attribute("ht").set_value((std::to_string((int)height) + ".0").c_str());
+                emitter.attribute("ht", (std::to_string((int)height) + ".0").c_str());
             }
             else
             {
-                row_node.append_attribute("ht").set_value(height);
+                // formatted by pugixml to match the rest of the document
+                scratch_attribute.set_value(height);
+                emitter.attribute("ht", scratch_attribute.value());
             }
         }
         //row_node.append_attribute("x14ac:dyDescent").set_value(0.25);
         
+        emitter.end_start_tag();
+        
         for(auto cell : row)
         {
-            if(!cell.garbage_collectible())
+            if(cell.garbage_collectible())
+            {
+                continue;
+            }
+            
+            if(cell.has_hyperlink())
             {
-                if(cell.has_hyperlink())
+                hyperlink_references[cell.get_hyperlink().get_id()] = cell.get_reference().to_string();
+            }
+
+            emitter.start_element("c", 3);
+            char reference_buffer[cell_reference::MaxStringLength];
+            cell.get_reference().to_string(reference_buffer);
+            emitter.attribute("r", reference_buffer);
+            
+            const auto &cell_value = cell.get_value();
+            
+            // a cell with a formula never gets a style attribute
+            if(cell.has_formula())
+            {
+                if(cell_value.is(value::type::string))
                 {
-                    hyperlink_references[cell.get_hyperlink().get_id()] = cell.get_reference().to_string();
+                    emitter.attribute("t", "str");
+                }
+                else if(cell_value.is(value::type::boolean))
+                {
+                    emitter.attribute("t", "b");
+                }
+                else if(cell_value.is(value::type::error))
+                {
+                    emitter.attribute("t", "e");
                 }
-
-                auto cell_node = row_node.append_child("c");
-                cell_node.append_attribute("r").set_value(cell.get_reference().to_string().c_str());
                 
-                if(cell.get_value().is(value::type::string))
+                emitter.end_start_tag();
+                emitter.start_element("f", 4);
+                emitter.text("f", cell.get_formula().c_str());
+                emitter.start_element("v", 4);
+                
+                if(cell_value.is(value::type::null))
                 {
-                    if(cell.has_formula())
-                    {
-                        cell_node.append_attribute("t").set_value("str");
-                        cell_node.append_child("f").text().set(cell.get_formula().c_str());
-                        cell_node.append_child("v").text().set(cell.get_value().to_string().c_str());
-                        continue;
-                    }
-
-                    int match_index = -1;
-                    for(int i = 0; i < (int)string_table.size(); i++)
-                    {
-                        if(string_table[i] == cell.get_value().as<std::string>())
-                        {
-                            match_index = i;
-                            break;
-                        }
-                    }
-                    
-                    if(match_index == -1)
-                    {
-                        if(cell.get_value().as<std::string>().empty())
-                        {
-                            cell_node.append_attribute("t").set_value("s");
-                        }
-                        else
-                        {
-                            cell_node.append_attribute("t").set_value("inlineStr");
-                            auto inline_string_node = cell_node.append_child("is");
-                            inline_string_node.append_child("t").text().set(cell.get_value().as<std::string>().c_str());
-                        }
-                    }
-                    else
-                    {
-                        cell_node.append_attribute("t").set_value("s");
-                        auto value_node = cell_node.append_child("v");
-                        value_node.text().set(match_index);
-                    }
+                    emitter.end_empty_element();
                 }
                 else
                 {
-                    if(!cell.get_value().is(value::type::null))
-                    {
-                        if(cell.get_value().is(value::type::boolean))
-                        {
-                            cell_node.append_attribute("t").set_value("b");
-                            auto value_node = cell_node.append_child("v");
-                            value_node.text().set(cell.get_value().as<bool>() ? 1 : 0);
-                        }
-                        else if(cell.get_value().is(value::type::numeric))
-                        {
-                            if(cell.has_formula())
-                            {
-                                cell_node.append_child("f").text().set(cell.get_formula().c_str());
-                                cell_node.append_child("v").text().set(cell.get_value().to_string().c_str());
-                                continue;
-                            }
-
-                            cell_node.append_attribute("t").set_value("n");
-                            auto value_node = cell_node.append_child("v");
-                            if(cell.get_value().is_integral())
-                            {
-                                value_node.text().set(cell.get_value().as<long long>());
-                            }
-                            else
-                            {
-                                value_node.text().set(cell.get_value().as<double>());
-                            }
-                        }
-                    }
-                    else if(cell.has_formula())
+                    emitter.text("v", cell_value.to_string().c_str());
+                }
+                
+                emitter.end_element("c", 3);
+                continue;
+            }
+            
+            if(cell_value.is(value::type::string))
+            {
+                const auto &string_value = cell_value.as<std::string>();
+                auto match = string_indices.find(string_value);
+                int match_index = match == string_indices.end() ? -1 : static_cast<int>(match->second);
+                
+                if(match_index == -1 && !string_value.empty())
+                {
+                    emitter.attribute("t", "inlineStr");
+                    
+                    if(cell.has_style())
                     {
-                        cell_node.append_child("f").text().set(cell.get_formula().c_str());
-                        cell_node.append_child("v");
-                        continue;
+                        emitter.attribute("s", style_index(cell));
                     }
+                    
+                    emitter.end_start_tag();
+                    emitter.start_element("is", 4);
+                    emitter.end_start_tag();
+                    emitter.start_element("t", 5);
+                    emitter.text("t", string_value.c_str());
+                    emitter.end_element("is", 4);
+                    emitter.end_element("c", 3);
+                    continue;
                 }
                 
+                emitter.attribute("t", "s");
+                
                 if(cell.has_style())
                 {
-                    cell_node.append_attribute("s").set_value(1);
+                    emitter.attribute("s", style_index(cell));
                 }
+                
+                if(match_index == -1)
+                {
+                    emitter.end_empty_element();
+                    continue;
+                }
+                
+                emitter.end_start_tag();
+                emitter.start_element("v", 4);
+                emitter.text("v", static_cast<std::uint64_t>(match_index));
+                emitter.end_element("c", 3);
+            }
+            else if(cell_value.is(value::type::boolean))
+            {
+                emitter.attribute("t", "b");
+                
+                if(cell.has_style())
+                {
+                    emitter.attribute("s", style_index(cell));
+                }
+                
+                emitter.end_start_tag();
+                emitter.start_element("v", 4);
+                emitter.text("v", cell_value.as<bool>() ? "1" : "0");
+                emitter.end_element("c", 3);
+            }
+            else if(cell_value.is(value::type::numeric))
+            {
+                emitter.attribute("t", "n");
+                
+                if(cell.has_style())
+                {
+                    emitter.attribute("s", style_index(cell));
+                }
+                
+                char number_buffer[detail::MaxDoubleLength];
+
+                if(cell_value.is_integral())
+                {
+                    detail::format_integer(cell_value.as<int64_t>(), number_buffer);
+                }
+                else
+                {
+                    detail::format_double(cell_value.as<double>(), number_buffer);
+                }
+
+                emitter.end_start_tag();
+                emitter.start_element("v", 4);
+                emitter.text("v", number_buffer);
+                emitter.end_element("c", 3);
+            }
+            else
+            {
+                if(cell.has_style())
+                {
+                    emitter.attribute("s", style_index(cell));
+                }
+                
+                emitter.end_empty_element();
             }
         }
+        
+        emitter.end_element("row", 2);
+    }
+    
+    if(any_rows)
+    {
+        emitter.end_element("sheetData", 1);
+    }
+    else
+    {
+        emitter.end_empty_element();
     }
 
     if(ws.has_auto_filter())
@@ -480,34 +641,34 @@ std::string writer::write_worksheet(worksheet ws, const std::vector<std::string>
         }
     }
     
-    if(!ws.get_page_setup().is_default())
+    if(!const_ws.get_page_setup().is_default())
     {
         auto print_options_node = root_node.append_child("printOptions");
-        print_options_node.append_attribute("horizontalCentered").set_value(ws.get_page_setup().get_horizontal_centered() ? 1 : 0);
-        print_options_node.append_attribute("verticalCentered").set_value(ws.get_page_setup().get_vertical_centered() ? 1 : 0);
+        print_options_node.append_attribute("horizontalCentered").set_value(const_ws.get_page_setup().get_horizontal_centered() ? 1 : 0);
+        print_options_node.append_attribute("verticalCentered").set_value(const_ws.get_page_setup().get_vertical_centered() ? 1 : 0);
     }
 
     auto page_margins_node = root_node.append_child("pageMargins");
         
-    page_margins_node.append_attribute("left").set_value(ws.get_page_margins().get_left());
-    page_margins_node.append_attribute("right").set_value(ws.get_page_margins().get_right());
-    page_margins_node.append_attribute("top").set_value(ws.get_page_margins().get_top());
-    page_margins_node.append_attribute("bottom").set_value(ws.get_page_margins().get_bottom());
-    page_margins_node.append_attribute("header").set_value(ws.get_page_margins().get_header());
-    page_margins_node.append_attribute("footer").set_value(ws.get_page_margins().get_footer());
-    
-    if(!ws.get_page_setup().is_default())
+    page_margins_node.append_attribute("left").set_value(const_ws.get_page_margins().get_left());
+    page_margins_node.append_attribute("right").set_value(const_ws.get_page_margins().get_right());
+    page_margins_node.append_attribute("top").set_value(const_ws.get_page_margins().get_top());
+    page_margins_node.append_attribute("bottom").set_value(const_ws.get_page_margins().get_bottom());
+    page_margins_node.append_attribute("header").set_value(const_ws.get_page_margins().get_header());
+    page_margins_node.append_attribute("footer").set_value(const_ws.get_page_margins().get_footer());
+    
+    if(!const_ws.get_page_setup().is_default())
     {
         auto page_setup_node = root_node.append_child("pageSetup");
         
-        std::string orientation_string = ws.get_page_setup().get_orientation() == page_setup::orientation::landscape ? "landscape" : "portrait";
+        std::string orientation_string = const_ws.get_page_setup().get_orientation() == page_setup::orientation::landscape ? "landscape" : "portrait";
         page_setup_node.append_attribute("orientation").set_value(orientation_string.c_str());
-        page_setup_node.append_attribute("paperSize").set_value((int)ws.get_page_setup().get_paper_size());
-        page_setup_node.append_attribute("fitToHeight").set_value(ws.get_page_setup().fit_to_height() ? 1 : 0);
-        page_setup_node.append_attribute("fitToWidth").set_value(ws.get_page_setup().fit_to_width() ? 1 : 0);
+        page_setup_node.append_attribute("paperSize").set_value((int)const_ws.get_page_setup().get_paper_size());
+        page_setup_node.append_attribute("fitToHeight").set_value(const_ws.get_page_setup().fit_to_height() ? 1 : 0);
+        page_setup_node.append_attribute("fitToWidth").set_value(const_ws.get_page_setup().fit_to_width() ? 1 : 0);
     }
     
-    if(!ws.get_header_footer().is_default())
+    if(!const_ws.get_header_footer().is_default())
     {
         auto header_footer_node = root_node.append_child("headerFooter");
         auto odd_header_node = header_footer_node.append_child("oddHeader");
@@ -518,10 +679,14 @@ std::string writer::write_worksheet(worksheet ws, const std::vector<std::string>
         odd_footer_node.text().set(footer_text.c_str());
     }
     
-    std::stringstream ss;
-    doc.save(ss);
+    for(auto child = sheet_data_node.next_sibling(); child; child = child.next_sibling())
+    {
+        child.print(xml_writer, "\t", pugi::format_default, pugi::encoding_auto, 1);
+    }
     
-    return ss.str();
+    emitter.end_element("worksheet", 0);
+    
+    return xml;
 }
     
 std::string writer::write_content_types(const workbook &wb)
@@ -1,6 +1,7 @@
 #include <algorithm>
 #include <cstring>
 #include <fstream>
+#include <limits>
 
 #ifdef _WIN32
 #define NOMINMAX
@@ -10,10 +11,41 @@
 #endif
 
 #include <xlnt/common/zip_file.hpp>
+#include <xlnt/common/memory.hpp>
 #include <xlnt/common/miniz.h>
 
+#include "detail/trace_scope.hpp"
+
 namespace {
 
+void *zip_allocate(void *, std::size_t items, std::size_t size)
+{
+    return xlnt::get_memory_functions().allocate(items * size);
+}
+
+void *zip_reallocate(void *, void *address, std::size_t items, std::size_t size)
+{
+    return xlnt::get_memory_functions().reallocate(address, items * size);
+}
+
+void zip_deallocate(void *, void *address)
+{
+    if(address != nullptr)
+    {
+        xlnt::get_memory_functions().deallocate(address);
+    }
+}
+
+// miniz only installs its malloc-based defaults when these are null, so set
+// them before every mz_zip_*_init
+void use_memory_functions(mz_zip_archive &archive)
+{
+    archive.m_pAlloc = &zip_allocate;
+    archive.m_pRealloc = &zip_reallocate;
+    archive.m_pFree = &zip_deallocate;
+    archive.m_pAlloc_opaque = nullptr;
+}
+
 std::string get_working_directory()
 {
 #ifdef _WIN32
@@ -391,6 +423,8 @@ void zip_file::start_read()
     {
         mz_zip_writer_end(archive_.get());
     }
+
+    use_memory_functions(*archive_);
         
     if(!mz_zip_reader_init_mem(archive_.get(), buffer_.data(), buffer_.size(), 0))
     {
@@ -426,6 +460,7 @@ void zip_file::start_write()
             mz_zip_archive archive_copy;
 	    std::memset(&archive_copy, 0, sizeof(mz_zip_archive));
             std::vector<char> buffer_copy(buffer_.begin(), buffer_.end());
+            use_memory_functions(archive_copy);
             
             if(!mz_zip_reader_init_mem(&archive_copy, buffer_copy.data(), buffer_copy.size(), 0))
             {
@@ -437,6 +472,7 @@ void zip_file::start_write()
             archive_->m_pWrite = &write_callback;
             archive_->m_pIO_opaque = &buffer_;
             buffer_ = std::vector<char>();
+            use_memory_functions(*archive_);
             
             if(!mz_zip_writer_init(archive_.get(), 0))
             {
@@ -463,6 +499,7 @@ void zip_file::start_write()
 
     archive_->m_pWrite = &write_callback;
     archive_->m_pIO_opaque = &buffer_;
+    use_memory_functions(*archive_);
 
     if(!mz_zip_writer_init(archive_.get(), 0))
     {
@@ -493,6 +530,8 @@ void zip_file::write(const std::string &filename, const std::string &arcname)
 
 void zip_file::writestr(const std::string &arcname, const std::string &bytes)
 {
+    detail::trace_scope trace("deflate", "zip", arcname);
+
     if(archive_->m_zip_mode != MZ_ZIP_MODE_WRITING)
     {
         start_write();
@@ -504,12 +543,41 @@ void zip_file::writestr(const std::string &arcname, const std::string &bytes)
     }
 }
 
+void zip_file::write_from(zip_file &source, const std::string &name)
+{
+    detail::trace_scope trace("copy", "zip", name);
+
+    if(source.archive_->m_zip_mode != MZ_ZIP_MODE_READING)
+    {
+        source.start_read();
+    }
+
+    if(archive_->m_zip_mode != MZ_ZIP_MODE_WRITING)
+    {
+        start_write();
+    }
+
+    int index = mz_zip_reader_locate_file(source.archive_.get(), name.c_str(), nullptr, 0);
+
+    if(index == -1)
+    {
+        throw std::runtime_error("file couldn't be read");
+    }
+
+    if(!mz_zip_writer_add_from_zip_reader(archive_.get(), source.archive_.get(), (mz_uint)index))
+    {
+        throw std::runtime_error("write error");
+    }
+}
+
 void zip_file::writestr(const zip_info &info, const std::string &bytes)
 {
     if(info.filename.empty() || info.date_time.year < 1980)
     {
         throw std::runtime_error("must specify a filename and valid date (year >= 1980");
     }
+
+    detail::trace_scope trace("deflate", "zip", info.filename);
     
     if(archive_->m_zip_mode != MZ_ZIP_MODE_WRITING)
     {
@@ -526,6 +594,7 @@ void zip_file::writestr(const zip_info &info, const std::string &bytes)
 
 std::string zip_file::read(const zip_info &info)
 {
+    detail::trace_scope trace("inflate", "zip", info.filename);
     std::size_t size;
     char *data = (char *)mz_zip_reader_extract_file_to_heap(archive_.get(), info.filename.c_str(), &size, 0);
     if(data == nullptr)
@@ -533,7 +602,7 @@ std::string zip_file::read(const zip_info &info)
 	throw std::runtime_error("file couldn't be read");
     }
     std::string extracted(data, data + size);
-    mz_free(data);
+    archive_->m_pFree(archive_->m_pAlloc_opaque, data);
     return extracted;
 }
 